@@ -85,6 +85,13 @@ typedef enum {
  */
 - (void)startCalibratingWithCompletionBlock:(void (^)(void))block;
 
+/*!
+ * The format of the audio being processed
+ *
+ *  Set by the audio controller when the filter is added, to match where it's added
+ *  (see @link AEAudioFilter::clientFormat @endlink). Defaults to the audio controller's
+ *  busAudioDescription.
+ */
 @property (nonatomic, assign) AudioStreamBasicDescription clientFormat;
 
 @property (nonatomic, assign) float ratio;
@@ -44,17 +44,35 @@ static inline double ratio_from_db(float db) { return pow(10.0, db / 10.0); };
 static inline double db_from_ratio(float value) { return 10.0 * log10(value); };
 static inline double db_from_value(UInt16 value) { return db_from_ratio((double)value / INT16_MAX); };
 
-#define kScratchBufferLength 8192
 #define kCalibrationTime 2.0
 #define kCalibrationThresholdOffset 3.0 // dB
 #define kMaxAutoThreshold -5.0
 
 typedef void (^AECalibrateCompletionBlock)(void);
 
+/*!
+ * Everything that depends on the client format, swapped as one on format changes
+ */
+typedef struct {
+    AEFloatConverter           *floatConverter;
+    AudioStreamBasicDescription clientFormat;
+} expander_setup_t;
+
+static expander_setup_t *expanderSetupCreate(AudioStreamBasicDescription clientFormat) {
+    expander_setup_t *setup = (expander_setup_t*)malloc(sizeof(expander_setup_t));
+    setup->clientFormat = clientFormat;
+    setup->floatConverter = [[AEFloatConverter alloc] initWithSourceFormat:clientFormat];
+    return setup;
+}
+
+static void expanderSetupDestroy(expander_setup_t *setup) {
+    [setup->floatConverter release];
+    free(setup);
+}
+
 @interface AEExpanderFilter ()  {
-    AudioStreamBasicDescription _clientFormat;
+    expander_setup_t *_setup;
     float        _maxValue;
-    float      **_scratchBuffer;
     UInt16       _threshold;
     UInt16       _offThreshold;
     double       _thresholdOffset;
@@ -67,13 +85,12 @@ typedef void (^AECalibrateCompletionBlock)(void);
 }
 
 @property (nonatomic, copy) AECalibrateCompletionBlock calibrateCompletionBlock;
-@property (nonatomic, retain) AEFloatConverter *floatConverter;
 @property (nonatomic, assign) AEAudioController *audioController;
 @end
 
 @implementation AEExpanderFilter
-@synthesize ratio = _ratio, attack = _attack, decay = _decay, calibrateCompletionBlock = _calibrateCompletionBlock, floatConverter = _floatConverter, audioController = _audioController;
-@dynamic threshold, hysteresis;
+@synthesize ratio = _ratio, attack = _attack, decay = _decay, calibrateCompletionBlock = _calibrateCompletionBlock, audioController = _audioController;
+@dynamic threshold, hysteresis, clientFormat;
 
 +(void)initialize {
     mach_timebase_info_data_t tinfo;
@@ -86,16 +103,7 @@ typedef void (^AECalibrateCompletionBlock)(void);
     if ( !(self = [super init]) ) return nil;
     
     self.audioController = audioController;
-    _clientFormat = audioController.audioDescription;
-    
-    self.floatConverter = [[[AEFloatConverter alloc] initWithSourceFormat:_clientFormat] autorelease];
-    
-    _scratchBuffer = (float**)malloc(sizeof(float*) * _clientFormat.mChannelsPerFrame);
-    assert(_scratchBuffer);
-    for ( int i=0; i<_clientFormat.mChannelsPerFrame; i++ ) {
-        _scratchBuffer[i] = malloc(sizeof(float) * kScratchBufferLength);
-        assert(_scratchBuffer[i]);
-    }
+    _setup = expanderSetupCreate(audioController.busAudioDescription);
     
     self.threshold = -13.0;
     
@@ -108,40 +116,27 @@ typedef void (^AECalibrateCompletionBlock)(void);
 }
 
 - (void)dealloc {
-    for ( int i=0; i<_clientFormat.mChannelsPerFrame; i++ ) {
-        free(_scratchBuffer[i]);
-    }
-    free(_scratchBuffer);
-    self.floatConverter = nil;
+    expanderSetupDestroy(_setup);
     [super dealloc];
 }
 
 -(void)setClientFormat:(AudioStreamBasicDescription)clientFormat {
+    expander_setup_t *setup = expanderSetupCreate(clientFormat);
+    expander_setup_t *oldSetup = _setup;
     
-    AEFloatConverter *floatConverter = [[[AEFloatConverter alloc] initWithSourceFormat:clientFormat] autorelease];
-    
-    float **scratchBuffer = (float**)malloc(sizeof(float*) * clientFormat.mChannelsPerFrame);
-    assert(scratchBuffer);
-    for ( int i=0; i<clientFormat.mChannelsPerFrame; i++ ) {
-        scratchBuffer[i] = malloc(sizeof(float) * kScratchBufferLength);
-        assert(scratchBuffer[i]);
-    }
-    
-    AEFloatConverter *oldFloatConverter = _floatConverter;
-    float** oldScratchBuffer = _scratchBuffer;
-    AudioStreamBasicDescription oldClientFormat = _clientFormat;
-    
-    [_audioController performSynchronousMessageExchangeWithBlock:^{
-        _floatConverter = floatConverter;
-        _scratchBuffer = scratchBuffer;
-        _clientFormat = clientFormat;
-    }];
+    // The render callback reads the setup pointer once per buffer, so a single store swaps everything
+    OSMemoryBarrier();
+    _setup = setup;
     
-    [oldFloatConverter release];
-    for ( int i=0; i<oldClientFormat.mChannelsPerFrame; i++ ) {
-        free(oldScratchBuffer[i]);
+    if ( _audioController ) {
+        [_audioController performBlockWhenRenderingComplete:^{ expanderSetupDestroy(oldSetup); }];
+    } else {
+        expanderSetupDestroy(oldSetup);
     }
-    free(oldScratchBuffer);
+}
+
+-(AudioStreamBasicDescription)clientFormat {
+    return _setup->clientFormat;
 }
 
 - (void)assignPreset:(AEExpanderFilterPreset)preset {
@@ -245,19 +240,42 @@ static OSStatus filterCallback(id                        filter,
                                AudioBufferList          *audio) {
     
     AEExpanderFilter *THIS = (AEExpanderFilter*)filter;
+    expander_setup_t *setup = THIS->_setup;
     
     OSStatus status = producer(producerToken, audio, &frames);
     if ( status != noErr ) return status;
     
+    if ( audio->mNumberBuffers != (setup->clientFormat.mFormatFlags & kAudioFormatFlagIsNonInterleaved ? setup->clientFormat.mChannelsPerFrame : 1) ) {
+        // Not the format we were set up for: pass it through untouched
+        return noErr;
+    }
+    
+    BOOL passThrough = AEFloatConverterIsPassThrough(setup->floatConverter);
+    float *scratchBuffer[audio->mNumberBuffers];
+    
+    if ( passThrough ) {
+        // Already floating-point: process in place
+        for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+            scratchBuffer[i] = (float*)audio->mBuffers[i].mData;
+        }
+    } else if ( !AEAudioControllerGetScratchBuffers(audioController, audio->mNumberBuffers, frames, scratchBuffer) ) {
+        // Too much audio for the engine's scratch space: pass it through untouched
+        return noErr;
+    }
+    
     // Convert audio to floats on scratch buffer for processing, and find maxima
     float max = 0;
     for ( int i=0; i<audio->mNumberBuffers; i++ ) {
-        vDSP_vflt16((SInt16*)audio->mBuffers[i].mData, 1, THIS->_scratchBuffer[i], 1, frames);
+        if ( !passThrough ) vDSP_vflt16((SInt16*)audio->mBuffers[i].mData, 1, scratchBuffer[i], 1, frames);
         float vmax = 0;
-        vDSP_maxmgv(THIS->_scratchBuffer[i], 1, &vmax, frames);
+        vDSP_maxmgv(scratchBuffer[i], 1, &vmax, frames);
         if ( vmax > max ) max = vmax;
     }
     
+    if ( passThrough ) {
+        // Thresholds and calibration are kept in 16-bit sample units
+        max *= INT16_MAX;
+    }
     
     if ( THIS->_calibrationStartTime ) {
         // Calibrating
@@ -294,7 +312,7 @@ static OSStatus filterCallback(id                        filter,
             break;
         case kStateClosed:
             for ( int i=0; i<audio->mNumberBuffers; i++ ) {
-                vDSP_vsmul(THIS->_scratchBuffer[i], 1, &THIS->_ratio, THIS->_scratchBuffer[i], 1, frames);
+                vDSP_vsmul(scratchBuffer[i], 1, &THIS->_ratio, scratchBuffer[i], 1, frames);
             }
             break;
             
@@ -305,11 +323,11 @@ static OSStatus filterCallback(id                        filter,
             float multiplierStart = (THIS->_multiplier * (1.0-THIS->_ratio)) + THIS->_ratio;
             float multiplierStep = -(1.0 / decayFrames) * (1.0-THIS->_ratio);
             if ( audio->mNumberBuffers == 2 ) {
-                vDSP_vrampmul2(THIS->_scratchBuffer[0], THIS->_scratchBuffer[1], 1, &multiplierStart, &multiplierStep, THIS->_scratchBuffer[0], THIS->_scratchBuffer[1], 1, rampDuration);
+                vDSP_vrampmul2(scratchBuffer[0], scratchBuffer[1], 1, &multiplierStart, &multiplierStep, scratchBuffer[0], scratchBuffer[1], 1, rampDuration);
             } else {
                 for ( int i=0; i<audio->mNumberBuffers; i++ ) {
                     float mul = multiplierStart;
-                    vDSP_vrampmul(THIS->_scratchBuffer[i], 1, &mul, &multiplierStep, THIS->_scratchBuffer[i], 1, rampDuration);
+                    vDSP_vrampmul(scratchBuffer[i], 1, &mul, &multiplierStep, scratchBuffer[i], 1, rampDuration);
                 }
             }
             
@@ -322,7 +340,7 @@ static OSStatus filterCallback(id                        filter,
             // Then multiply by the ratio
             if ( decayFrames < frames ) {
                 for ( int i=0; i<audio->mNumberBuffers; i++ ) {
-                    vDSP_vsmul(THIS->_scratchBuffer[i]+decayFrames, 1, &THIS->_ratio, THIS->_scratchBuffer[i], 1, frames-decayFrames);
+                    vDSP_vsmul(scratchBuffer[i]+decayFrames, 1, &THIS->_ratio, scratchBuffer[i], 1, frames-decayFrames);
                 }
             }
             break;
@@ -335,11 +353,11 @@ static OSStatus filterCallback(id                        filter,
             float multiplierStart = (THIS->_multiplier * (1.0-THIS->_ratio)) + THIS->_ratio;
             float multiplierStep = (1.0 / attackFrames) * (1.0-THIS->_ratio);
             if ( audio->mNumberBuffers == 2 ) {
-                vDSP_vrampmul2(THIS->_scratchBuffer[0], THIS->_scratchBuffer[1], 1, &multiplierStart, &multiplierStep, THIS->_scratchBuffer[0], THIS->_scratchBuffer[1], 1, rampDuration);
+                vDSP_vrampmul2(scratchBuffer[0], scratchBuffer[1], 1, &multiplierStart, &multiplierStep, scratchBuffer[0], scratchBuffer[1], 1, rampDuration);
             } else {
                 for ( int i=0; i<audio->mNumberBuffers; i++ ) {
                     float mul = multiplierStart;
-                    vDSP_vrampmul(THIS->_scratchBuffer[i], 1, &mul, &multiplierStep, THIS->_scratchBuffer[i], 1, rampDuration);
+                    vDSP_vrampmul(scratchBuffer[i], 1, &mul, &multiplierStep, scratchBuffer[i], 1, rampDuration);
                 }
             }
             
@@ -353,9 +371,11 @@ static OSStatus filterCallback(id                        filter,
         }
     }
     
-    // Copy audio back to buffers
-    for ( int i=0; i<audio->mNumberBuffers; i++ ) {
-        vDSP_vfix16(THIS->_scratchBuffer[i], 1, (SInt16*)audio->mBuffers[i].mData, 1, frames);
+    if ( !passThrough ) {
+        // Copy audio back to buffers
+        for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+            vDSP_vfix16(scratchBuffer[i], 1, (SInt16*)audio->mBuffers[i].mData, 1, frames);
+        }
     }
     
     return noErr;
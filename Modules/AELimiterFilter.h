@@ -50,6 +50,13 @@ extern "C" {
 @property (nonatomic, assign) UInt32 decay;
 @property (nonatomic, assign) float level;
 
+/*!
+ * The format of the audio being limited
+ *
+ *  Set by the audio controller when the filter is added, to match where it's added
+ *  (see @link AEAudioFilter::clientFormat @endlink). Defaults to the audio controller's
+ *  busAudioDescription.
+ */
 @property (nonatomic, assign) AudioStreamBasicDescription clientFormat;
 @end
 
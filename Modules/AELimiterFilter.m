@@ -27,114 +27,116 @@
 #import "AELimiter.h"
 #import "AEFloatConverter.h"
 #import <Accelerate/Accelerate.h>
+#import <libkern/OSAtomic.h>
+
+/*!
+ * Everything that depends on the client format, swapped as one on format changes
+ */
+typedef struct {
+    AELimiter                  *limiter;
+    AEFloatConverter           *floatConverter;
+    AudioStreamBasicDescription clientFormat;
+} limiter_setup_t;
+
+static limiter_setup_t *limiterSetupCreate(AudioStreamBasicDescription clientFormat, AELimiter *previousLimiter) {
+    limiter_setup_t *setup = (limiter_setup_t*)malloc(sizeof(limiter_setup_t));
+    setup->clientFormat = clientFormat;
+    setup->floatConverter = [[AEFloatConverter alloc] initWithSourceFormat:clientFormat];
+    setup->limiter = [[AELimiter alloc] initWithNumberOfChannels:clientFormat.mChannelsPerFrame sampleRate:clientFormat.mSampleRate];
+    if ( previousLimiter ) {
+        setup->limiter.hold = previousLimiter.hold;
+        setup->limiter.attack = previousLimiter.attack;
+        setup->limiter.decay = previousLimiter.decay;
+        setup->limiter.level = previousLimiter.level;
+    }
+    return setup;
+}
 
-const int kScratchBufferLength = 8192;
+static void limiterSetupDestroy(limiter_setup_t *setup) {
+    [setup->limiter release];
+    [setup->floatConverter release];
+    free(setup);
+}
 
 @interface AELimiterFilter () {
-    float **_scratchBuffer;
+    limiter_setup_t *_setup;
 }
-@property (nonatomic, retain) AEFloatConverter *floatConverter;
-@property (nonatomic, retain) AELimiter *limiter;
 @property (nonatomic, assign) AEAudioController *audioController;
 @end
 
 @implementation AELimiterFilter
-@synthesize floatConverter = _floatConverter, limiter = _limiter, clientFormat = _clientFormat, audioController = _audioController;
-@dynamic hold, attack, decay, level;
+@synthesize audioController = _audioController;
+@dynamic hold, attack, decay, level, clientFormat;
 
 - (id)initWithAudioController:(AEAudioController *)audioController {
     if ( !(self = [super init]) ) return nil;
     
     self.audioController = audioController;
-    _clientFormat = audioController.audioDescription;
-    self.floatConverter = [[[AEFloatConverter alloc] initWithSourceFormat:_clientFormat] autorelease];
-    self.limiter = [[[AELimiter alloc] initWithNumberOfChannels:_clientFormat.mChannelsPerFrame sampleRate:_clientFormat.mSampleRate] autorelease];
-    
-    _scratchBuffer = (float**)malloc(sizeof(float*) * _clientFormat.mChannelsPerFrame);
-    assert(_scratchBuffer);
-    for ( int i=0; i<_clientFormat.mChannelsPerFrame; i++ ) {
-        _scratchBuffer[i] = malloc(sizeof(float) * kScratchBufferLength);
-        assert(_scratchBuffer[i]);
-    }
+    _setup = limiterSetupCreate(audioController.busAudioDescription, nil);
     
     return self;
 }
 
 -(void)dealloc {
-    for ( int i=0; i<_clientFormat.mChannelsPerFrame; i++ ) {
-        free(_scratchBuffer[i]);
-    }
-    free(_scratchBuffer);
-    self.floatConverter = nil;
-    self.limiter = nil;
+    limiterSetupDestroy(_setup);
     self.audioController = nil;
     [super dealloc];
 }
 
 -(void)setClientFormat:(AudioStreamBasicDescription)clientFormat {
+    limiter_setup_t *setup = limiterSetupCreate(clientFormat, _setup->limiter);
+    limiter_setup_t *oldSetup = _setup;
     
-    AEFloatConverter *floatConverter = [[[AEFloatConverter alloc] initWithSourceFormat:clientFormat] autorelease];
-    
-    float **scratchBuffer = (float**)malloc(sizeof(float*) * clientFormat.mChannelsPerFrame);
-    assert(scratchBuffer);
-    for ( int i=0; i<clientFormat.mChannelsPerFrame; i++ ) {
-        scratchBuffer[i] = malloc(sizeof(float) * kScratchBufferLength);
-        assert(scratchBuffer[i]);
-    }
-    
-    AELimiter *limiter = [[AELimiter alloc] initWithNumberOfChannels:clientFormat.mChannelsPerFrame sampleRate:clientFormat.mSampleRate];
+    // The render callback reads the setup pointer once per buffer, so a single store swaps everything
+    OSMemoryBarrier();
+    _setup = setup;
     
-    AELimiter *oldLimiter = _limiter;
-    AEFloatConverter *oldFloatConverter = _floatConverter;
-    float** oldScratchBuffer = _scratchBuffer;
-    AudioStreamBasicDescription oldClientFormat = _clientFormat;
-    
-    [_audioController performSynchronousMessageExchangeWithBlock:^{
-        _limiter = limiter;
-        _floatConverter = floatConverter;
-        _scratchBuffer = scratchBuffer;
-        _clientFormat = clientFormat;
-    }];
-    
-    [oldLimiter release];
-    [oldFloatConverter release];
-    for ( int i=0; i<oldClientFormat.mChannelsPerFrame; i++ ) {
-        free(oldScratchBuffer[i]);
+    if ( _audioController ) {
+        [_audioController performBlockWhenRenderingComplete:^{ limiterSetupDestroy(oldSetup); }];
+    } else {
+        limiterSetupDestroy(oldSetup);
     }
-    free(oldScratchBuffer);
 }
 
+-(AudioStreamBasicDescription)clientFormat {
+    return _setup->clientFormat;
+}
 
 -(void)setHold:(UInt32)hold {
-    _limiter.hold = hold;
+    _setup->limiter.hold = hold;
 }
 
 -(UInt32)hold {
-    return _limiter.hold;
+    return _setup->limiter.hold;
 }
 
 -(void)setAttack:(UInt32)attack {
-    _limiter.attack = attack;
+    _setup->limiter.attack = attack;
 }
 
 -(UInt32)attack {
-    return _limiter.attack;
+    return _setup->limiter.attack;
+}
+
+-(NSTimeInterval)latency {
+    // The limiter holds back its attack length for lookahead
+    return _setup->clientFormat.mSampleRate ? _setup->limiter.attack / _setup->clientFormat.mSampleRate : 0;
 }
 
 -(void)setDecay:(UInt32)decay {
-    _limiter.decay = decay;
+    _setup->limiter.decay = decay;
 }
 
 -(UInt32)decay {
-    return _limiter.decay;
+    return _setup->limiter.decay;
 }
 
 -(void)setLevel:(float)level {
-    _limiter.level = level;
+    _setup->limiter.level = level;
 }
 
 -(float)level {
-    return _limiter.level;
+    return _setup->limiter.level;
 }
 
 static OSStatus filterCallback(id                        filter,
@@ -145,21 +147,41 @@ static OSStatus filterCallback(id                        filter,
                                UInt32                    frames,
                                AudioBufferList          *audio) {
     
-    assert(frames < kScratchBufferLength);
     AELimiterFilter *THIS = filter;
+    limiter_setup_t *setup = THIS->_setup;
     
     OSStatus status = producer(producerToken, audio, &frames);
     if ( status != noErr ) return status;
     
-    // Copy buffer into floating point scratch buffer
-    AEFloatConverterToFloat(THIS->_floatConverter, audio, THIS->_scratchBuffer, frames);
+    if ( audio->mNumberBuffers != (setup->clientFormat.mFormatFlags & kAudioFormatFlagIsNonInterleaved ? setup->clientFormat.mChannelsPerFrame : 1) ) {
+        // Not the format we were set up for: pass it through untouched
+        return noErr;
+    }
+    
+    BOOL passThrough = AEFloatConverterIsPassThrough(setup->floatConverter);
+    float *scratchBuffer[setup->clientFormat.mChannelsPerFrame];
+    
+    if ( passThrough ) {
+        // Already floating-point: limit in place
+        for ( int i=0; i<setup->clientFormat.mChannelsPerFrame; i++ ) {
+            scratchBuffer[i] = (float*)audio->mBuffers[i].mData;
+        }
+    } else {
+        if ( !AEAudioControllerGetScratchBuffers(audioController, setup->clientFormat.mChannelsPerFrame, frames, scratchBuffer) ) {
+            // Too much audio for the engine's scratch space: pass it through untouched
+            return noErr;
+        }
+        
+        // Copy buffer into floating point scratch buffer
+        AEFloatConverterToFloat(setup->floatConverter, audio, scratchBuffer, frames);
+    }
     
-    AELimiterEnqueue(THIS->_limiter, THIS->_scratchBuffer, frames, NULL);
-    AELimiterDequeue(THIS->_limiter, THIS->_scratchBuffer, &frames, NULL);
+    AELimiterEnqueue(setup->limiter, scratchBuffer, frames, NULL);
+    AELimiterDequeue(setup->limiter, scratchBuffer, &frames, NULL);
     
-    if ( frames > 0 ) {
+    if ( frames > 0 && !passThrough ) {
         // Convert back to buffer
-        AEFloatConverterFromFloat(THIS->_floatConverter, THIS->_scratchBuffer, audio, frames);
+        AEFloatConverterFromFloat(setup->floatConverter, scratchBuffer, audio, frames);
     }
     
     return noErr;
@@ -141,4 +141,9 @@ static void audioCallback(id                        receiver,
     return audioCallback;
 }
 
+-(BOOL)requiresClientFormat {
+    // Output is mixed with input and written in the audio controller's format
+    return YES;
+}
+
 @end
@@ -0,0 +1,106 @@
+//
+//  AERenderAheadChannel.h
+//  TheAmazingAudioEngine
+//
+//  This software is provided 'as-is', without any express or implied
+//  warranty.  In no event will the authors be held liable for any damages
+//  arising from the use of this software.
+//
+//  Permission is granted to anyone to use this software for any purpose,
+//  including commercial applications, and to alter it and redistribute it
+//  freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and must not be
+//     misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import "TheAmazingAudioEngine.h"
+
+/*!
+ * Render-ahead channel
+ *
+ *  Wraps an expensive channel (an instrument, a channel with a long reverb, etc.) and
+ *  renders it ahead of time on a worker thread, so that a slow buffer doesn't cause a
+ *  dropout. The realtime render callback only copies audio out of a circular buffer.
+ *
+ *  Add this object to the audio controller in place of the wrapped channel, and set the
+ *  volume, pan, mute and playing state on this object. Changes made directly to the
+ *  wrapped channel are heard up to renderAheadTime late; use 
+ *  @link performTimedBlock:atTime: @endlink to make changes that land on an exact frame.
+ */
+@interface AERenderAheadChannel : NSObject <AEAudioPlayable>
+
+/*!
+ * Initialise
+ *
+ *  The worker thread starts immediately, and fills the buffer before playback starts.
+ *
+ * @param channel The channel to render ahead
+ * @param audioController The Audio Controller
+ * @param renderAheadTime How far ahead of playback to render, in seconds
+ */
+- (id)initWithChannel:(id<AEAudioPlayable>)channel audioController:(AEAudioController*)audioController renderAheadTime:(NSTimeInterval)renderAheadTime;
+
+/*!
+ * Perform a block at an exact time in the wrapped channel's audio
+ *
+ *  The block is performed on the worker thread, just before rendering the audio that
+ *  will be played at the given time. The buffer is split at that frame, so the block
+ *  is always given a zero offset, and changes it makes to the wrapped channel apply
+ *  from the target frame onwards.
+ *
+ *  The time may be given as a host time, relative to the timestamps passed to the
+ *  channel's render callback, or as a sample time in the wrapped channel's own
+ *  timeline. Times that have already been rendered are performed before the next
+ *  frame is rendered.
+ *
+ *  Until playback starts, it's not known when the audio rendered so far will be heard,
+ *  so host-time blocks are held until then. One whose time falls within the audio
+ *  rendered before playback started is performed as soon as playback begins, up to
+ *  @link renderAheadTime @endlink late. Use a sample time for a block that must land
+ *  exactly on a frame near the start of playback.
+ *
+ *  Call from the main thread only.
+ *
+ * @param block The block to perform
+ * @param time The time at which to perform the block
+ */
+- (void)performTimedBlock:(AEAudioControllerTimedMessageBlock)block atTime:(const AudioTimeStamp*)time;
+
+/*!
+ * The wrapped channel
+ */
+@property (nonatomic, readonly) id<AEAudioPlayable> channel;
+
+/*!
+ * How far ahead of playback the channel is rendered, in seconds
+ */
+@property (nonatomic, readonly) NSTimeInterval renderAheadTime;
+
+/*!
+ * Number of times the worker thread fell behind and silence was played
+ */
+@property (nonatomic, readonly) int underrunCount;
+
+@property (nonatomic, assign) float volume;
+@property (nonatomic, assign) float pan;
+@property (nonatomic, assign) BOOL channelIsPlaying;
+@property (nonatomic, assign) BOOL channelIsMuted;
+@property (nonatomic, readonly) AudioStreamBasicDescription audioDescription;
+@end
+
+#ifdef __cplusplus
+}
+#endif
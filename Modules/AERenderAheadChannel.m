@@ -0,0 +1,379 @@
+//
+//  AERenderAheadChannel.m
+//  TheAmazingAudioEngine
+//
+//  This software is provided 'as-is', without any express or implied
+//  warranty.  In no event will the authors be held liable for any damages
+//  arising from the use of this software.
+//
+//  Permission is granted to anyone to use this software for any purpose,
+//  including commercial applications, and to alter it and redistribute it
+//  freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and must not be
+//     misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source distribution.
+//
+
+#import "AERenderAheadChannel.h"
+#import "TPCircularBuffer.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+
+#define checkResult(result,operation) (_checkResult((result),(operation),strrchr(__FILE__, '/')+1,__LINE__))
+static inline BOOL _checkResult(OSStatus result, const char *operation, const char* file, int line) {
+    if ( result != noErr ) {
+        NSLog(@"%s:%d: %s result %d %08X %4.4s\n", file, line, operation, (int)result, (int)result, (char*)&result);
+        return NO;
+    }
+    return YES;
+}
+
+static const UInt32 kRenderChunkFrames      = 512;
+static const int kMaximumScheduledBlocks    = 64;
+
+typedef struct {
+    AEAudioControllerTimedMessageBlock block;
+    AudioTimeStamp time;
+} scheduled_block_t;
+
+@interface AERenderAheadChannel () {
+    AEAudioControllerRenderCallback _channelRenderCallback;
+    AudioStreamBasicDescription _audioDescription;
+    int                 _bufferCount;
+    UInt32              _bytesPerFrame;
+    TPCircularBuffer   *_buffers;
+    AudioBufferList    *_renderBufferList;
+    UInt32              _renderAheadFrames;
+    double              _hostTicksPerFrame;
+
+    volatile int64_t    _renderedFrames;
+    volatile int64_t    _consumedFrames;
+    volatile int32_t    _underrunCount;
+
+    volatile int32_t    _playbackSequence;
+    int64_t             _playbackFrame;
+    uint64_t            _playbackHostTime;
+
+    TPCircularBuffer    _scheduleQueue;
+    scheduled_block_t   _pendingBlocks[kMaximumScheduledBlocks];
+    int                 _pendingBlockCount;
+
+    pthread_t           _thread;
+    semaphore_t         _semaphore;
+    volatile BOOL       _stop;
+}
+@property (nonatomic, retain, readwrite) id<AEAudioPlayable> channel;
+@property (nonatomic, retain) AEAudioController *audioController;
+@end
+
+@implementation AERenderAheadChannel
+@synthesize channel = _channel, audioController = _audioController, renderAheadTime = _renderAheadTime;
+@synthesize volume = _volume, pan = _pan, channelIsPlaying = _channelIsPlaying, channelIsMuted = _channelIsMuted;
+
+static void *renderAheadThreadEntry(void *userInfo);
+
+- (id)initWithChannel:(id<AEAudioPlayable>)channel audioController:(AEAudioController*)audioController renderAheadTime:(NSTimeInterval)renderAheadTime {
+    if ( !(self = [super init]) ) return nil;
+
+    self.channel = channel;
+    self.audioController = audioController;
+    _channelRenderCallback = channel.renderCallback;
+    _renderAheadTime = renderAheadTime;
+
+    _volume = [channel respondsToSelector:@selector(volume)] ? channel.volume : 1.0;
+    _pan = [channel respondsToSelector:@selector(pan)] ? channel.pan : 0.0;
+    _channelIsMuted = [channel respondsToSelector:@selector(channelIsMuted)] ? channel.channelIsMuted : NO;
+    _channelIsPlaying = YES;
+
+    _audioDescription = [channel respondsToSelector:@selector(audioDescription)] ? channel.audioDescription : audioController.audioDescription;
+    BOOL nonInterleaved = _audioDescription.mFormatFlags & kAudioFormatFlagIsNonInterleaved;
+    _bufferCount = nonInterleaved ? _audioDescription.mChannelsPerFrame : 1;
+    _bytesPerFrame = _audioDescription.mBytesPerFrame;
+    _renderAheadFrames = MAX(kRenderChunkFrames, (UInt32)ceil(renderAheadTime * _audioDescription.mSampleRate));
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    _hostTicksPerFrame = (1.0e9 * timebase.denom / timebase.numer) / _audioDescription.mSampleRate;
+
+    // Room for the render-ahead window plus one chunk in flight
+    _buffers = (TPCircularBuffer*)calloc(_bufferCount, sizeof(TPCircularBuffer));
+    for ( int i=0; i<_bufferCount; i++ ) {
+        TPCircularBufferInit(&_buffers[i], (_renderAheadFrames + kRenderChunkFrames) * _bytesPerFrame);
+    }
+
+    _renderBufferList = (AudioBufferList*)malloc(sizeof(AudioBufferList) + (_bufferCount-1)*sizeof(AudioBuffer));
+    _renderBufferList->mNumberBuffers = _bufferCount;
+    for ( int i=0; i<_bufferCount; i++ ) {
+        _renderBufferList->mBuffers[i].mNumberChannels = nonInterleaved ? 1 : _audioDescription.mChannelsPerFrame;
+    }
+
+    TPCircularBufferInit(&_scheduleQueue, kMaximumScheduledBlocks * sizeof(scheduled_block_t));
+
+    if ( !checkResult(semaphore_create(mach_task_self(), &_semaphore, SYNC_POLICY_FIFO, 0), "semaphore_create") ) {
+        [self release];
+        return nil;
+    }
+
+    if ( pthread_create(&_thread, NULL, renderAheadThreadEntry, self) != 0 ) {
+        NSLog(@"TAAE: Couldn't create render-ahead thread");
+        semaphore_destroy(mach_task_self(), _semaphore);
+        _semaphore = 0;
+        [self release];
+        return nil;
+    }
+
+    return self;
+}
+
+- (void)dealloc {
+    if ( _thread ) {
+        _stop = YES;
+        OSMemoryBarrier();
+        semaphore_signal(_semaphore);
+        pthread_join(_thread, NULL);
+    }
+    if ( _semaphore ) {
+        semaphore_destroy(mach_task_self(), _semaphore);
+    }
+
+    for ( int i=0; i<_pendingBlockCount; i++ ) {
+        [_pendingBlocks[i].block release];
+    }
+    int32_t availableBytes;
+    scheduled_block_t *entry;
+    while ( (entry = TPCircularBufferTail(&_scheduleQueue, &availableBytes)) && availableBytes >= (int32_t)sizeof(scheduled_block_t) ) {
+        [entry->block release];
+        TPCircularBufferConsume(&_scheduleQueue, sizeof(scheduled_block_t));
+    }
+    TPCircularBufferCleanup(&_scheduleQueue);
+
+    if ( _buffers ) {
+        for ( int i=0; i<_bufferCount; i++ ) {
+            TPCircularBufferCleanup(&_buffers[i]);
+        }
+        free(_buffers);
+    }
+    if ( _renderBufferList ) free(_renderBufferList);
+
+    self.channel = nil;
+    self.audioController = nil;
+    [super dealloc];
+}
+
+- (void)performTimedBlock:(AEAudioControllerTimedMessageBlock)block atTime:(const AudioTimeStamp*)time {
+    scheduled_block_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.block = [block copy];
+    if ( time ) entry.time = *time;
+
+    if ( !TPCircularBufferProduceBytes(&_scheduleQueue, &entry, sizeof(entry)) ) {
+        NSLog(@"TAAE: Render-ahead block queue is full, dropping block");
+        [entry.block release];
+        return;
+    }
+
+    semaphore_signal(_semaphore);
+}
+
+-(int)underrunCount {
+    return _underrunCount;
+}
+
+-(AudioStreamBasicDescription)audioDescription {
+    return _audioDescription;
+}
+
+#pragma mark - Worker thread
+
+static BOOL playbackPosition(AERenderAheadChannel *THIS, int64_t *frame, uint64_t *hostTime) {
+    while ( 1 ) {
+        int32_t sequence = THIS->_playbackSequence;
+        OSMemoryBarrier();
+        if ( sequence & 1 ) continue;
+        *frame = THIS->_playbackFrame;
+        *hostTime = THIS->_playbackHostTime;
+        OSMemoryBarrier();
+        if ( sequence == THIS->_playbackSequence ) break;
+    }
+    return *hostTime != 0;
+}
+
+static int64_t scheduledBlockOffset(AERenderAheadChannel *THIS, const AudioTimeStamp *target, const AudioTimeStamp *timestamp) {
+    if ( target->mFlags & kAudioTimeStampHostTimeValid ) {
+        if ( !(timestamp->mFlags & kAudioTimeStampHostTimeValid) ) {
+            // Not playing yet, so there's no way to tell when this will be heard: hold on to it until we can
+            return INT64_MAX;
+        }
+        return (int64_t)floor(((double)target->mHostTime - (double)timestamp->mHostTime) / THIS->_hostTicksPerFrame);
+    } else if ( target->mFlags & kAudioTimeStampSampleTimeValid ) {
+        return (int64_t)(target->mSampleTime - timestamp->mSampleTime);
+    }
+    return 0;
+}
+
+static void receiveScheduledBlocks(AERenderAheadChannel *THIS) {
+    int32_t availableBytes;
+    scheduled_block_t *entry;
+    while ( THIS->_pendingBlockCount < kMaximumScheduledBlocks
+                && (entry = TPCircularBufferTail(&THIS->_scheduleQueue, &availableBytes))
+                && availableBytes >= (int32_t)sizeof(scheduled_block_t) ) {
+        THIS->_pendingBlocks[THIS->_pendingBlockCount++] = *entry;
+        TPCircularBufferConsume(&THIS->_scheduleQueue, sizeof(scheduled_block_t));
+    }
+}
+
+static UInt32 performDueBlocks(AERenderAheadChannel *THIS, const AudioTimeStamp *timestamp, UInt32 frames) {
+    // Perform blocks that are due, and shorten the render so it stops at the next one
+    for ( int i=0; i<THIS->_pendingBlockCount; i++ ) {
+        int64_t offset = scheduledBlockOffset(THIS, &THIS->_pendingBlocks[i].time, timestamp);
+        if ( offset <= 0 ) {
+            AEAudioControllerTimedMessageBlock block = THIS->_pendingBlocks[i].block;
+            @autoreleasepool {
+                block(0);
+            }
+            [block release];
+            memmove(&THIS->_pendingBlocks[i], &THIS->_pendingBlocks[i+1], (THIS->_pendingBlockCount-i-1) * sizeof(scheduled_block_t));
+            THIS->_pendingBlockCount--;
+            i--;
+        } else if ( offset < frames ) {
+            frames = (UInt32)offset;
+        }
+    }
+    return frames;
+}
+
+static void renderAheadFill(AERenderAheadChannel *THIS) {
+    while ( !THIS->_stop ) {
+        receiveScheduledBlocks(THIS);
+
+        int64_t fillCount = THIS->_renderedFrames - THIS->_consumedFrames;
+        if ( fillCount >= THIS->_renderAheadFrames && THIS->_pendingBlockCount == 0 ) break;
+
+        AudioTimeStamp timestamp;
+        memset(&timestamp, 0, sizeof(timestamp));
+        timestamp.mFlags = kAudioTimeStampSampleTimeValid;
+        timestamp.mSampleTime = THIS->_renderedFrames;
+        int64_t playbackFrame;
+        uint64_t playbackHostTime;
+        if ( playbackPosition(THIS, &playbackFrame, &playbackHostTime) ) {
+            timestamp.mFlags |= kAudioTimeStampHostTimeValid;
+            timestamp.mHostTime = playbackHostTime + (int64_t)((THIS->_renderedFrames - playbackFrame) * THIS->_hostTicksPerFrame);
+        }
+
+        if ( fillCount >= THIS->_renderAheadFrames ) {
+            // Window is full; just perform any blocks that have come due before what's been rendered
+            performDueBlocks(THIS, &timestamp, 0);
+            break;
+        }
+
+        UInt32 frames = MIN(kRenderChunkFrames, (UInt32)(THIS->_renderAheadFrames - fillCount));
+        frames = performDueBlocks(THIS, &timestamp, frames);
+
+        for ( int i=0; i<THIS->_bufferCount; i++ ) {
+            int32_t availableBytes;
+            THIS->_renderBufferList->mBuffers[i].mData = TPCircularBufferHead(&THIS->_buffers[i], &availableBytes);
+            frames = MIN(frames, availableBytes / THIS->_bytesPerFrame);
+        }
+        if ( frames == 0 ) break;
+
+        for ( int i=0; i<THIS->_bufferCount; i++ ) {
+            THIS->_renderBufferList->mBuffers[i].mDataByteSize = frames * THIS->_bytesPerFrame;
+            memset(THIS->_renderBufferList->mBuffers[i].mData, 0, frames * THIS->_bytesPerFrame);
+        }
+
+        OSStatus result = THIS->_channelRenderCallback(THIS->_channel, THIS->_audioController, &timestamp, frames, THIS->_renderBufferList);
+
+        for ( int i=0; i<THIS->_bufferCount; i++ ) {
+            if ( result == AEAudioControllerOutputIsSilence ) {
+                memset(THIS->_renderBufferList->mBuffers[i].mData, 0, frames * THIS->_bytesPerFrame);
+            }
+            TPCircularBufferProduce(&THIS->_buffers[i], frames * THIS->_bytesPerFrame);
+        }
+
+        OSAtomicAdd64Barrier(frames, &THIS->_renderedFrames);
+    }
+}
+
+static void *renderAheadThreadEntry(void *userInfo) {
+    AERenderAheadChannel *THIS = (AERenderAheadChannel*)userInfo;
+
+    // Run often enough to top up one chunk at a time, but stay preemptible by the Core Audio thread
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    uint32_t period = (uint32_t)((kRenderChunkFrames / THIS->_audioDescription.mSampleRate) * 1.0e9 * timebase.denom / timebase.numer);
+    thread_time_constraint_policy_data_t policy = {
+        .period      = period,
+        .computation = period / 2,
+        .constraint  = period,
+        .preemptible = true
+    };
+    checkResult(thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY, (thread_policy_t)&policy, THREAD_TIME_CONSTRAINT_POLICY_COUNT),
+                "thread_policy_set");
+
+    while ( !THIS->_stop ) {
+        renderAheadFill(THIS);
+        semaphore_wait(THIS->_semaphore);
+    }
+
+    return NULL;
+}
+
+#pragma mark - Realtime thread
+
+static OSStatus renderCallback(id                        channel,
+                               AEAudioController        *audioController,
+                               const AudioTimeStamp     *time,
+                               UInt32                    frames,
+                               AudioBufferList          *audio) {
+    AERenderAheadChannel *THIS = channel;
+
+    if ( audio->mNumberBuffers != THIS->_bufferCount ) return AEAudioControllerOutputIsSilence;
+
+    int64_t consumedFrames = THIS->_consumedFrames;
+
+    // Tell the worker when the next frame is going to be heard
+    OSAtomicIncrement32Barrier(&THIS->_playbackSequence);
+    THIS->_playbackFrame = consumedFrames;
+    THIS->_playbackHostTime = time->mHostTime;
+    OSAtomicIncrement32Barrier(&THIS->_playbackSequence);
+
+    OSMemoryBarrier();
+    UInt32 availableFrames = (UInt32)MIN((int64_t)frames, THIS->_renderedFrames - consumedFrames);
+
+    for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+        int32_t availableBytes;
+        void *tail = TPCircularBufferTail(&THIS->_buffers[i], &availableBytes);
+        if ( availableFrames ) {
+            memcpy(audio->mBuffers[i].mData, tail, availableFrames * THIS->_bytesPerFrame);
+            TPCircularBufferConsume(&THIS->_buffers[i], availableFrames * THIS->_bytesPerFrame);
+        }
+        if ( availableFrames < frames ) {
+            memset((char*)audio->mBuffers[i].mData + availableFrames * THIS->_bytesPerFrame, 0, (frames - availableFrames) * THIS->_bytesPerFrame);
+        }
+    }
+
+    OSAtomicAdd64Barrier(availableFrames, &THIS->_consumedFrames);
+
+    if ( availableFrames < frames ) {
+        OSAtomicIncrement32(&THIS->_underrunCount);
+    }
+
+    semaphore_signal(THIS->_semaphore);
+
+    return availableFrames ? noErr : AEAudioControllerOutputIsSilence;
+}
+
+-(AEAudioControllerRenderCallback)renderCallback {
+    return renderCallback;
+}
+
+@end
@@ -0,0 +1,204 @@
+//
+//  AERenderBenchmark.h
+//  TheAmazingAudioEngine
+//
+//  This software is provided 'as-is', without any express or implied
+//  warranty.  In no event will the authors be held liable for any damages
+//  arising from the use of this software.
+//
+//  Permission is granted to anyone to use this software for any purpose,
+//  including commercial applications, and to alter it and redistribute it
+//  freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and must not be
+//     misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#import <Foundation/Foundation.h>
+#import "TheAmazingAudioEngine.h"
+
+/*!
+ * Render benchmark
+ *
+ *  Measures how long the engine takes to mix a group of channels, by rendering offline
+ *  with a fresh audio controller for each configuration (see
+ *  @link AEAudioController::initForOfflineRenderingWithAudioDescription: @endlink).
+ *  Channels play noise, panned across the stereo field, so nothing is skipped as silent.
+ *
+ *  Run it on the device, in a release build, with nothing else playing. Each configuration
+ *  renders for the given duration as fast as it can, so a full report takes a while; call it
+ *  from a background thread.
+ */
+@interface AERenderBenchmark : NSObject
+
+/*!
+ * Measure the render load of one configuration
+ *
+ * @param channelCount      Number of channels in the group
+ * @param softwareMixing    Whether to mix the group in software (see @link AEAudioController::softwareMixingEnabled @endlink)
+ * @param renderThreadCount Number of render worker threads (see @link AEAudioController::renderThreadCount @endlink)
+ * @param duration          Seconds of audio to render
+ * @return Time taken to render, as a fraction of the duration of the audio rendered, or 0 on failure
+ */
++ (double)renderLoadWithChannelCount:(int)channelCount
+                      softwareMixing:(BOOL)softwareMixing
+                   renderThreadCount:(NSUInteger)renderThreadCount
+                            duration:(NSTimeInterval)duration;
+
+/*!
+ * Compare software mixing with the mixer unit, for groups of 2 to 100 channels
+ *
+ * @param duration Seconds of audio to render for each configuration
+ * @return A table of render loads, one line per channel count
+ */
++ (NSString*)mixingReportWithDuration:(NSTimeInterval)duration;
+
+/*!
+ * Measure how parallel rendering scales with group size and render thread count
+ *
+ *  Renders software-mixed groups of 8 to 256 channels with 0 to 3 render worker threads.
+ *  Thread counts are limited as for @link AEAudioController::renderThreadCount @endlink,
+ *  so on devices with fewer cores the higher columns repeat the highest count available.
+ *
+ * @param duration Seconds of audio to render for each configuration
+ * @return A table of render loads, one line per channel count and one column per thread count
+ */
++ (NSString*)scalingReportWithDuration:(NSTimeInterval)duration;
+
+/*!
+ * Measure the render load of one configuration, with a custom setup
+ *
+ *  Creates a group of channels as for @link renderLoadWithChannelCount:softwareMixing:renderThreadCount:duration: @endlink,
+ *  then calls the given block to configure the audio controller, group or channels before rendering.
+ *
+ * @param channelCount      Number of channels in the group
+ * @param audioDescription  Audio format for the audio controller; channels always render non-interleaved float
+ * @param configure         Block to set up the audio controller, group and channels
+ * @param duration          Seconds of audio to render
+ * @return Time taken to render, as a fraction of the duration of the audio rendered, or 0 on failure
+ */
++ (double)renderLoadWithChannelCount:(int)channelCount
+                    audioDescription:(AudioStreamBasicDescription)audioDescription
+                           configure:(void (^)(AEAudioController *audioController, AEChannelGroupRef group, NSArray *channels))configure
+                            duration:(NSTimeInterval)duration;
+
+/*!
+ * Measure the cost of filter chains, for 1 to 15 pass-through filters on each of 8 channels
+ *
+ *  Each filter just produces its input, so the figures show the engine's own cost per filter,
+ *  with the mixer unit and with software mixing.
+ *
+ * @param duration Seconds of audio to render for each configuration
+ * @return A table of render loads, one line per chain length
+ */
++ (NSString*)filterChainReportWithDuration:(NSTimeInterval)duration;
+
+/*!
+ * Measure the cost of render profiling, for 10 to 100 channels
+ *
+ *  Renders software-mixed groups in which each channel has a pass-through filter and an
+ *  output receiver, with @link AEAudioController::renderProfilingEnabled @endlink off and on.
+ *
+ * @param duration Seconds of audio to render for each configuration
+ * @return A table of render loads, one line per channel count, with the overhead as a proportion of the load without profiling
+ */
++ (NSString*)profilingReportWithDuration:(NSTimeInterval)duration;
+
+/*!
+ * Measure limiter and expander chains with and without float buses
+ *
+ *  Renders a group of 8 channels, with chains of 1 to 8 AELimiterFilter and AEExpanderFilter
+ *  pairs on the group, at a 16-bit interleaved client format, with
+ *  @link AEAudioController::floatBusesEnabled @endlink off and on.
+ *
+ * @param duration Seconds of audio to render for each configuration
+ * @return A table of render loads, one line per chain length
+ */
++ (NSString*)dynamicsReportWithDuration:(NSTimeInterval)duration;
+
+/*!
+ * Measure how long messages from the realtime thread take to reach the main thread
+ *
+ *  Renders offline, sending messages with AEAudioControllerSendAsynchronousMessageToMainThread
+ *  from each buffer, and reports @link AEAudioController::mainThreadMessageLatencyAverage:maximum: @endlink.
+ *  Each buffer waits for the previous buffer's messages to be handled, so the queue never fills.
+ *  The messages are handled on the main thread, so call this from a background thread while the
+ *  main thread's run loop is running.
+ *
+ * @param messagesPerBuffer Number of messages sent from each buffer
+ * @param duration          Seconds of audio to render
+ * @param average           On output, the average latency, in seconds
+ * @param maximum           On output, the greatest latency, in seconds
+ * @return YES on success, NO on failure
+ */
++ (BOOL)mainThreadMessageLatencyWithMessagesPerBuffer:(int)messagesPerBuffer
+                                             duration:(NSTimeInterval)duration
+                                              average:(NSTimeInterval*)average
+                                              maximum:(NSTimeInterval*)maximum;
+
+/*!
+ * Measure main thread message latency for 1 to 32 messages per buffer
+ *
+ * @param duration Seconds of audio to render for each configuration
+ * @return A table of average and maximum latencies, one line per message count
+ */
++ (NSString*)mainThreadMessageReportWithDuration:(NSTimeInterval)duration;
+
+/*!
+ * Measure the cost of handling a flood of messages to the main thread
+ *
+ *  Renders offline, sending a burst of messages with userInfo from each buffer, and waits
+ *  for each burst to be handled before the next. As for
+ *  @link mainThreadMessageLatencyWithMessagesPerBuffer:duration:average:maximum: @endlink,
+ *  call this from a background thread while the main thread's run loop is running.
+ *
+ * @param userInfoLength Bytes of userInfo sent with each message
+ * @param messageCount   Number of messages to send
+ * @return Time from the first message being sent to the last being handled, divided by the number of messages, or 0 on failure
+ */
++ (NSTimeInterval)mainThreadMessageFloodTimeWithUserInfoLength:(int)userInfoLength messageCount:(int)messageCount;
+
+/*!
+ * Measure main thread message handling for userInfo of 0 to 256 bytes
+ *
+ * @param messageCount Number of messages to send for each length
+ * @return A table of times per message, one line per userInfo length
+ */
++ (NSString*)mainThreadMessageFloodReportWithMessageCount:(int)messageCount;
+
+/*!
+ * Measure how long it takes to load a session of channels into a running audio controller
+ *
+ *  Adds a group of channels, each with a filter and a receiver, then removes them again.
+ *  Unlike the other measurements this starts the audio hardware, as changes made while
+ *  rendering offline don't wait for the realtime thread.
+ *
+ * @param channelCount  Number of channels to load
+ * @param batched       Whether to make the changes within a single batch (see @link AEAudioController::beginUpdates @endlink)
+ * @return Seconds taken to load the channels, or 0 on failure
+ */
++ (NSTimeInterval)loadTimeWithChannelCount:(int)channelCount batched:(BOOL)batched;
+
+/*!
+ * Compare session load times with and without batching, for 10 to 200 channels
+ *
+ * @return A table of load times, one line per channel count
+ */
++ (NSString*)loadReport;
+
+@end
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,442 @@
+//
+//  AERenderBenchmark.m
+//  TheAmazingAudioEngine
+//
+//  This software is provided 'as-is', without any express or implied
+//  warranty.  In no event will the authors be held liable for any damages
+//  arising from the use of this software.
+//
+//  Permission is granted to anyone to use this software for any purpose,
+//  including commercial applications, and to alter it and redistribute it
+//  freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and must not be
+//     misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source distribution.
+//
+
+#import "AERenderBenchmark.h"
+#import "AELimiterFilter.h"
+#import "AEExpanderFilter.h"
+#import <mach/mach_time.h>
+#import <libkern/OSAtomic.h>
+
+static const UInt32 kBenchmarkBufferFrames  = 512;
+static const int kNoiseTableLength          = 4096; // Power of two
+static const int kWarmUpBuffers             = 16;
+static const int kMixingReportChannelCounts[] = { 2, 5, 10, 20, 50, 100 };
+static const int kScalingReportChannelCounts[] = { 8, 16, 32, 64, 128, 256 };
+static const int kScalingReportMaximumThreadCount = 3;
+static const int kLoadReportChannelCounts[] = { 10, 50, 100, 200 };
+static const int kMessageReportMessageCounts[] = { 1, 4, 16, 32 };
+static const NSTimeInterval kMessageHandlingTimeout = 1.0;
+static const int kFloodMessagesPerBuffer    = 16;   // Bursts of the largest messages still fit the 8KB queue
+static const int kFloodReportUserInfoLengths[] = { 0, 16, 64, 256 };
+static const int kFilterChainReportChannelCount = 8;
+static const int kFilterChainReportMaximumLength = 15;
+static const int kProfilingReportChannelCounts[] = { 10, 50, 100 };
+static const int kDynamicsReportChannelCount = 8;
+static const int kDynamicsReportChainLengths[] = { 1, 2, 4, 8 };
+
+static float __noise[kNoiseTableLength];
+static volatile int32_t __messagesHandled;
+
+@implementation AERenderBenchmark
+
++ (void)initialize {
+    for ( int i=0; i<kNoiseTableLength; i++ ) {
+        __noise[i] = ((float)arc4random() / UINT32_MAX) * 0.2 - 0.1;
+    }
+}
+
++ (double)renderLoadWithChannelCount:(int)channelCount
+                      softwareMixing:(BOOL)softwareMixing
+                   renderThreadCount:(NSUInteger)renderThreadCount
+                            duration:(NSTimeInterval)duration {
+    
+    return [self renderLoadWithChannelCount:channelCount
+                           audioDescription:[AEAudioController nonInterleavedFloatStereoAudioDescription]
+                                  configure:^(AEAudioController *audioController, AEChannelGroupRef group, NSArray *channels) {
+                                      audioController.softwareMixingEnabled = softwareMixing;
+                                      audioController.renderThreadCount = renderThreadCount;
+                                  }
+                                   duration:duration];
+}
+
++ (double)renderLoadWithChannelCount:(int)channelCount
+                    audioDescription:(AudioStreamBasicDescription)audioDescription
+                           configure:(void (^)(AEAudioController *audioController, AEChannelGroupRef group, NSArray *channels))configure
+                            duration:(NSTimeInterval)duration {
+    
+    AEAudioController *audioController = [[AEAudioController alloc] initForOfflineRenderingWithAudioDescription:audioDescription];
+    AudioStreamBasicDescription channelDescription = [AEAudioController nonInterleavedFloatStereoAudioDescription];
+
+    NSMutableArray *channels = [NSMutableArray array];
+    for ( int i=0; i<channelCount; i++ ) {
+        // Each channel reads the noise table from a different offset, so no two are the same
+        __block int offset = (i * 613) & (kNoiseTableLength-1);
+        AEBlockChannel *channel = [AEBlockChannel channelWithBlock:^(const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
+            for ( int j=0; j<frames; j++ ) {
+                float sample = __noise[(offset+j) & (kNoiseTableLength-1)];
+                for ( int k=0; k<audio->mNumberBuffers; k++ ) {
+                    ((float*)audio->mBuffers[k].mData)[j] = sample;
+                }
+            }
+            offset = (offset+frames) & (kNoiseTableLength-1);
+        }];
+        channel.audioDescription = channelDescription;
+        channel.volume = 0.5;
+        channel.pan = channelCount > 1 ? -1.0 + 2.0 * i / (channelCount-1) : 0.0;
+        [channels addObject:channel];
+    }
+
+    AEChannelGroupRef group = [audioController createChannelGroup];
+    [audioController addChannels:channels toChannelGroup:group];
+    
+    configure(audioController, group, channels);
+
+    if ( ![audioController start:NULL] ) {
+        [audioController release];
+        return 0;
+    }
+
+    AudioBufferList *bufferList = AEAllocateAndInitAudioBufferList(audioDescription, kBenchmarkBufferFrames);
+
+    // Let the first few buffers set up caches and buffers before timing
+    BOOL success = YES;
+    for ( int i=0; i<kWarmUpBuffers && success; i++ ) {
+        success = [audioController renderOfflineFrames:kBenchmarkBufferFrames intoBufferList:bufferList atTime:NULL] == noErr;
+    }
+
+    UInt64 totalFrames = (UInt64)(duration * audioDescription.mSampleRate);
+    uint64_t start = mach_absolute_time();
+    for ( UInt64 frame=0; frame<totalFrames && success; frame += kBenchmarkBufferFrames ) {
+        success = [audioController renderOfflineFrames:kBenchmarkBufferFrames intoBufferList:bufferList atTime:NULL] == noErr;
+    }
+    uint64_t end = mach_absolute_time();
+
+    AEFreeAudioBufferList(bufferList);
+    [audioController stop];
+    [audioController release];
+
+    if ( !success || totalFrames == 0 ) return 0;
+
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double renderTime = ((double)(end - start) * timebase.numer / timebase.denom) / 1.0e9;
+    double audioTime = (double)((totalFrames + kBenchmarkBufferFrames - 1) / kBenchmarkBufferFrames * kBenchmarkBufferFrames) / audioDescription.mSampleRate;
+    return renderTime / audioTime;
+}
+
++ (NSString*)mixingReportWithDuration:(NSTimeInterval)duration {
+    NSMutableString *report = [NSMutableString stringWithString:@"Channels\tMixer unit\tSoftware\n"];
+    for ( int i=0; i<sizeof(kMixingReportChannelCounts)/sizeof(int); i++ ) {
+        int channelCount = kMixingReportChannelCounts[i];
+        double mixerUnitLoad = [self renderLoadWithChannelCount:channelCount softwareMixing:NO renderThreadCount:0 duration:duration];
+        double softwareLoad = [self renderLoadWithChannelCount:channelCount softwareMixing:YES renderThreadCount:0 duration:duration];
+        [report appendFormat:@"%d\t%.2f%%\t%.2f%%\n", channelCount, mixerUnitLoad * 100.0, softwareLoad * 100.0];
+    }
+    return report;
+}
+
++ (NSString*)scalingReportWithDuration:(NSTimeInterval)duration {
+    NSMutableString *report = [NSMutableString stringWithString:@"Channels"];
+    for ( int threadCount=0; threadCount<=kScalingReportMaximumThreadCount; threadCount++ ) {
+        [report appendFormat:@"\t%d threads", threadCount];
+    }
+    [report appendString:@"\n"];
+    
+    for ( int i=0; i<sizeof(kScalingReportChannelCounts)/sizeof(int); i++ ) {
+        int channelCount = kScalingReportChannelCounts[i];
+        [report appendFormat:@"%d", channelCount];
+        for ( int threadCount=0; threadCount<=kScalingReportMaximumThreadCount; threadCount++ ) {
+            double load = [self renderLoadWithChannelCount:channelCount softwareMixing:YES renderThreadCount:threadCount duration:duration];
+            [report appendFormat:@"\t%.2f%%", load * 100.0];
+        }
+        [report appendString:@"\n"];
+    }
+    return report;
+}
+
++ (NSString*)filterChainReportWithDuration:(NSTimeInterval)duration {
+    NSMutableString *report = [NSMutableString stringWithString:@"Filters per channel\tMixer unit\tSoftware\n"];
+    for ( int filterCount=1; filterCount<=kFilterChainReportMaximumLength; filterCount++ ) {
+        [report appendFormat:@"%d", filterCount];
+        for ( int softwareMixing=0; softwareMixing<=1; softwareMixing++ ) {
+            double load = [self renderLoadWithChannelCount:kFilterChainReportChannelCount
+                                          audioDescription:[AEAudioController nonInterleavedFloatStereoAudioDescription]
+                                                 configure:^(AEAudioController *audioController, AEChannelGroupRef group, NSArray *channels) {
+                                                     audioController.softwareMixingEnabled = softwareMixing;
+                                                     for ( AEBlockChannel *channel in channels ) {
+                                                         for ( int i=0; i<filterCount; i++ ) {
+                                                             [audioController addFilter:[AEBlockFilter filterWithBlock:^(AEAudioControllerFilterProducer producer, void *producerToken, const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
+                                                                 producer(producerToken, audio, &frames);
+                                                             }] toChannel:channel];
+                                                         }
+                                                     }
+                                                 }
+                                                  duration:duration];
+            [report appendFormat:@"\t%.2f%%", load * 100.0];
+        }
+        [report appendString:@"\n"];
+    }
+    return report;
+}
+
++ (NSString*)profilingReportWithDuration:(NSTimeInterval)duration {
+    NSMutableString *report = [NSMutableString stringWithString:@"Channels\tProfiling off\tProfiling on\tOverhead\n"];
+    for ( int i=0; i<sizeof(kProfilingReportChannelCounts)/sizeof(int); i++ ) {
+        int channelCount = kProfilingReportChannelCounts[i];
+        double loads[2];
+        for ( int profiling=0; profiling<=1; profiling++ ) {
+            // A filter and a receiver on each channel, so every kind of node is timed
+            loads[profiling] = [self renderLoadWithChannelCount:channelCount
+                                               audioDescription:[AEAudioController nonInterleavedFloatStereoAudioDescription]
+                                                      configure:^(AEAudioController *audioController, AEChannelGroupRef group, NSArray *channels) {
+                                                          audioController.softwareMixingEnabled = YES;
+                                                          audioController.renderProfilingEnabled = profiling;
+                                                          for ( AEBlockChannel *channel in channels ) {
+                                                              [audioController addFilter:[AEBlockFilter filterWithBlock:^(AEAudioControllerFilterProducer producer, void *producerToken, const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
+                                                                  producer(producerToken, audio, &frames);
+                                                              }] toChannel:channel];
+                                                              [audioController addOutputReceiver:[AEBlockAudioReceiver audioReceiverWithBlock:^(void *source, const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {}]
+                                                                                      forChannel:channel];
+                                                          }
+                                                      }
+                                                       duration:duration];
+        }
+        [report appendFormat:@"%d\t%.2f%%\t%.2f%%\t%.1f%%\n", channelCount, loads[0] * 100.0, loads[1] * 100.0,
+                             loads[0] > 0 ? (loads[1] - loads[0]) / loads[0] * 100.0 : 0.0];
+    }
+    return report;
+}
+
++ (NSString*)dynamicsReportWithDuration:(NSTimeInterval)duration {
+    NSMutableString *report = [NSMutableString stringWithString:@"Limiter/expander pairs\tClient format buses\tFloat buses\n"];
+    for ( int i=0; i<sizeof(kDynamicsReportChainLengths)/sizeof(int); i++ ) {
+        int chainLength = kDynamicsReportChainLengths[i];
+        [report appendFormat:@"%d", chainLength];
+        for ( int floatBuses=0; floatBuses<=1; floatBuses++ ) {
+            // An integer client format, so that without float buses each filter converts in and out of it
+            double load = [self renderLoadWithChannelCount:kDynamicsReportChannelCount
+                                          audioDescription:[AEAudioController interleaved16BitStereoAudioDescription]
+                                                 configure:^(AEAudioController *audioController, AEChannelGroupRef group, NSArray *channels) {
+                                                     audioController.floatBusesEnabled = floatBuses;
+                                                     for ( int j=0; j<chainLength; j++ ) {
+                                                         AELimiterFilter *limiter = [[AELimiterFilter alloc] initWithAudioController:audioController];
+                                                         AEExpanderFilter *expander = [[AEExpanderFilter alloc] initWithAudioController:audioController];
+                                                         [audioController addFilter:limiter toChannelGroup:group];
+                                                         [audioController addFilter:expander toChannelGroup:group];
+                                                         [limiter release];
+                                                         [expander release];
+                                                     }
+                                                 }
+                                                  duration:duration];
+            [report appendFormat:@"\t%.2f%%", load * 100.0];
+        }
+        [report appendString:@"\n"];
+    }
+    return report;
+}
+
+static void benchmarkMessageHandler(AEAudioController *audioController, void *userInfo, int userInfoLength) {
+    OSAtomicIncrement32(&__messagesHandled);
+}
+
++ (BOOL)waitForMessagesHandled:(int32_t)count {
+    uint64_t start = mach_absolute_time();
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    while ( __messagesHandled < count ) {
+        if ( ((double)(mach_absolute_time() - start) * timebase.numer / timebase.denom) / 1.0e9 > kMessageHandlingTimeout ) return NO;
+        [NSThread sleepForTimeInterval:0.0001];
+    }
+    return YES;
+}
+
++ (BOOL)mainThreadMessageLatencyWithMessagesPerBuffer:(int)messagesPerBuffer
+                                             duration:(NSTimeInterval)duration
+                                              average:(NSTimeInterval*)average
+                                              maximum:(NSTimeInterval*)maximum {
+    
+    AudioStreamBasicDescription audioDescription = [AEAudioController nonInterleavedFloatStereoAudioDescription];
+    AEAudioController *audioController = [[AEAudioController alloc] initForOfflineRenderingWithAudioDescription:audioDescription];
+    
+    // Not retained by the block, which the controller holds on to
+    __block AEAudioController *sender = audioController;
+    AEBlockChannel *channel = [AEBlockChannel channelWithBlock:^(const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
+        for ( int i=0; i<messagesPerBuffer; i++ ) {
+            AEAudioControllerSendAsynchronousMessageToMainThread(sender, benchmarkMessageHandler, &i, sizeof(i));
+        }
+        for ( int k=0; k<audio->mNumberBuffers; k++ ) {
+            memset(audio->mBuffers[k].mData, 0, audio->mBuffers[k].mDataByteSize);
+        }
+    }];
+    [audioController addChannels:[NSArray arrayWithObject:channel]];
+    
+    if ( ![audioController start:NULL] ) {
+        [audioController release];
+        return NO;
+    }
+    
+    AudioBufferList *bufferList = AEAllocateAndInitAudioBufferList(audioDescription, kBenchmarkBufferFrames);
+    
+    __messagesHandled = 0;
+    int32_t messagesSent = 0;
+    BOOL success = YES;
+    for ( int i=0; i<kWarmUpBuffers && success; i++ ) {
+        success = [audioController renderOfflineFrames:kBenchmarkBufferFrames intoBufferList:bufferList atTime:NULL] == noErr;
+        messagesSent += messagesPerBuffer;
+        success = success && [self waitForMessagesHandled:messagesSent];
+    }
+    [audioController mainThreadMessageLatencyAverage:NULL maximum:NULL];
+    
+    UInt64 totalFrames = (UInt64)(duration * audioDescription.mSampleRate);
+    for ( UInt64 frame=0; frame<totalFrames && success; frame += kBenchmarkBufferFrames ) {
+        success = [audioController renderOfflineFrames:kBenchmarkBufferFrames intoBufferList:bufferList atTime:NULL] == noErr;
+        messagesSent += messagesPerBuffer;
+        success = success && [self waitForMessagesHandled:messagesSent];
+    }
+    
+    [audioController mainThreadMessageLatencyAverage:average maximum:maximum];
+    
+    AEFreeAudioBufferList(bufferList);
+    [audioController stop];
+    [audioController release];
+    
+    return success;
+}
+
++ (NSString*)mainThreadMessageReportWithDuration:(NSTimeInterval)duration {
+    NSMutableString *report = [NSMutableString stringWithString:@"Messages per buffer\tAverage\tMaximum\n"];
+    for ( int i=0; i<sizeof(kMessageReportMessageCounts)/sizeof(int); i++ ) {
+        int messageCount = kMessageReportMessageCounts[i];
+        NSTimeInterval average = 0, maximum = 0;
+        if ( [self mainThreadMessageLatencyWithMessagesPerBuffer:messageCount duration:duration average:&average maximum:&maximum] ) {
+            [report appendFormat:@"%d\t%.1fus\t%.1fus\n", messageCount, average * 1.0e6, maximum * 1.0e6];
+        } else {
+            [report appendFormat:@"%d\tfailed\n", messageCount];
+        }
+    }
+    return report;
+}
+
++ (NSTimeInterval)mainThreadMessageFloodTimeWithUserInfoLength:(int)userInfoLength messageCount:(int)messageCount {
+    AudioStreamBasicDescription audioDescription = [AEAudioController nonInterleavedFloatStereoAudioDescription];
+    AEAudioController *audioController = [[AEAudioController alloc] initForOfflineRenderingWithAudioDescription:audioDescription];
+    
+    char *userInfo = (char*)calloc(1, MAX(userInfoLength, 1));
+    __block AEAudioController *sender = audioController;
+    __block int remaining = 0;
+    AEBlockChannel *channel = [AEBlockChannel channelWithBlock:^(const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
+        for ( ; remaining > 0; remaining-- ) {
+            AEAudioControllerSendAsynchronousMessageToMainThread(sender, benchmarkMessageHandler, userInfo, userInfoLength);
+        }
+        for ( int k=0; k<audio->mNumberBuffers; k++ ) {
+            memset(audio->mBuffers[k].mData, 0, audio->mBuffers[k].mDataByteSize);
+        }
+    }];
+    [audioController addChannels:[NSArray arrayWithObject:channel]];
+    
+    if ( ![audioController start:NULL] ) {
+        [audioController release];
+        free(userInfo);
+        return 0;
+    }
+    
+    AudioBufferList *bufferList = AEAllocateAndInitAudioBufferList(audioDescription, kBenchmarkBufferFrames);
+    
+    __messagesHandled = 0;
+    int32_t messagesSent = 0;
+    BOOL success = YES;
+    uint64_t start = mach_absolute_time();
+    while ( messagesSent < messageCount && success ) {
+        remaining = MIN(kFloodMessagesPerBuffer, messageCount - messagesSent);
+        messagesSent += remaining;
+        success = [audioController renderOfflineFrames:kBenchmarkBufferFrames intoBufferList:bufferList atTime:NULL] == noErr
+                    && [self waitForMessagesHandled:messagesSent];
+    }
+    uint64_t end = mach_absolute_time();
+    
+    AEFreeAudioBufferList(bufferList);
+    [audioController stop];
+    [audioController release];
+    free(userInfo);
+    
+    if ( !success || messageCount == 0 ) return 0;
+    
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (((double)(end - start) * timebase.numer / timebase.denom) / 1.0e9) / messageCount;
+}
+
++ (NSString*)mainThreadMessageFloodReportWithMessageCount:(int)messageCount {
+    NSMutableString *report = [NSMutableString stringWithString:@"UserInfo bytes\tTime per message\n"];
+    for ( int i=0; i<sizeof(kFloodReportUserInfoLengths)/sizeof(int); i++ ) {
+        int userInfoLength = kFloodReportUserInfoLengths[i];
+        NSTimeInterval time = [self mainThreadMessageFloodTimeWithUserInfoLength:userInfoLength messageCount:messageCount];
+        [report appendFormat:@"%d\t%.0fns\n", userInfoLength, time * 1.0e9];
+    }
+    return report;
+}
+
++ (NSTimeInterval)loadTimeWithChannelCount:(int)channelCount batched:(BOOL)batched {
+    AEAudioController *audioController = [[AEAudioController alloc] initWithAudioDescription:[AEAudioController nonInterleavedFloatStereoAudioDescription]];
+    if ( ![audioController start:NULL] ) {
+        [audioController release];
+        return 0;
+    }
+    
+    NSMutableArray *channels = [NSMutableArray array];
+    NSMutableArray *filters = [NSMutableArray array];
+    NSMutableArray *receivers = [NSMutableArray array];
+    for ( int i=0; i<channelCount; i++ ) {
+        [channels addObject:[AEBlockChannel channelWithBlock:^(const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
+            for ( int k=0; k<audio->mNumberBuffers; k++ ) {
+                memset(audio->mBuffers[k].mData, 0, audio->mBuffers[k].mDataByteSize);
+            }
+        }]];
+        [filters addObject:[AEBlockFilter filterWithBlock:^(AEAudioControllerFilterProducer producer, void *producerToken, const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
+            producer(producerToken, audio, &frames);
+        }]];
+        [receivers addObject:[AEBlockAudioReceiver audioReceiverWithBlock:^(void *source, const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {}]];
+    }
+    
+    uint64_t start = mach_absolute_time();
+    if ( batched ) [audioController beginUpdates];
+    AEChannelGroupRef group = [audioController createChannelGroup];
+    for ( int i=0; i<channelCount; i++ ) {
+        [audioController addChannels:[NSArray arrayWithObject:[channels objectAtIndex:i]] toChannelGroup:group];
+        [audioController addFilter:[filters objectAtIndex:i] toChannel:[channels objectAtIndex:i]];
+        [audioController addOutputReceiver:[receivers objectAtIndex:i] forChannel:[channels objectAtIndex:i]];
+    }
+    if ( batched ) [audioController commitUpdates];
+    uint64_t end = mach_absolute_time();
+    
+    [audioController removeChannelGroup:group];
+    [audioController stop];
+    [audioController release];
+    
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return ((double)(end - start) * timebase.numer / timebase.denom) / 1.0e9;
+}
+
++ (NSString*)loadReport {
+    NSMutableString *report = [NSMutableString stringWithString:@"Channels\tUnbatched\tBatched\n"];
+    for ( int i=0; i<sizeof(kLoadReportChannelCounts)/sizeof(int); i++ ) {
+        int channelCount = kLoadReportChannelCounts[i];
+        NSTimeInterval unbatchedTime = [self loadTimeWithChannelCount:channelCount batched:NO];
+        NSTimeInterval batchedTime = [self loadTimeWithChannelCount:channelCount batched:YES];
+        [report appendFormat:@"%d\t%.1fms\t%.1fms\n", channelCount, unbatchedTime * 1000.0, batchedTime * 1000.0];
+    }
+    return report;
+}
+
+@end
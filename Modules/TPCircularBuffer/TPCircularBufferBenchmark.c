@@ -0,0 +1,257 @@
+//
+//  TPCircularBufferBenchmark.c
+//  Circular/Ring buffer implementation
+//
+//  https://github.com/michaeltyson/TPCircularBuffer
+//
+//  Benchmarks for TPCircularBuffer. Build and run it on its own, with optimisation:
+//
+//      cc -O2 -pthread -o TPCircularBufferBenchmark TPCircularBufferBenchmark.c TPCircularBuffer.c
+//      ./TPCircularBufferBenchmark
+//
+//  Add -DTPCIRCULARBUFFER_SPLIT_INDICES=1 to measure the split index variant instead.
+//
+//  Copyright (C) 2012-2013 A Tasty Pixel
+//
+//  This software is provided 'as-is', without any express or implied
+//  warranty.  In no event will the authors be held liable for any damages
+//  arising from the use of this software.
+//
+//  Permission is granted to anyone to use this software for any purpose,
+//  including commercial applications, and to alter it and redistribute it
+//  freely, subject to the following restrictions:
+//
+//  1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//  2. Altered source versions must be plainly marked as such, and must not be
+//     misrepresented as being the original software.
+//
+//  3. This notice may not be removed or altered from any source distribution.
+//
+
+#include "TPCircularBuffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+static const int32_t kBufferLength      = 64*1024;
+static const int32_t kItemLength        = 1000;
+static const int     kIterations        = 2000000;
+static const int     kPingPongIterations = 200000;
+static const int     kStreamItems       = 20000000;
+
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1.0e9;
+}
+
+/*
+ * Plain ring buffer, for comparison: wraps by copying in two parts
+ */
+typedef struct {
+    char    *buffer;
+    int32_t  length;
+    int32_t  head;
+    int32_t  tail;
+    int32_t  fillCount;
+} modulo_ring_t;
+
+static bool moduloRingProduceBytes(modulo_ring_t *ring, const void *src, int32_t len) {
+    if ( ring->length - ring->fillCount < len ) return false;
+    int32_t firstPart = ring->length - ring->head < len ? ring->length - ring->head : len;
+    memcpy(ring->buffer + ring->head, src, firstPart);
+    memcpy(ring->buffer, (const char*)src + firstPart, len - firstPart);
+    ring->head = (ring->head + len) % ring->length;
+    OSAtomicAdd32Barrier(len, &ring->fillCount);
+    return true;
+}
+
+static bool moduloRingConsumeBytes(modulo_ring_t *ring, void *dst, int32_t len) {
+    if ( ring->fillCount < len ) return false;
+    int32_t firstPart = ring->length - ring->tail < len ? ring->length - ring->tail : len;
+    memcpy(dst, ring->buffer + ring->tail, firstPart);
+    memcpy((char*)dst + firstPart, ring->buffer, len - firstPart);
+    ring->tail = (ring->tail + len) % ring->length;
+    OSAtomicAdd32Barrier(-len, &ring->fillCount);
+    return true;
+}
+
+static double benchmarkMirroredCopy(void) {
+    TPCircularBuffer buffer;
+    if ( !TPCircularBufferInit(&buffer, kBufferLength) ) return 0;
+    char item[kItemLength];
+    memset(item, 1, sizeof(item));
+
+    double start = now();
+    for ( int i=0; i<kIterations; i++ ) {
+        TPCircularBufferProduceBytes(&buffer, item, kItemLength);
+        int32_t available;
+        void *tail = TPCircularBufferTail(&buffer, &available);
+        memcpy(item, tail, kItemLength);
+        TPCircularBufferConsume(&buffer, kItemLength);
+    }
+    double end = now();
+
+    TPCircularBufferCleanup(&buffer);
+    return (end - start) / kIterations * 1.0e9;
+}
+
+static double benchmarkMirroredInPlace(void) {
+    TPCircularBuffer buffer;
+    if ( !TPCircularBufferInit(&buffer, kBufferLength) ) return 0;
+
+    // Work on the returned memory directly, as when queueing buffer lists or messages
+    volatile uint32_t sum = 0;
+    double start = now();
+    for ( int i=0; i<kIterations; i++ ) {
+        int32_t available;
+        uint32_t *head = (uint32_t*)TPCircularBufferHead(&buffer, &available);
+        for ( int j=0; j<kItemLength/sizeof(uint32_t); j++ ) head[j] = i + j;
+        TPCircularBufferProduce(&buffer, kItemLength);
+        uint32_t *tail = (uint32_t*)TPCircularBufferTail(&buffer, &available);
+        uint32_t itemSum = 0;
+        for ( int j=0; j<kItemLength/sizeof(uint32_t); j++ ) itemSum += tail[j];
+        sum += itemSum;
+        TPCircularBufferConsume(&buffer, kItemLength);
+    }
+    double end = now();
+
+    TPCircularBufferCleanup(&buffer);
+    return (end - start) / kIterations * 1.0e9;
+}
+
+static double benchmarkModuloCopy(void) {
+    modulo_ring_t ring = { .buffer = (char*)malloc(kBufferLength), .length = kBufferLength };
+    char item[kItemLength];
+    memset(item, 1, sizeof(item));
+
+    double start = now();
+    for ( int i=0; i<kIterations; i++ ) {
+        moduloRingProduceBytes(&ring, item, kItemLength);
+        moduloRingConsumeBytes(&ring, item, kItemLength);
+    }
+    double end = now();
+
+    free(ring.buffer);
+    return (end - start) / kIterations * 1.0e9;
+}
+
+static double benchmarkModuloInPlace(void) {
+    modulo_ring_t ring = { .buffer = (char*)malloc(kBufferLength), .length = kBufferLength };
+    uint32_t item[kItemLength/sizeof(uint32_t)];
+
+    // Without a mirror, the item has to be assembled and read back through scratch space
+    volatile uint32_t sum = 0;
+    double start = now();
+    for ( int i=0; i<kIterations; i++ ) {
+        for ( int j=0; j<kItemLength/sizeof(uint32_t); j++ ) item[j] = i + j;
+        moduloRingProduceBytes(&ring, item, kItemLength);
+        moduloRingConsumeBytes(&ring, item, kItemLength);
+        uint32_t itemSum = 0;
+        for ( int j=0; j<kItemLength/sizeof(uint32_t); j++ ) itemSum += item[j];
+        sum += itemSum;
+    }
+    double end = now();
+
+    free(ring.buffer);
+    return (end - start) / kIterations * 1.0e9;
+}
+
+/*
+ * Two-thread measurements, for the cost of the index handoff between producer and consumer
+ */
+typedef struct {
+    TPCircularBuffer *ping;
+    TPCircularBuffer *pong;
+} ping_pong_t;
+
+static void* pingPongResponder(void *userInfo) {
+    ping_pong_t *pingPong = (ping_pong_t*)userInfo;
+    for ( int i=0; i<kPingPongIterations; i++ ) {
+        int32_t available;
+        uint64_t *item;
+        while ( !(item = (uint64_t*)TPCircularBufferTail(pingPong->ping, &available)) ) sched_yield();
+        uint64_t value = *item;
+        TPCircularBufferConsume(pingPong->ping, sizeof(uint64_t));
+        while ( !TPCircularBufferProduceBytes(pingPong->pong, &value, sizeof(value)) ) sched_yield();
+    }
+    return NULL;
+}
+
+static double benchmarkPingPong(void) {
+    TPCircularBuffer ping, pong;
+    if ( !TPCircularBufferInit(&ping, 4096) ) return 0;
+    if ( !TPCircularBufferInit(&pong, 4096) ) { TPCircularBufferCleanup(&ping); return 0; }
+    ping_pong_t pingPong = { &ping, &pong };
+    pthread_t thread;
+    pthread_create(&thread, NULL, pingPongResponder, &pingPong);
+
+    // Each round trip hands an item to the other thread and waits for it to come back
+    double start = now();
+    for ( uint64_t i=0; i<kPingPongIterations; i++ ) {
+        while ( !TPCircularBufferProduceBytes(&ping, &i, sizeof(i)) ) sched_yield();
+        int32_t available;
+        while ( !TPCircularBufferTail(&pong, &available) ) sched_yield();
+        TPCircularBufferConsume(&pong, sizeof(uint64_t));
+    }
+    double end = now();
+
+    pthread_join(thread, NULL);
+    TPCircularBufferCleanup(&ping);
+    TPCircularBufferCleanup(&pong);
+    return (end - start) / kPingPongIterations * 1.0e9;
+}
+
+static void* streamConsumer(void *userInfo) {
+    TPCircularBuffer *buffer = (TPCircularBuffer*)userInfo;
+    uint64_t expected = 0;
+    while ( expected < kStreamItems ) {
+        int32_t available;
+        uint64_t *items = (uint64_t*)TPCircularBufferTail(buffer, &available);
+        if ( !items ) { sched_yield(); continue; }
+        int count = available / sizeof(uint64_t);
+        for ( int i=0; i<count; i++ ) {
+            if ( items[i] != expected++ ) {
+                printf("Stream out of order at item %llu\n", (unsigned long long)expected-1);
+                exit(1);
+            }
+        }
+        TPCircularBufferConsume(buffer, count * sizeof(uint64_t));
+    }
+    return NULL;
+}
+
+static double benchmarkStream(void) {
+    TPCircularBuffer buffer;
+    if ( !TPCircularBufferInit(&buffer, kBufferLength) ) return 0;
+    pthread_t thread;
+    pthread_create(&thread, NULL, streamConsumer, &buffer);
+
+    // One item per produce, so each publishes the head index once
+    double start = now();
+    for ( uint64_t i=0; i<kStreamItems; i++ ) {
+        while ( !TPCircularBufferProduceBytes(&buffer, &i, sizeof(i)) ) sched_yield();
+    }
+    pthread_join(thread, NULL);
+    double end = now();
+
+    TPCircularBufferCleanup(&buffer);
+    return (end - start) / kStreamItems * 1.0e9;
+}
+
+int main(int argc, char *argv[]) {
+    printf("TPCircularBuffer benchmark (%s), %d-byte items\n", TPCIRCULARBUFFER_SPLIT_INDICES ? "split indices" : "shared fill count", kItemLength);
+    printf("\t\t\tMirrored\tModulo\n");
+    printf("Copy in and out\t\t%.1f ns/op\t%.1f ns/op\n", benchmarkMirroredCopy(), benchmarkModuloCopy());
+    printf("Work in place\t\t%.1f ns/op\t%.1f ns/op\n", benchmarkMirroredInPlace(), benchmarkModuloInPlace());
+    printf("Two threads, 8-byte items\n");
+    printf("Ping-pong round trip\t%.1f ns/op\n", benchmarkPingPong());
+    printf("One-way stream\t\t%.1f ns/op\n", benchmarkStream());
+    return 0;
+}
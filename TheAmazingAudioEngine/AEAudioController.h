@@ -80,8 +80,90 @@ typedef enum {
     AEInputModeVariableAudioFormat
 } AEInputMode;
 
+/*!
+ * @enum AERampCurve
+ *  Shape of a volume ramp
+ *
+ * @var AERampCurveLinear
+ *  Change the gain by an equal amount every frame.
+ *
+ * @var AERampCurveExponential
+ *  Change the gain by an equal number of decibels every frame, which sounds even to the
+ *  ear. Ramps to or from silence pass through -80dB.
+ */
+typedef enum {
+    AERampCurveLinear,
+    AERampCurveExponential
+} AERampCurve;
+
+/*!
+ * @enum AERenderProfileNodeType
+ *  Kind of render graph node described by a render profile entry
+ *
+ * @var AERenderProfileNodeTypeChannel
+ *  A channel's render callback. The node is the channel.
+ *
+ * @var AERenderProfileNodeTypeChannelGroup
+ *  A channel group's mix. The node is an NSValue holding the AEChannelGroupRef. This
+ *  includes the time spent rendering everything in the group.
+ *
+ * @var AERenderProfileNodeTypeFilter
+ *  A filter, on a channel, group or the input. The node is the filter. This does not
+ *  include the time spent producing the filter's input.
+ *
+ * @var AERenderProfileNodeTypeReceiver
+ *  An output or input receiver. The node is the receiver.
+ */
+typedef enum {
+    AERenderProfileNodeTypeChannel,
+    AERenderProfileNodeTypeChannelGroup,
+    AERenderProfileNodeTypeFilter,
+    AERenderProfileNodeTypeReceiver
+} AERenderProfileNodeType;
+
+/*!
+ * Render profile histogram size
+ *
+ *  Render profile histograms count buffers by processing time in steps of 10% of the
+ *  buffer duration. The last bucket counts buffers that took the whole buffer duration or more.
+ */
+enum { AERenderProfileHistogramBucketCount = 11 };
+
+/*!
+ * @var AERenderProfileNodeKey
+ *  The node: the channel, filter or receiver object, or an NSValue holding a group
+ *
+ * @var AERenderProfileNodeTypeKey
+ *  NSNumber holding the node's AERenderProfileNodeType
+ *
+ * @var AERenderProfileAverageLoadKey
+ *  NSNumber holding the node's mean processing time, as a percentage of buffer duration
+ *
+ * @var AERenderProfilePeakLoadKey
+ *  NSNumber holding the node's longest processing time for one buffer, as a percentage of buffer duration
+ *
+ * @var AERenderProfileHistogramKey
+ *  NSArray of AERenderProfileHistogramBucketCount NSNumbers, counting buffers by processing time
+ */
+extern NSString * const AERenderProfileNodeKey;
+extern NSString * const AERenderProfileNodeTypeKey;
+extern NSString * const AERenderProfileAverageLoadKey;
+extern NSString * const AERenderProfilePeakLoadKey;
+extern NSString * const AERenderProfileHistogramKey;
+
 #pragma mark - Callbacks and protocols
 
+/*!
+ * Silence status
+ *
+ *  Return this from a render or filter callback, instead of noErr, when the buffer you
+ *  produced contains only silence. The buffer must still be zeroed. The engine then skips
+ *  mixing, level metering and idle filters for that buffer.
+ */
+enum {
+    AEAudioControllerOutputIsSilence = 'AEsl'
+};
+
 /*!
  * Render callback
  *
@@ -98,7 +180,7 @@ typedef enum {
  * @param time              The time the buffer will be played, automatically compensated for hardware latency.
  * @param frames            The number of frames required
  * @param audio             The audio buffer list - audio should be copied into the provided buffers
- * @return A status code
+ * @return A status code, or AEAudioControllerOutputIsSilence if the buffer is silent
  */
 typedef OSStatus (*AEAudioControllerRenderCallback) (id                        channel,
                                                      AEAudioController        *audioController,
@@ -235,6 +317,20 @@ typedef void (*AEAudioControllerAudioCallback) (id                        receiv
  */
 @property (nonatomic, readonly) AEAudioControllerAudioCallback receiverCallback;
 
+@optional
+
+/*!
+ * Whether the receiver needs audio in the client format
+ *
+ *  With @link AEAudioController::floatBusesEnabled floatBusesEnabled @endlink on, channel
+ *  groups carry non-interleaved floating-point audio. Receivers that return YES here are
+ *  given group audio converted to the audio controller's
+ *  @link AEAudioController::audioDescription audioDescription @endlink instead; the
+ *  conversion is done once per group per buffer, however many receivers ask for it.
+ *  Read when the receiver is added.
+ */
+@property (nonatomic, readonly) BOOL requiresClientFormat;
+
 @end
 
 /*!
@@ -280,7 +376,7 @@ typedef OSStatus (*AEAudioControllerFilterProducer)(void            *producerTok
  * @param time      The time the output audio will be played or the time input audio was received, automatically compensated for hardware latency.
  * @param frames    The length of the required audio, in frames
  * @param audio     The audio buffer list to write output audio to
- * @return A status code
+ * @return A status code, or AEAudioControllerOutputIsSilence if the output is silent
  */
 typedef OSStatus (*AEAudioControllerFilterCallback)(id                        filter,
                                                     AEAudioController        *audioController,
@@ -314,6 +410,40 @@ typedef OSStatus (*AEAudioControllerFilterCallback)(id                        fi
  */
 @property (nonatomic, readonly) AEAudioControllerFilterCallback filterCallback;
 
+@optional
+
+/*!
+ * Tail time
+ *
+ *  How long, in seconds, the filter continues to produce output after its input
+ *  falls silent (e.g. a reverb's decay time). Once the input has been silent for
+ *  this long, the filter is skipped until audio arrives again. Filters that don't
+ *  implement this are always run. Read once, when the filter is added.
+ */
+@property (nonatomic, readonly) NSTimeInterval tailTime;
+
+/*!
+ * Latency
+ *
+ *  How long, in seconds, the filter delays the audio passing through it (e.g. a
+ *  lookahead limiter's attack time). The other paths through the enclosing groups are
+ *  delayed to match, so that everything stays in phase. Filters that don't implement
+ *  this are assumed not to delay audio. Read when the filter is added.
+ */
+@property (nonatomic, readonly) NSTimeInterval latency;
+
+/*!
+ * Audio format the filter processes
+ *
+ *  If the filter implements a setter for this, the audio controller sets it to the format of
+ *  the audio the filter will be given, when the filter is added: the channel's own format for
+ *  a channel filter, @link AEAudioController::busAudioDescription busAudioDescription @endlink
+ *  for a channel group filter, and the input format for an input filter. It's set again if
+ *  that format changes, such as when @link AEAudioController::floatBusesEnabled floatBusesEnabled @endlink
+ *  is toggled, or a channel's audio description changes.
+ */
+@property (nonatomic, assign) AudioStreamBasicDescription clientFormat;
+
 @end
 
 
@@ -403,6 +533,66 @@ typedef struct _channel_group_t* AEChannelGroupRef;
  */
 typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *audioController, void *userInfo, int userInfoLength);
 
+/*!
+ * Timed message block
+ *
+ *  Performed on the realtime thread, just before rendering the buffer that contains
+ *  the message's target time.
+ *
+ * @param frameOffset       Offset, in frames, of the target time within the buffer about to be rendered
+ */
+typedef void (^AEAudioControllerTimedMessageBlock)(UInt32 frameOffset);
+
+/*!
+ * @enum AERenderEventType
+ *  Render timing problems
+ *
+ * @var AERenderEventOverrun
+ *  Processing a buffer took longer than the buffer lasts, so audio has probably glitched.
+ *
+ * @var AERenderEventDiscontinuity
+ *  The buffer's sample time doesn't follow on from the last one: the system skipped audio.
+ *
+ * @var AERenderEventLateCallback
+ *  The buffer arrived more than half a buffer duration later than the last one implied.
+ */
+typedef enum {
+    AERenderEventOverrun,
+    AERenderEventDiscontinuity,
+    AERenderEventLateCallback
+} AERenderEventType;
+
+/*!
+ * Render timing event
+ *
+ *  Describes one render timing problem. See @link AEAudioController::drainRenderEvents:maxCount:statistics: @endlink.
+ */
+typedef struct {
+    AERenderEventType       type;
+    AEAudioTimingContext    context;        //!< Whether it occurred while processing input or output
+    uint64_t                hostTime;       //!< Host time of the buffer's timestamp
+    Float64                 sampleTime;     //!< Sample time of the buffer's timestamp
+    NSTimeInterval          duration;       //!< Overrun: processing time beyond the buffer duration. Discontinuity: length of the gap. Late callback: lateness.
+    void                   *node;           //!< The slowest node in the cycle, as identified by AERenderProfileNodeKey (for reference only; it may since have been released), or NULL
+    AERenderProfileNodeType nodeType;       //!< The slowest node's type
+} AERenderEvent;
+
+/*!
+ * Render timing statistics
+ *
+ *  Summary of render timing for output and input together since the last drain.
+ */
+typedef struct {
+    UInt32                  cycles;         //!< Buffers processed
+    UInt32                  overruns;
+    UInt32                  discontinuities;
+    UInt32                  lateCallbacks;
+    UInt32                  droppedEvents;  //!< Events lost because the event log was full
+    NSTimeInterval          meanJitter;     //!< Mean difference between the time between callbacks and the buffer duration
+    NSTimeInterval          maxJitter;      //!< Largest difference between the time between callbacks and the buffer duration
+    NSTimeInterval          maxProcessingTime; //!< Longest time spent processing one buffer
+} AERenderStatistics;
+
 #pragma mark -
 
 /*!
@@ -498,6 +688,22 @@ typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *aud
  */
 - (id)initWithAudioDescription:(AudioStreamBasicDescription)audioDescription inputEnabled:(BOOL)enableInput useVoiceProcessing:(BOOL)useVoiceProcessing;
 
+/*!
+ * Initialize for offline rendering
+ *
+ *  Creates an audio controller that is not connected to the audio hardware or the audio
+ *  session. Once started, audio is rendered through the same channels, groups, filters and
+ *  receivers as usual, but only when you ask for it with
+ *  @link renderOfflineFrames:intoBufferList:atTime: @endlink, and as fast as the device allows.
+ *  Use this to bounce to disk faster than realtime, or to run the engine where there's no
+ *  audio hardware.
+ *
+ *  Audio input is not available in this mode.
+ *
+ * @param audioDescription    Audio description to use for all audio
+ */
+- (id)initForOfflineRenderingWithAudioDescription:(AudioStreamBasicDescription)audioDescription;
+
 /*!
  * Start audio engine
  *
@@ -511,6 +717,44 @@ typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *aud
  */
 - (void)stop;
 
+///@}
+#pragma mark - Offline rendering
+/** @name Offline rendering */
+///@{
+
+/*!
+ * Render audio in offline mode
+ *
+ *  Only available for audio controllers created with
+ *  @link initForOfflineRenderingWithAudioDescription: @endlink, after calling @link start: @endlink.
+ *  Renders the given number of frames into the buffer, in the audio controller's audio format.
+ *  Large requests are rendered in several slices.
+ *
+ *  The timestamps passed along the render path come from the given time, if provided, advanced
+ *  by the frames rendered for each slice. Otherwise, the audio controller keeps its own clock,
+ *  starting at sample time zero when first rendered and advancing by the frames rendered, with a
+ *  host time that advances at the same rate.
+ *
+ * @param frames        Number of frames to render
+ * @param bufferList    Buffer to render into, with space for the number of frames requested
+ * @param time          The time of the first frame, or NULL to use the audio controller's own clock
+ * @return noErr on success, or an error code
+ */
+- (OSStatus)renderOfflineFrames:(UInt32)frames intoBufferList:(AudioBufferList*)bufferList atTime:(const AudioTimeStamp*)time;
+
+/*!
+ * Whether the audio controller is in offline rendering mode
+ */
+@property (nonatomic, readonly) BOOL offline;
+
+/*!
+ * Offline rendering speed, as a multiple of realtime
+ *
+ *  The duration of audio rendered so far with @link renderOfflineFrames:intoBufferList:atTime: @endlink,
+ *  divided by the time it took to render. A value of 10 means rendering ran ten times faster than realtime.
+ */
+@property (nonatomic, readonly) double offlineRenderSpeed;
+
 ///@}
 #pragma mark - Channel and channel group management
 /** @name Channel and channel group management */
@@ -643,6 +887,30 @@ typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *aud
  */
 - (float)panForChannelGroup:(AEChannelGroupRef)group;
 
+/*!
+ * Ramp the volume level of a channel group
+ *
+ *  The ramp is applied sample by sample from the next buffer, so fast fades don't click.
+ *  Setting the volume directly while a ramp is in progress cancels the ramp.
+ *
+ * @param volume    Target group volume (0 - 1)
+ * @param group     Group identifier
+ * @param duration  Duration of the ramp, in seconds
+ * @param curve     Shape of the ramp
+ */
+- (void)setVolume:(float)volume forChannelGroup:(AEChannelGroupRef)group rampDuration:(NSTimeInterval)duration curve:(AERampCurve)curve;
+
+/*!
+ * Ramp the pan of a channel group
+ *
+ *  The ramp is linear, and is applied sample by sample from the next buffer.
+ *
+ * @param pan       Target group pan (-1.0, left to 1.0, right)
+ * @param group     Group identifier
+ * @param duration  Duration of the ramp, in seconds
+ */
+- (void)setPan:(float)pan forChannelGroup:(AEChannelGroupRef)group rampDuration:(NSTimeInterval)duration;
+
 /*!
  * Set the mute status of a channel group
  *
@@ -659,6 +927,98 @@ typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *aud
  */
 - (BOOL)channelGroupIsMuted:(AEChannelGroupRef)group;
 
+/*!
+ * Create an aux bus within an existing channel group
+ *
+ *  An aux bus is a channel group that, as well as mixing its own channels, mixes in audio
+ *  sent to it from other channels and groups with @link setSendLevel:toAuxBus:forChannel: @endlink.
+ *  Filters added to the bus with @link addFilter:toChannelGroup: @endlink process the combined
+ *  sends once per buffer, so one expensive effect, like a reverb, can serve many channels.
+ *  The result is mixed into the given group, like any other group.
+ *
+ *  Sends are taken after each sender's filters and volume. Audio from senders that render
+ *  after the bus - other aux buses added to the bus's parent group after it, or anything in a
+ *  part of the tree that is mixed later - reaches the bus one buffer late. Senders within the
+ *  bus's own parent group, and within groups in it, reach it in the same buffer.
+ *
+ *  If the bus's parent group is inside a group whose channels render in parallel (see
+ *  @link renderThreadCount @endlink), all audio sent to the bus reaches it one buffer late,
+ *  whichever render thread each sender happened to render on.
+ *
+ *  Remove the bus with @link removeChannelGroup: @endlink; any sends to it are removed too.
+ *
+ * @param group Group identifier of the group to mix the bus into
+ * @return An identifier for the created aux bus, which can be used wherever a group identifier can
+ */
+- (AEChannelGroupRef)createAuxBusWithinChannelGroup:(AEChannelGroupRef)group;
+
+/*!
+ * Set the level at which a channel sends to an aux bus
+ *
+ * @param level     Send level (0 - 1); 0 removes the send
+ * @param auxBus    Aux bus identifier
+ * @param channel   The channel
+ */
+- (void)setSendLevel:(float)level toAuxBus:(AEChannelGroupRef)auxBus forChannel:(id<AEAudioPlayable>)channel;
+
+/*!
+ * Get the level at which a channel sends to an aux bus
+ *
+ * @param auxBus    Aux bus identifier
+ * @param channel   The channel
+ * @return Send level (0 - 1)
+ */
+- (float)sendLevelToAuxBus:(AEChannelGroupRef)auxBus forChannel:(id<AEAudioPlayable>)channel;
+
+/*!
+ * Set the level at which a channel group sends to an aux bus
+ *
+ * @param level     Send level (0 - 1); 0 removes the send
+ * @param auxBus    Aux bus identifier
+ * @param group     Group identifier
+ */
+- (void)setSendLevel:(float)level toAuxBus:(AEChannelGroupRef)auxBus forChannelGroup:(AEChannelGroupRef)group;
+
+/*!
+ * Get the level at which a channel group sends to an aux bus
+ *
+ * @param auxBus    Aux bus identifier
+ * @param group     Group identifier
+ * @return Send level (0 - 1)
+ */
+- (float)sendLevelToAuxBus:(AEChannelGroupRef)auxBus forChannelGroup:(AEChannelGroupRef)group;
+
+/*!
+ * Begin a batch of channel, group, filter and receiver changes
+ *
+ *  Each change to the channel layout normally reconfigures the affected mixer buses and
+ *  updates the audio graph straight away. Between this call and the matching
+ *  @link commitUpdates @endlink, that work is deferred: the affected groups are noted,
+ *  and on commit each is reconfigured once, followed by a single graph update. Changes
+ *  to the channel, filter, receiver and send tables are made to the main thread's copies,
+ *  and handed to the realtime thread together in a single message exchange on commit.
+ *  Use this when making many changes at once, such as when loading a session.
+ *
+ *  Channels, groups, filters and receivers added within a batch are visible to the
+ *  query methods (like @link channels @endlink and @link filters @endlink) straight
+ *  away, but aren't rendered until the batch is committed; those removed within a batch
+ *  keep rendering until then, and are released on commit.
+ *
+ *  The batch is also wrapped in a message exchange transaction (see
+ *  @link beginMessageExchangeTransaction @endlink).
+ *
+ *  Batches may be nested; changes are applied when the outermost batch is committed.
+ *  Must be called from the main thread.
+ */
+- (void)beginUpdates;
+
+/*!
+ * Commit a batch of changes
+ *
+ *  See @link beginUpdates @endlink.
+ */
+- (void)commitUpdates;
+
 ///@}
 #pragma mark - Filters
 /** @name Filters */
@@ -972,6 +1332,75 @@ typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *aud
 - (void)performAsynchronousMessageExchangeWithBlock:(void (^)())block
                                       responseBlock:(void (^)())responseBlock;
 
+/*!
+ * Send a message to the realtime thread, to be performed at a given time
+ *
+ *  Like @link performAsynchronousMessageExchangeWithBlock:responseBlock: @endlink, but
+ *  the block is held on the realtime thread until the render cycle containing the given
+ *  time, and is performed just before that buffer is rendered. The block is given the
+ *  offset of the target time within the buffer, so it can apply its change at that exact
+ *  frame; for example, by scheduling an Audio Unit parameter event at that offset, or by
+ *  having a filter switch parameters partway through its next buffer.
+ *
+ *  The time may be given as a host time or a sample time, relative to the output timestamps
+ *  passed to timing receivers (host time is used when both are valid). Times in the past
+ *  are performed at the start of the next buffer. If the audio system is not running, the
+ *  block is performed straight away with a zero offset.
+ *
+ * @param block         A block to be performed on the realtime thread.
+ * @param time          The time at which to perform the block
+ * @param responseBlock A block to be performed on the main thread after the block has been performed, or nil.
+ */
+- (void)performAsynchronousMessageExchangeWithTimedBlock:(AEAudioControllerTimedMessageBlock)block
+                                                  atTime:(const AudioTimeStamp*)time
+                                           responseBlock:(void (^)())responseBlock;
+
+/*!
+ * Set a mixer parameter for a channel at an exact time
+ *
+ *  Schedules a change to one of the channel's parameters on its group's mixer
+ *  (kMultiChannelMixerParam_Volume, kMultiChannelMixerParam_Pan or kMultiChannelMixerParam_Enable)
+ *  so that it takes effect at the given frame, rather than at the next buffer boundary.
+ *
+ *  This does not change the channel's own properties; it is intended for scheduling
+ *  changes that the channel's properties will later agree with.
+ *
+ * @param parameter     The mixer parameter
+ * @param value         The new value
+ * @param channel       The channel
+ * @param time          The time at which the change should occur (see @link performAsynchronousMessageExchangeWithTimedBlock:atTime:responseBlock: @endlink)
+ */
+- (void)setMixerParameter:(AudioUnitParameterID)parameter value:(AudioUnitParameterValue)value forChannel:(id<AEAudioPlayable>)channel atTime:(const AudioTimeStamp*)time;
+
+/*!
+ * Ramp the volume of a channel
+ *
+ *  Moves the channel's mixer volume to the target over the given duration, sample by
+ *  sample, starting from the next buffer. Use this for fader automation and fades that
+ *  would otherwise click.
+ *
+ *  Like @link setMixerParameter:value:forChannel:atTime: @endlink, this does not change
+ *  the channel's own volume property. Setting that property to the ramp's target while the
+ *  ramp runs leaves the ramp alone; setting it to anything else cancels the ramp.
+ *
+ * @param volume    Target volume (0 - 1)
+ * @param channel   The channel
+ * @param duration  Duration of the ramp, in seconds
+ * @param curve     Shape of the ramp
+ */
+- (void)setVolume:(float)volume forChannel:(id<AEAudioPlayable>)channel rampDuration:(NSTimeInterval)duration curve:(AERampCurve)curve;
+
+/*!
+ * Ramp the pan of a channel
+ *
+ *  As @link setVolume:forChannel:rampDuration:curve: @endlink, for pan. Pan ramps are linear.
+ *
+ * @param pan       Target pan (-1.0, left to 1.0, right)
+ * @param channel   The channel
+ * @param duration  Duration of the ramp, in seconds
+ */
+- (void)setPan:(float)pan forChannel:(id<AEAudioPlayable>)channel rampDuration:(NSTimeInterval)duration;
+
 /*!
  * Send a message to the realtime thread synchronously
  *
@@ -983,7 +1412,8 @@ typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *aud
  *  memory or interact with the BSD subsystem, as all of these may result in audio glitches due
  *  to priority inversion.
  *
- *  This method will block the current thread until the block has been performed on the realtime thread.
+ *  This method will block the current thread until the block has been performed on the realtime thread,
+ *  or until @link synchronousMessageExchangeTimeout @endlink has elapsed.
  *  You may pass information from the realtime thread to the calling thread via the use of __block variables.
  *
  *  If all you need is a checkpoint to make sure the Core Audio thread is not mid-render, etc, then
@@ -993,13 +1423,64 @@ typedef void (*AEAudioControllerMainThreadMessageHandler)(AEAudioController *aud
  */
 - (void)performSynchronousMessageExchangeWithBlock:(void (^)())block;
 
+/*!
+ * Timeout for synchronous message exchanges (in seconds)
+ *
+ *  If the realtime thread hasn't performed the block within this time (for example,
+ *  because the audio system has stalled), @link performSynchronousMessageExchangeWithBlock: @endlink
+ *  logs a warning and performs the block on the calling thread.
+ *
+ *  Default is 1.0.
+ */
+@property (nonatomic, assign) NSTimeInterval synchronousMessageExchangeTimeout;
+
+/*!
+ * Get synchronous message exchange round-trip time since this method was last called
+ *
+ *  Measures the time from @link performSynchronousMessageExchangeWithBlock: @endlink being
+ *  called to the calling thread resuming after the block has been performed. Exchanges
+ *  that timed out are not counted.
+ *
+ * @param average If not NULL, on output will be set to the average round-trip time, in seconds
+ * @param maximum If not NULL, on output will be set to the greatest round-trip time, in seconds
+ */
+- (void)synchronousMessageExchangeLatencyAverage:(NSTimeInterval*)average maximum:(NSTimeInterval*)maximum;
+
+/*!
+ * Begin a message exchange transaction
+ *
+ *  Until the matching @link commitMessageExchangeTransaction @endlink, message exchanges sent
+ *  from the calling thread are collected rather than sent. On commit, they are published to
+ *  the realtime thread as a single message, and are all performed together, in the order
+ *  they were sent, however many there are. Use this to make several related changes without
+ *  the realtime thread seeing some of them but not others.
+ *
+ *  Any response blocks are combined, and performed together on the main thread once the
+ *  whole transaction has been performed.
+ *
+ *  Transactions may be nested; messages are sent when the outermost transaction is committed.
+ *  A synchronous message exchange within a transaction can't wait for the commit, so it sends
+ *  the messages collected so far, along with its own, as one message before waiting; the
+ *  rest of the transaction follows on commit.
+ */
+- (void)beginMessageExchangeTransaction;
+
+/*!
+ * Commit a message exchange transaction
+ *
+ *  See @link beginMessageExchangeTransaction @endlink.
+ */
+- (void)commitMessageExchangeTransaction;
+
 /*!
  * Send a message to the main thread asynchronously
  *
  *  This is a synchronization mechanism that allows you to schedule actions to be performed 
  *  on the main thread, without any locking or memory allocation.  Pass in a function pointer
  *  optionally a pointer to data to be copied and passed to the handler, and the function will 
- *  be called on the realtime thread at the next polling interval.
+ *  be called on the main thread as soon as it's free.
+ *
+ *  This may be called from the output and input realtime threads at the same time.
  *
  * @param audioController The audio controller.
  * @param handler         A pointer to a function to call on the main thread.
@@ -1011,6 +1492,57 @@ void AEAudioControllerSendAsynchronousMessageToMainThread(AEAudioController
                                                           void                              *userInfo,
                                                           int                                userInfoLength);
 
+/*!
+ * Number of times a realtime thread had to retry sending a message to the main thread
+ *
+ *  Messages to the main thread may be sent from the output and input threads at
+ *  the same time. When two sends race for the same space in the message queue, 
+ *  one of them tries again; this counts those retries.
+ */
+@property (nonatomic, readonly) NSUInteger mainThreadMessageRetryCount;
+
+/*!
+ * Get main thread message latency since this method was last called
+ *
+ *  Measures the time from a message being sent on a realtime thread (via
+ *  AEAudioControllerSendAsynchronousMessageToMainThread, or a response from
+ *  @link performAsynchronousMessageExchangeWithBlock:responseBlock: @endlink) to
+ *  its handler being called.
+ *
+ * @param average If not NULL, on output will be set to the average latency, in seconds
+ * @param maximum If not NULL, on output will be set to the greatest latency, in seconds
+ */
+- (void)mainThreadMessageLatencyAverage:(NSTimeInterval*)average maximum:(NSTimeInterval*)maximum;
+
+
+///@}
+#pragma mark - Deferred release
+/** @name Deferred release */
+///@{
+
+/*!
+ * Release an object once the realtime thread can no longer be using it
+ *
+ *  Use this when replacing an object that the realtime thread refers to: store the new
+ *  pointer, then pass the old object here instead of releasing it. It will be released
+ *  on a background thread once every render cycle that may have seen it has finished,
+ *  without waiting for a message exchange.
+ *
+ *  This takes over the caller's ownership of the object.
+ *
+ * @param object The object to release
+ */
+- (void)releaseObjectWhenRenderingComplete:(id)object;
+
+/*!
+ * Perform a block once any render cycle in progress has finished
+ *
+ *  Like @link releaseObjectWhenRenderingComplete: @endlink, but for other resources,
+ *  such as buffers to be freed. The block is performed on a background thread.
+ *
+ * @param block Block to perform
+ */
+- (void)performBlockWhenRenderingComplete:(void (^)())block;
 
 ///@}
 #pragma mark - Metering
@@ -1042,6 +1574,50 @@ void AEAudioControllerSendAsynchronousMessageToMainThread(AEAudioController
  */
 - (void)inputAveragePowerLevel:(Float32*)averagePower peakHoldLevel:(Float32*)peakLevel;
 
+///@}
+#pragma mark - Profiling
+/** @name Profiling */
+///@{
+
+/*!
+ * Whether to time each node of the render graph
+ *
+ *  When on, the render thread times every channel, group, filter and receiver it runs,
+ *  at the cost of two host time reads per node per buffer, for @link renderProfile @endlink
+ *  and for the slowest node reported with render timing events. Turn it off to save that
+ *  cost; nodes then report no processing time, and events name no slowest node.
+ *
+ *  Default is YES.
+ */
+@property (nonatomic, assign) BOOL renderProfilingEnabled;
+
+/*!
+ * Get processing time for each node of the render graph since this method was last called
+ *
+ *  Use this to find where the render budget goes. Requires
+ *  @link renderProfilingEnabled @endlink.
+ *
+ * @return Array of NSDictionary, one per node, with the keys described under AERenderProfileNodeKey
+ */
+- (NSArray*)renderProfile;
+
+/*!
+ * Take render timing events and statistics gathered since this method was last called
+ *
+ *  The realtime threads watch the timestamps of each output and input buffer for
+ *  discontinuities and late arrival, and time each buffer's processing against its
+ *  duration. Problems are logged to a fixed-size event log, which this drains.
+ *
+ *  Call this regularly, from the main thread: if the log fills up, further events are
+ *  counted in the statistics' droppedEvents, but otherwise lost.
+ *
+ * @param events     Array to receive events, oldest first, or NULL to discard them
+ * @param maxCount   Capacity of the events array; events that don't fit stay for the next call
+ * @param statistics If not NULL, on output will be set to summary statistics
+ * @return The number of events written to the array
+ */
+- (NSUInteger)drainRenderEvents:(AERenderEvent*)events maxCount:(NSUInteger)maxCount statistics:(AERenderStatistics*)statistics;
+
 ///@}
 #pragma mark - Utilities
 /** @name Utilities */
@@ -1052,6 +1628,13 @@ void AEAudioControllerSendAsynchronousMessageToMainThread(AEAudioController
  */
 AudioStreamBasicDescription *AEAudioControllerAudioDescription(AEAudioController *audioController);
 
+/*!
+ * Get access to the AudioStreamBasicDescription carried by channel groups
+ *
+ *  See @link AEAudioController::busAudioDescription busAudioDescription @endlink.
+ */
+AudioStreamBasicDescription *AEAudioControllerBusAudioDescription(AEAudioController *audioController);
+
 /*!
  * Get access to the input AudioStreamBasicDescription
  */
@@ -1067,6 +1650,24 @@ long AEConvertSecondsToFrames(AEAudioController *audioController, NSTimeInterval
  */
 NSTimeInterval AEConvertFramesToSeconds(AEAudioController *audioController, long frames);
 
+/*!
+ * Get scratch buffers for use within a filter callback
+ *
+ *  Provides non-interleaved float buffers from the engine's shared render buffers, so
+ *  filters don't need to allocate their own. The contents are undefined, and the buffers
+ *  are only valid until the filter calls its producer again or returns - call the
+ *  producer first, then take the buffers.
+ *
+ *  Only call this from the realtime thread.
+ *
+ * @param audioController The audio controller
+ * @param channels  Number of buffers required
+ * @param frames    Number of frames per buffer
+ * @param buffers   Array of at least 'channels' pointers, which will be set to the buffers
+ * @return YES on success, NO if buffers of this size aren't available
+ */
+BOOL AEAudioControllerGetScratchBuffers(AEAudioController *audioController, int channels, UInt32 frames, float **buffers);
+
 ///@}
 #pragma mark - Properties
 
@@ -1156,6 +1757,97 @@ NSTimeInterval AEConvertFramesToSeconds(AEAudioController *audioController, long
  */
 @property (nonatomic, assign) BOOL voiceProcessingOnlyForSpeakerAndMicrophone;
 
+/*!
+ * Whether to mix channel groups in software
+ *
+ *  When enabled, channel groups are mixed by the audio engine itself, rather than
+ *  by a MultiChannelMixer audio unit per group. This mixes in non-interleaved floating-point,
+ *  ramps volume and pan changes across each buffer, and avoids the per-bus overhead of the
+ *  mixer unit, which can be significant for groups with many channels. The top-level mix
+ *  always uses a mixer unit.
+ *
+ *  Pan follows the mixer unit's law: mono channels are panned at equal power, 3dB down
+ *  on each side at centre, and pan acts as a balance control on stereo channels. Use
+ *  AERenderBenchmark to compare the cost of the two mixers for your channel counts.
+ *
+ *  Nested groups whose output goes only to their parent's mix (no filters, receivers,
+ *  Audiobus port or level metering) are flattened: they are mixed, deepest first, in a
+ *  single pass by the outermost group, rather than pulled through a render callback at
+ *  each level. The schedule is rebuilt whenever the group tree changes.
+ *
+ *  Changing this value reconfigures existing channel groups, which may cause a brief
+ *  break in audio playback; it's best set before creating channel groups.
+ *
+ *  Default is NO.
+ */
+@property (nonatomic, assign) BOOL softwareMixingEnabled;
+
+/*!
+ * Whether channel groups carry non-interleaved floating-point audio
+ *
+ *  When enabled, every group's mix, along with the group's filters, receivers, level
+ *  metering and Audiobus output, runs in @link busAudioDescription @endlink: non-interleaved
+ *  32-bit float at the sample rate and channel count of @link audioDescription @endlink.
+ *  Audio is converted to the output hardware's format once, by the IO unit. Channels still
+ *  render in their own format, or in audioDescription if they don't specify one, and are
+ *  converted as they're mixed into their group.
+ *
+ *  Filters and receivers that process audio in float, such as AELimiterFilter and
+ *  AEExpanderFilter, then no longer need to convert in and out of the client format
+ *  themselves. Receivers that need the client format can ask for it with
+ *  @link AEAudioReceiver::requiresClientFormat requiresClientFormat @endlink.
+ *
+ *  Changing this value reconfigures existing channel groups, which may cause a brief
+ *  break in audio playback. Group filters that implement
+ *  @link AEAudioFilter::clientFormat clientFormat @endlink are switched to the new format;
+ *  other filters and receivers usually read the format when they're created, so it's best
+ *  set before creating them.
+ *
+ *  Default is NO.
+ */
+@property (nonatomic, assign) BOOL floatBusesEnabled;
+
+/*!
+ * The audio format carried by channel groups
+ *
+ *  The non-interleaved floating-point equivalent of @link audioDescription @endlink if
+ *  @link floatBusesEnabled @endlink is on, otherwise the same as audioDescription.
+ *  Filters and receivers added to groups will see audio in this format.
+ */
+@property (nonatomic, readonly) AudioStreamBasicDescription busAudioDescription;
+
+/*!
+ * Number of worker threads used to render channel groups in parallel
+ *
+ *  When non-zero, the channels of groups mixed in software (see @link softwareMixingEnabled @endlink)
+ *  are rendered in parallel by a pool of realtime-priority worker threads, together with the
+ *  Core Audio thread. The group is mixed once all of its channels have rendered, in channel order,
+ *  so output is the same as when rendering serially. One group renders in parallel at a time;
+ *  groups nested within it render serially on whichever thread renders them.
+ *
+ *  Important: Render, filter and receiver callbacks for channels within these groups will be
+ *  called on the worker threads, concurrently with those of sibling channels.
+ *
+ *  The Core Audio thread waits for every channel in the group to finish rendering, however long
+ *  that takes, so a channel that is slow on a worker delays the whole buffer just as it would
+ *  when rendering serially.
+ *
+ *  The value is limited to one less than the number of active processor cores, and to 15.
+ *  Default is 0.
+ */
+@property (nonatomic, assign) NSUInteger renderThreadCount;
+
+/*!
+ * Render working set size, in bytes
+ *
+ *  The total size of the buffers the engine renders through: the shared pool of
+ *  transient buffers (planned from the channel graph, and reused across channels,
+ *  mixing, metering and filter scratch space), plus per-channel buffers that must
+ *  stay live during a render, like the float buffers of software-mixed channels.
+ *  Doesn't include buffers owned by channels and filters themselves.
+ */
+@property (nonatomic, readonly) NSUInteger renderWorkingSetSize;
+
 /*! 
  * Input mode: How to handle incoming audio
  *
@@ -1221,6 +1913,16 @@ NSTimeInterval AEConvertFramesToSeconds(AEAudioController *audioController, long
  */
 @property (nonatomic, readonly) NSTimeInterval outputLatency;
 
+/*!
+ * Graph latency (in seconds)
+ *
+ *  How long audio is delayed by the filters on its way through the channels and
+ *  groups to the output, with delay compensation applied to the shorter paths.
+ *  Timestamps passed to output receivers already include the part of this that
+ *  follows the receiver.
+ */
+@property (nonatomic, readonly) NSTimeInterval graphLatency;
+
 /*!
  * Determine whether the audio engine is running
  *
@@ -1315,6 +2017,18 @@ NSTimeInterval AEAudioControllerInputLatency(AEAudioController *controller);
  */
 NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller);
 
+/*!
+ * Graph latency (in seconds)
+ *
+ *  The delay added by filters that report latency, including the compensation that
+ *  keeps every path through the graph in phase. Add this to hardware output latency
+ *  to find when audio rendered now will be heard.
+ *
+ * @param controller The audio controller
+ * @returns The current graph latency
+ */
+NSTimeInterval AEAudioControllerGraphLatency(AEAudioController *controller);
+
 @end
 
 #ifdef __cplusplus
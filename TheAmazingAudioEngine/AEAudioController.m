@@ -35,21 +35,29 @@
 #import "AEAudioController+AudiobusStub.h"
 #import "AEFloatConverter.h"
 #import <mach/mach_time.h>
+#import <mach/mach.h>
 #import <pthread.h>
 
 static double __hostTicksToSeconds = 0.0;
 static double __secondsToHostTicks = 0.0;
 
-static const int kMaximumChannelsPerGroup              = 100;
-static const int kMaximumCallbacksPerSource            = 15;
+static const int kInitialChannelTableCapacity          = 4;
+static const int kInitialCallbackTableCapacity         = 4;
 static const int kMessageBufferLength                  = 8192;
-static const NSTimeInterval kIdleMessagingPollDuration = 0.1;
+static const int kMaximumTimedMessages                 = 64;
 static const int kScratchBufferFrames                  = 4096;
 static const int kInputAudioBufferFrames               = 4096;
-static const int kLevelMonitorScratchBufferSize        = 4096;
 static const NSTimeInterval kMaxBufferDurationWithVPIO = 0.01;
+static const UInt32 kMaximumFramesPerSlice             = 4096;
 static const Float32 kNoValue                          = -1.0;
+static const UInt32 kUnknownTailFrames                 = UINT32_MAX;
+static const int kRenderBufferAlignment                = 64;
+static const float kExponentialRampFloor               = 0.0001; // -80dB
+static const int kRenderEventLogLength                 = 64;     // Power of two
+static const int kRenderJobCompletionSpinCount         = 2000;
+static const int kRenderJobCompletionWaitNanoseconds   = 500000;
 #define kNoAudioErr                            -2222
+#define kMaximumRenderLanes                    16        // Core Audio thread, plus render workers
 
 static Float32 __cachedInputLatency = kNoValue;
 static Float32 __cachedOutputLatency = kNoValue;
@@ -58,6 +66,12 @@ NSString * const AEAudioControllerSessionInterruptionBeganNotification = @"com.t
 NSString * const AEAudioControllerSessionInterruptionEndedNotification = @"com.theamazingaudioengine.AEAudioControllerSessionInterruptionEndedNotification";
 NSString * const AEAudioControllerDidRecreateGraphNotification = @"com.theamazingaudioengine.AEAudioControllerDidRecreateGraphNotification";
 
+NSString * const AERenderProfileNodeKey = @"node";
+NSString * const AERenderProfileNodeTypeKey = @"type";
+NSString * const AERenderProfileAverageLoadKey = @"averageLoad";
+NSString * const AERenderProfilePeakLoadKey = @"peakLoad";
+NSString * const AERenderProfileHistogramKey = @"histogram";
+
 const NSString *kAEAudioControllerCallbackKey = @"callback";
 const NSString *kAEAudioControllerUserInfoKey = @"userinfo";
 
@@ -114,9 +128,26 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
 enum {
     kFilterFlag               = 1<<0,
     kReceiverFlag             = 1<<1,
+    kClientFormatFlag         = 1<<2,
     kAudiobusSenderPortFlag   = 1<<3
 };
 
+/*!
+ * Render profile
+ *
+ *  Processing time for one node, written only by the thread rendering the node. The
+ *  main thread reads it and then sets the reset flag, like the level monitor's.
+ */
+typedef struct __render_profile_t {
+    void               *node;           // Identity, for render timing events
+    AERenderProfileNodeType nodeType;
+    uint64_t            totalTicks;
+    uint64_t            totalFrames;
+    float               peakLoad;
+    UInt32              histogram[AERenderProfileHistogramBucketCount];
+    BOOL                reset;
+} render_profile_t;
+
 /*!
  * Callback
  */
@@ -124,14 +155,34 @@ typedef struct __callback_t {
     void *callback;
     void *userInfo;
     uint8_t flags;
+    UInt32 tailFrames;
+    UInt32 silentFrames;
+    UInt32 latencyFrames;
+    render_profile_t *profile;
 } callback_t;
 
 /*!
  * Callback table
+ *
+ *  The main thread edits its own copy of the table (count, capacity and callbacks),
+ *  which the realtime thread never sees. Changes are published by compiling that copy
+ *  into a new render copy, swapped in on the realtime thread: the callbacks, plus
+ *  filters in processing order (most recently added first) and receivers, in one
+ *  allocation, followed by the callbacks' render profiles, which are carried over
+ *  from the old render copy.
  */
 typedef struct __callback_table_t {
     int count;
-    callback_t callbacks[kMaximumCallbacksPerSource];
+    int capacity;
+    callback_t *callbacks;
+    BOOL publishPending;
+    int renderCount;
+    callback_t *renderCallbacks;
+    int filterCount;
+    callback_t *filters;
+    int receiverCount;
+    callback_t *receivers;
+    render_profile_t *profiles;
 } callback_table_t;
 
 /*!
@@ -156,11 +207,100 @@ typedef struct __audio_level_monitor_t {
     float               peak;
     float               average;
     AEFloatConverter   *floatConverter;
-    AudioBufferList    *scratchBuffer;
     int                 channels;
     BOOL                reset;
 } audio_level_monitor_t;
 
+/*!
+ * Software mixer input
+ *
+ *  Per-channel resources used when the channel's parent group is mixed in software
+ */
+typedef struct __software_mixer_input_t {
+    AEFloatConverter   *floatConverter;
+    AudioBufferList    *floatBuffer;
+    BOOL                renderInPlace;  // Channel produces float audio: render straight into floatBuffer
+    float               gains[2];
+} software_mixer_input_t;
+
+/*!
+ * Delay line
+ *
+ *  Holds back a channel's output to line it up with the slowest of its siblings. One
+ *  mirrored circular buffer per audio buffer, primed with the delay's worth of silence;
+ *  each render writes the new audio in and reads the same amount back out.
+ */
+typedef struct {
+    UInt32              frames;
+    UInt32              silentFrames;   // Silence written since the last audio, up to frames
+    UInt32              bytesPerFrame;
+    int                 bufferCount;
+    TPCircularBuffer    buffers[1];
+} delay_line_t;
+
+/*!
+ * Aux send
+ *
+ *  One of a channel's sends to an aux bus. The level is set directly by the main thread;
+ *  the gain actually applied last buffer is kept so changes can be ramped.
+ */
+typedef struct {
+    struct _channel_group_t *bus;
+    float               level;
+    float               gain;
+} aux_send_t;
+
+/*!
+ * Aux bus accumulator
+ *
+ *  Non-interleaved float audio sent to a bus during one render cycle.
+ */
+typedef struct {
+    int32_t             epoch;          // Render cycle the audio was sent in
+    UInt32              frames;         // Frames written since the bus last took them
+    AudioBufferList    *buffer;
+} aux_bus_accumulator_t;
+
+/*!
+ * Aux bus render lane
+ *
+ *  Only ever written by senders rendering on the lane, and by the bus when it can't
+ *  be rendering at the same time as them.
+ */
+typedef struct {
+    aux_bus_accumulator_t accumulators[2]; // Indexed by render cycle parity
+} aux_bus_lane_t;
+
+/*!
+ * Aux bus
+ *
+ *  Senders mix into their render lane's accumulator for the current render cycle as they
+ *  render, so senders on different threads never share one. When the bus group renders, it
+ *  mixes in this cycle's sends, plus any that arrived after it rendered last cycle, then
+ *  empties them. Sends older than that are discarded. While channels are rendering in
+ *  parallel, the bus only takes this cycle's sends from its own lane; the others are
+ *  still being written, and are taken next cycle.
+ */
+typedef struct {
+    aux_bus_lane_t      lanes[kMaximumRenderLanes];
+    volatile int32_t    laneCount;         // Lanes with buffers; only grows
+    AudioStreamBasicDescription floatFormat;
+    AEFloatConverter   *outputConverter;   // Between the group's format and float
+} aux_bus_t;
+
+/*!
+ * Parameter ramp
+ *
+ *  Moves a channel's volume or pan towards a target over a number of frames. Only
+ *  touched on the realtime thread, which advances it once per buffer.
+ */
+typedef struct {
+    float               target;
+    float               step;           // Per frame: an increment (linear) or a factor (exponential)
+    UInt32              remainingFrames;
+    BOOL                exponential;
+} parameter_ramp_t;
+
 /*!
  * Source types
  */
@@ -180,18 +320,57 @@ typedef struct __channel_t {
     float            volume;
     float            pan;
     BOOL             muted;
+    parameter_ramp_t volumeRamp;
+    parameter_ramp_t panRamp;
+    UInt32           rampFrames;        // How far into the current buffer the latest volume/pan change runs
+    UInt32           rampOffset;        // How far into the current buffer that change starts
+    UInt32           stepOffset;        // Frame in the coming buffer of a timed change, when stepPending
+    BOOL             stepPending;
     AudioStreamBasicDescription audioDescription;
     callback_table_t callbacks;
+    render_profile_t renderProfile;
     AudioTimeStamp   timeStamp;
     
+    UInt32           latencyFrames;     // Through the channel's filters and, for a group, its mix
+    UInt32           downstreamLatencyFrames; // Added after the channel's compensated output, before the hardware
+    delay_line_t    *delayLine;         // Compensation, to keep in phase with the slowest sibling
+    delay_line_t    *renderDelayLine;   // As last published to the realtime thread
+    
     BOOL             setRenderNotification;
     
     AEAudioController *audioController;
     ABSenderPort     *audiobusSenderPort;
     AEFloatConverter *audiobusFloatConverter;
     AudioBufferList *audiobusScratchBuffer;
+    float            audiobusGains[2];
+    
+    software_mixer_input_t *mixerInput;
+    AEFloatConverter *clientFormatConverter; // For receivers that need bus audio in the client format
+    
+    aux_send_t      *sends;             // Taken after filters and volume; replaced whole when sends are added or removed
+    int              sendCount;
+    aux_send_t      *renderSends;       // As last published to the realtime thread, which keeps their gains
+    int              renderSendCount;
+    AEFloatConverter *sendFloatConverter;
+    
+    BOOL             publishPending;    // Sends or delay line changed since last published
 } channel_t, *AEChannelRef;
 
+/*!
+ * Render schedule step
+ *
+ *  A software-mixed group whose mix has been flattened into the schedule of the nearest
+ *  ancestor still pulled through renderCallback. Steps are in post-order, so each group's
+ *  nested groups are mixed before it.
+ */
+typedef struct {
+    struct _channel_group_t *group;
+    struct _channel_group_t *parent;
+    int                 index;          // Group's index within its parent
+    int                 parentStep;     // Parent's step, or -1 if the parent owns the schedule
+    int                 firstStep;      // First step of this group's subtree
+} render_schedule_step_t;
+
 /*!
  * Channel group
  */
@@ -199,11 +378,23 @@ typedef struct _channel_group_t {
     AEChannelRef        channel;
     AUNode              mixerNode;
     AudioUnit           mixerAudioUnit;
-    AEChannelRef        channels[kMaximumChannelsPerGroup];
+    AEChannelRef       *channels;       // Main thread's copy of the table
     int                 channelCount;
+    int                 channelCapacity;
+    AEChannelRef       *renderChannels; // As last published to the realtime thread
+    int                 renderChannelCount;
+    BOOL                publishPending;
     AUNode              converterNode;
     AudioUnit           converterUnit;
     audio_level_monitor_t level_monitor_data;
+    BOOL                softwareMixing;
+    AEFloatConverter   *mixerOutputConverter;
+    BOOL                mixInPlace;     // Group output is float: accumulate straight into the output buffer
+    software_mixer_input_t **renderedInputs; // Indexed like renderChannels
+    BOOL                flattened;      // Mixed by an ancestor's schedule, not pulled through renderCallback
+    render_schedule_step_t *schedule;
+    int                 scheduleLength;
+    aux_bus_t          *auxBus;         // Also mixes in sends from other channels, if this is an aux bus
 } channel_group_t;
 
 #pragma mark Messaging
@@ -213,13 +404,469 @@ typedef struct _channel_group_t {
  */
 typedef struct {
     void                            (^block)();
+    AEAudioControllerTimedMessageBlock timedBlock;
+    AudioTimeStamp                  targetTime;
     void                            (^responseBlock)();
     AEAudioControllerMainThreadMessageHandler handler;
     void                           *userInfoByReference;
     int                             userInfoLength;
-    pthread_t                       sourceThread;
+    semaphore_t                     responseSemaphore;
+    uint64_t                        sendTime;
 } message_t;
 
+/*!
+ * Main thread message queue
+ *
+ *  Multi-producer, single-consumer queue of variable-length records, used to send
+ *  messages to the main thread from both the output and input realtime threads.
+ *
+ *  Producers claim space by compare-and-swap on the reserve index, write their record,
+ *  then mark it committed. The consumer reads records in reserve order, stopping at the
+ *  first one that hasn't been committed yet, and zeroes each record once it's done with
+ *  it so that free space never contains a stale commit flag.
+ */
+typedef struct {
+    TPCircularBuffer    storage;        // Mirrored memory only: indices below are used instead of the buffer's own
+    volatile uint32_t   reserveIndex;   // Free-running, wrapping; advanced by producers
+    volatile uint32_t   tail;           // Free-running, wrapping; advanced by the consumer
+    volatile int32_t    retryCount;     // Number of times a producer lost a reservation race
+} message_queue_t;
+
+typedef struct {
+    int32_t             length;         // Total length of record, including this header
+    volatile int32_t    committed;
+} message_queue_record_t;
+
+static const int kMessageQueueRecordAlignment = 16;
+
+static BOOL messageQueueInit(message_queue_t *queue, int32_t length) {
+    memset(queue, 0, sizeof(message_queue_t));
+    if ( !TPCircularBufferInit(&queue->storage, length) ) return NO;
+    // Indices are masked, so the length must be a power of two (page multiples of 8192 always are)
+    assert((queue->storage.length & (queue->storage.length-1)) == 0);
+    return YES;
+}
+
+static void messageQueueCleanup(message_queue_t *queue) {
+    TPCircularBufferCleanup(&queue->storage);
+}
+
+static inline message_queue_record_t *messageQueueRecordAtIndex(message_queue_t *queue, uint32_t index) {
+    return (message_queue_record_t*)((char*)queue->storage.buffer + (index & (queue->storage.length-1)));
+}
+
+static void *messageQueueReserve(message_queue_t *queue, int32_t length) {
+    uint32_t recordLength = sizeof(message_queue_record_t) + length;
+    recordLength = (recordLength + kMessageQueueRecordAlignment-1) & ~(kMessageQueueRecordAlignment-1);
+    
+    while ( 1 ) {
+        uint32_t reserveIndex = queue->reserveIndex;
+        if ( reserveIndex + recordLength - queue->tail > (uint32_t)queue->storage.length ) {
+            return NULL; // Full
+        }
+        if ( OSAtomicCompareAndSwap32Barrier((int32_t)reserveIndex, (int32_t)(reserveIndex + recordLength), (volatile int32_t*)&queue->reserveIndex) ) {
+            message_queue_record_t *record = messageQueueRecordAtIndex(queue, reserveIndex);
+            record->length = recordLength;
+            return record + 1;
+        }
+        // Another producer got in first
+        OSAtomicIncrement32(&queue->retryCount);
+    }
+}
+
+static void messageQueueCommit(message_queue_t *queue, void *reservation) {
+    message_queue_record_t *record = (message_queue_record_t*)reservation - 1;
+    OSMemoryBarrier();
+    record->committed = YES;
+}
+
+static void *messageQueueNext(message_queue_t *queue) {
+    if ( queue->tail == queue->reserveIndex ) return NULL;
+    message_queue_record_t *record = messageQueueRecordAtIndex(queue, queue->tail);
+    if ( !record->committed ) return NULL; // Next record is still being written
+    OSMemoryBarrier();
+    return record + 1;
+}
+
+static void messageQueueConsume(message_queue_t *queue) {
+    message_queue_record_t *record = messageQueueRecordAtIndex(queue, queue->tail);
+    uint32_t length = record->length;
+    memset(record, 0, length);
+    OSMemoryBarrier();
+    queue->tail += length;
+}
+
+#pragma mark Render timing
+
+/*!
+ * Slowest node rendered by one thread in the current cycle
+ */
+typedef struct {
+    render_profile_t   *profile;
+    uint64_t            ticks;
+} __attribute__((aligned(64))) render_slowest_node_t;
+
+/*!
+ * Render timing monitor
+ *
+ *  Tracks the timestamps and processing time of one context's (output or input) buffers.
+ *  Written only by that context's realtime thread, except for the per-lane slowest nodes,
+ *  each written only by the thread rendering on that lane and merged by the realtime thread
+ *  at the end of the cycle. The statistics are read on the main thread, which then sets the
+ *  reset flag.
+ */
+typedef struct {
+    uint64_t            lastHostTime;
+    Float64             lastSampleTime;
+    UInt32              lastFrames;
+    uint64_t            cycleStartTime;
+    render_slowest_node_t slowestPerLane[kMaximumRenderLanes];
+    render_profile_t   *slowestProfile;     // Slowest node of the last completed cycle, across all lanes
+    uint64_t            slowestTicks;
+    
+    UInt32              cycles;
+    UInt32              overruns;
+    UInt32              discontinuities;
+    UInt32              lateCallbacks;
+    double              jitterAccumulator;
+    double              maxJitter;
+    double              maxProcessingTime;
+    BOOL                reset;
+} render_timing_monitor_t;
+
+/*!
+ * Render event log entry
+ *
+ *  The sequence number is written last, once the event is complete: it's the entry's
+ *  index in the log plus one.
+ */
+typedef struct {
+    AERenderEvent       event;
+    volatile int32_t    sequence;
+} render_event_entry_t;
+
+#pragma mark Deferred release
+
+/*!
+ * Retired item, awaiting release once the render thread is done with it
+ */
+typedef struct {
+    void                            (^releaseBlock)();
+    int32_t                         renderEpoch;
+} retired_item_t;
+
+#pragma mark Render buffer pool
+
+/*!
+ * Render buffer lane
+ *
+ *  The transient buffers for one rendering thread, used as a stack. A software-mixed
+ *  group holds a slot while each of its channels renders into it; the slot at the
+ *  current depth is scratch space for whatever is running (filters, mix accumulation,
+ *  level metering), valid until it renders anything else.
+ */
+typedef struct {
+    char               *slots;
+    int                 depth;
+} __attribute__((aligned(64))) render_buffer_lane_t;
+
+/*!
+ * Render buffer pool
+ *
+ *  A single 64-byte-aligned allocation holding the lane headers followed by every
+ *  lane's slots, sized from the graph by -updateRenderBufferPool.
+ */
+typedef struct {
+    void               *memory;
+    size_t              size;
+    size_t              slotSize;
+    int                 slotCount;      // Per lane: deepest software mixing nesting, plus scratch
+    int                 laneCount;      // Core Audio thread, plus one per render worker
+    render_buffer_lane_t *lanes;
+} render_buffer_pool_t;
+
+static pthread_key_t __renderBufferLaneKey;
+
+static inline size_t renderBufferAlign(size_t size) {
+    return (size + kRenderBufferAlignment-1) & ~(size_t)(kRenderBufferAlignment-1);
+}
+
+static size_t renderBufferSlotSizeForFormat(const AudioStreamBasicDescription *format) {
+    if ( !format->mBytesPerFrame || !format->mChannelsPerFrame ) return 0;
+    
+    // Room for audio in the format itself, and in its float equivalent
+    int bufferCount = format->mFormatFlags & kAudioFormatFlagIsNonInterleaved ? format->mChannelsPerFrame : 1;
+    size_t nativeSize = bufferCount * renderBufferAlign(kMaximumFramesPerSlice * format->mBytesPerFrame);
+    size_t floatSize = format->mChannelsPerFrame * renderBufferAlign(kMaximumFramesPerSlice * sizeof(float));
+    return MAX(nativeSize, floatSize);
+}
+
+static render_buffer_pool_t *renderBufferPoolCreate(int laneCount, int slotCount, size_t slotSize) {
+    render_buffer_pool_t *pool = (render_buffer_pool_t*)calloc(1, sizeof(render_buffer_pool_t));
+    size_t headerSize = renderBufferAlign(laneCount * sizeof(render_buffer_lane_t));
+    size_t laneSize = slotCount * slotSize;
+    
+    pool->size = headerSize + laneCount * laneSize;
+    if ( posix_memalign(&pool->memory, kRenderBufferAlignment, pool->size) != 0 ) {
+        free(pool);
+        return NULL;
+    }
+    
+    pool->slotSize  = slotSize;
+    pool->slotCount = slotCount;
+    pool->laneCount = laneCount;
+    pool->lanes     = (render_buffer_lane_t*)pool->memory;
+    for ( int i=0; i<laneCount; i++ ) {
+        pool->lanes[i].slots = (char*)pool->memory + headerSize + i * laneSize;
+        pool->lanes[i].depth = 0;
+    }
+    
+    return pool;
+}
+
+static void renderBufferPoolDestroy(render_buffer_pool_t *pool) {
+    free(pool->memory);
+    free(pool);
+}
+
+static inline render_buffer_lane_t *renderBufferPoolCurrentLane(render_buffer_pool_t *pool) {
+    if ( !pool ) return NULL;
+    
+    // Render workers are assigned lanes from 1; every other thread shares the Core Audio thread's lane
+    int index = (int)(intptr_t)pthread_getspecific(__renderBufferLaneKey);
+    return index < pool->laneCount ? &pool->lanes[index] : NULL;
+}
+
+static inline char *renderBufferLaneSlot(render_buffer_pool_t *pool, render_buffer_lane_t *lane) {
+    return lane && lane->depth < pool->slotCount ? lane->slots + lane->depth * pool->slotSize : NULL;
+}
+
+static BOOL renderBufferSlotAssignToBufferList(render_buffer_pool_t *pool, char *slot, const AudioStreamBasicDescription *format, UInt32 frames, AudioBufferList *bufferList) {
+    // The buffer list must have room for one buffer per channel if the format is non-interleaved
+    BOOL nonInterleaved = format->mFormatFlags & kAudioFormatFlagIsNonInterleaved;
+    size_t stride = renderBufferAlign(frames * format->mBytesPerFrame);
+    bufferList->mNumberBuffers = nonInterleaved ? format->mChannelsPerFrame : 1;
+    if ( !slot || stride * bufferList->mNumberBuffers > pool->slotSize ) return NO;
+    
+    for ( int i=0; i<bufferList->mNumberBuffers; i++ ) {
+        bufferList->mBuffers[i].mNumberChannels = nonInterleaved ? 1 : format->mChannelsPerFrame;
+        bufferList->mBuffers[i].mData = slot + i * stride;
+        bufferList->mBuffers[i].mDataByteSize = frames * format->mBytesPerFrame;
+    }
+    return YES;
+}
+
+#pragma mark Delay lines
+
+static delay_line_t *delayLineCreate(const AudioStreamBasicDescription *format, UInt32 frames) {
+    if ( !format->mBytesPerFrame || !format->mChannelsPerFrame ) return NULL;
+    
+    int bufferCount = format->mFormatFlags & kAudioFormatFlagIsNonInterleaved ? format->mChannelsPerFrame : 1;
+    delay_line_t *line = (delay_line_t*)calloc(1, sizeof(delay_line_t) + (bufferCount-1)*sizeof(TPCircularBuffer));
+    line->frames = frames;
+    line->silentFrames = frames;
+    line->bytesPerFrame = format->mBytesPerFrame;
+    
+    int32_t delayBytes = frames * format->mBytesPerFrame;
+    for ( ; line->bufferCount<bufferCount; line->bufferCount++ ) {
+        TPCircularBuffer *buffer = &line->buffers[line->bufferCount];
+        if ( !TPCircularBufferInit(buffer, delayBytes + kMaximumFramesPerSlice * format->mBytesPerFrame) ) break;
+        
+        int32_t availableBytes;
+        void *head = TPCircularBufferHead(buffer, &availableBytes);
+        memset(head, 0, delayBytes);
+        TPCircularBufferProduce(buffer, delayBytes);
+    }
+    
+    if ( line->bufferCount < bufferCount ) {
+        NSLog(@"TAAE: Couldn't allocate delay line of %d frames", (int)frames);
+        for ( int i=0; i<line->bufferCount; i++ ) TPCircularBufferCleanup(&line->buffers[i]);
+        free(line);
+        return NULL;
+    }
+    
+    return line;
+}
+
+static void delayLineDestroy(delay_line_t *line) {
+    for ( int i=0; i<line->bufferCount; i++ ) {
+        TPCircularBufferCleanup(&line->buffers[i]);
+    }
+    free(line);
+}
+
+static void delayLineProcess(delay_line_t *line, AudioUnitRenderActionFlags *ioActionFlags, UInt32 frames, AudioBufferList *audio) {
+    if ( audio->mNumberBuffers != line->bufferCount || frames > kMaximumFramesPerSlice ) return;
+    
+    int32_t bytes = frames * line->bytesPerFrame;
+    
+    if ( *ioActionFlags & kAudioUnitRenderAction_OutputIsSilence ) {
+        // Once the line holds nothing but silence, there's nothing to move through it
+        if ( line->silentFrames >= line->frames ) return;
+        line->silentFrames += frames;
+        for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+            memset(audio->mBuffers[i].mData, 0, bytes);
+        }
+        *ioActionFlags &= ~kAudioUnitRenderAction_OutputIsSilence;
+    } else {
+        line->silentFrames = 0;
+    }
+    
+    // The same thread writes and reads, so no barriers are needed
+    for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+        TPCircularBuffer *buffer = &line->buffers[i];
+        int32_t availableBytes;
+        void *head = TPCircularBufferHead(buffer, &availableBytes);
+        if ( !head || availableBytes < bytes ) continue;
+        memcpy(head, audio->mBuffers[i].mData, bytes);
+        TPCircularBufferProduceNoBarrier(buffer, bytes);
+        
+        void *tail = TPCircularBufferTail(buffer, &availableBytes);
+        memcpy(audio->mBuffers[i].mData, tail, bytes);
+        TPCircularBufferConsumeNoBarrier(buffer, bytes);
+        audio->mBuffers[i].mDataByteSize = bytes;
+    }
+}
+
+#pragma mark Aux buses
+
+static void auxBusSetLaneCount(aux_bus_t *bus, int laneCount) {
+    // Give any new lanes buffers before publishing them; lanes aren't freed until the bus is
+    for ( int lane=bus->laneCount; lane<MIN(laneCount, kMaximumRenderLanes); lane++ ) {
+        for ( int i=0; i<2; i++ ) {
+            AudioBufferList *buffer = AEAllocateAndInitAudioBufferList(bus->floatFormat, kMaximumFramesPerSlice);
+            for ( int j=0; j<buffer->mNumberBuffers; j++ ) {
+                memset(buffer->mBuffers[j].mData, 0, buffer->mBuffers[j].mDataByteSize);
+            }
+            bus->lanes[lane].accumulators[i].buffer = buffer;
+        }
+    }
+    
+    if ( laneCount > bus->laneCount ) {
+        OSMemoryBarrier();
+        bus->laneCount = MIN(laneCount, kMaximumRenderLanes);
+    }
+}
+
+static aux_bus_t *auxBusCreate(const AudioStreamBasicDescription *format, int laneCount) {
+    aux_bus_t *bus = (aux_bus_t*)calloc(1, sizeof(aux_bus_t));
+    
+    // Sends accumulate as non-interleaved float, with as many channels as the output
+    bus->floatFormat = (AudioStreamBasicDescription) {
+        .mSampleRate        = format->mSampleRate,
+        .mFormatID          = kAudioFormatLinearPCM,
+        .mFormatFlags       = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked | kAudioFormatFlagIsNonInterleaved,
+        .mBytesPerPacket    = sizeof(float),
+        .mFramesPerPacket   = 1,
+        .mBytesPerFrame     = sizeof(float),
+        .mChannelsPerFrame  = format->mChannelsPerFrame,
+        .mBitsPerChannel    = 8 * sizeof(float)
+    };
+    
+    auxBusSetLaneCount(bus, laneCount);
+    
+    return bus;
+}
+
+static void auxBusDestroy(aux_bus_t *bus) {
+    for ( int lane=0; lane<bus->laneCount; lane++ ) {
+        for ( int i=0; i<2; i++ ) {
+            AEFreeAudioBufferList(bus->lanes[lane].accumulators[i].buffer);
+        }
+    }
+    [bus->outputConverter release];
+    free(bus);
+}
+
+/*!
+ * Send table update
+ *
+ *  A channel's replacement send table, prepared on the main thread.
+ */
+typedef struct {
+    AEChannelRef        channel;
+    aux_send_t         *sends;
+    int                 sendCount;
+} send_table_update_t;
+
+/*!
+ * Group configuration deferred until a batch of updates is committed
+ */
+typedef struct {
+    AEChannelGroupRef   group;          // NULL for the top channel's connection to the output unit
+    NSRange             range;
+    BOOL                trimBusCount;
+} pending_group_configuration_t;
+
+/*!
+ * Group table publication
+ *
+ *  A render copy of a group's channel table, prepared on the main thread to be swapped
+ *  in with the others in one message exchange. Afterwards, holds the old render copy.
+ */
+typedef struct {
+    AEChannelGroupRef   group;
+    AEChannelRef       *channels;
+    int                 channelCount;
+    software_mixer_input_t **renderedInputs;
+} group_publication_t;
+
+/*!
+ * Callback table publication
+ *
+ *  As for group tables; only the render fields of the compiled table are used.
+ */
+typedef struct {
+    callback_table_t   *table;
+    callback_table_t    compiled;
+} callback_table_publication_t;
+
+/*!
+ * Channel publication
+ *
+ *  A channel's send table and delay line, as for group tables.
+ */
+typedef struct {
+    AEChannelRef        channel;
+    aux_send_t         *sends;
+    int                 sendCount;
+    delay_line_t       *delayLine;
+} channel_publication_t;
+
+#pragma mark Render worker pool
+
+/*!
+ * Parallel render job: renders the channels of one software-mixed group
+ *
+ *  The cursor packs a job sequence number (high 32 bits), the channel count and the
+ *  next unclaimed channel index (16 bits each), so that a worker can only claim an
+ *  index belonging to the job whose parameters it read.
+ */
+typedef struct {
+    AEChannelGroupRef   group;
+    AudioTimeStamp      timeStamp;
+    UInt32              frames;
+    volatile int64_t    cursor;         // Sequence number, channel count and next index, in 32, 16 and 16 bits
+    volatile int32_t    remaining;
+    volatile int32_t    waiting;        // Set when the thread that posted the job blocks on its completion
+    semaphore_t         completionSemaphore;
+} render_job_t;
+
+/*!
+ * Render worker pool
+ */
+typedef struct {
+    pthread_t          *threads;
+    int                 threadCount;
+    semaphore_t         semaphore;
+    semaphore_t         completionSemaphore;
+    volatile uint32_t   period;         // Buffer duration in host ticks, kept current for the workers' time constraints
+    volatile int32_t    busy;
+    volatile int32_t    stop;
+    volatile int32_t    nextLane;
+    render_job_t        job;
+} render_worker_pool_t;
+
 
 #pragma mark -
 
@@ -231,7 +878,6 @@ typedef struct {
 
 @interface AEAudioControllerMessagePollThread : NSThread
 - (id)initWithAudioController:(AEAudioController*)audioController;
-@property (nonatomic, assign) NSTimeInterval pollInterval;
 @end
 
 @interface AEAudioController () {
@@ -244,6 +890,13 @@ typedef struct {
     BOOL                _running;
     BOOL                _runningPriorToInterruption;
     BOOL                _hasSystemError;
+    BOOL                _offline;
+    
+    Float64             _offlineSampleTime;
+    uint64_t            _offlineHostTimeBase;
+    UInt64              _offlineRenderedFrames;
+    uint64_t            _offlineRenderTicks;
+    BOOL                _offlineRenderInProgress;
     
     AEChannelGroupRef   _topGroup;
     AEChannelRef        _topChannel;
@@ -256,20 +909,79 @@ typedef struct {
     AudioBufferList    *_inputAudioBufferList;
     
     TPCircularBuffer    _realtimeThreadMessageBuffer;
-    TPCircularBuffer    _mainThreadMessageBuffer;
+    message_t           _timedMessages[kMaximumTimedMessages];
+    int                 _timedMessageCount;
+    message_queue_t     _mainThreadMessageQueue;
     AEAudioControllerMessagePollThread *_pollThread;
-    int                 _pendingResponses;
+    semaphore_t         _mainThreadMessageSemaphore;
+    BOOL                _pollingForMessageResponses;
+    volatile int32_t    _mainThreadMessageSignalled;
+    uint64_t            _mainThreadMessageLatencyTotal;
+    uint64_t            _mainThreadMessageLatencyMaximum;
+    int                 _mainThreadMessageLatencyCount;
+    uint64_t            _synchronousMessageExchangeLatencyTotal;
+    uint64_t            _synchronousMessageExchangeLatencyMaximum;
+    int                 _synchronousMessageExchangeLatencyCount;
+    
+    void             (^*_transactionBlocks)();
+    int                 _transactionBlockCount;
+    int                 _transactionBlockCapacity;
+    int                 _transactionDepth;
+    pthread_t           _transactionThread;
+    NSMutableArray     *_transactionResponseBlocks;
+    
+    int                 _updateBatchDepth;
+    NSMutableData      *_pendingGroupConfigurations;
+    NSMutableData      *_pendingChannelReleases;
+    BOOL                _graphUpdatePending;
+    NSMutableData      *_pendingGroupPublications;
+    NSMutableData      *_pendingCallbackTablePublications;
+    NSMutableData      *_pendingChannelPublications;
+    void              (^_pendingUpdateBlock)();
+    NSMutableArray     *_pendingUpdateCompletions;
+    BOOL                _holdingUpdates;
+    
+    volatile int32_t    _renderEpoch;
+    volatile BOOL       _parallelRenderInProgress;
+    retired_item_t     *_retiredItems;
+    int                 _retiredItemCount;
+    int                 _retiredItemCapacity;
     
     audio_level_monitor_t _inputLevelMonitorData;
     BOOL                _usingAudiobusInput;
-}
-
+    BOOL                _softwareMixingEnabled;
+    BOOL                _floatBusesEnabled;
+    BOOL                _renderProfilingEnabled;
+    AudioStreamBasicDescription _busAudioDescription;
+    render_worker_pool_t *_renderWorkerPool;
+    render_buffer_pool_t *_renderBufferPool;
+    size_t              _renderWorkingSetSize;
+    
+    render_timing_monitor_t _outputTimingMonitor;
+    render_timing_monitor_t _inputTimingMonitor;
+    render_timing_monitor_t *_activeTimingMonitor;
+    render_event_entry_t _renderEventLog[kRenderEventLogLength];
+    volatile int32_t    _renderEventWriteIndex;
+    int32_t             _renderEventReadIndex;
+    int32_t             _renderEventsDropped;
+}
+
+- (id)initWithAudioDescription:(AudioStreamBasicDescription)audioDescription inputEnabled:(BOOL)enableInput useVoiceProcessing:(BOOL)useVoiceProcessing offline:(BOOL)offline;
 - (BOOL)mustUpdateVoiceProcessingSettings;
 - (void)replaceIONode;
 - (BOOL)updateInputDeviceStatus;
 static void processPendingMessagesOnRealtimeThread(AEAudioController *THIS);
+static void processTimedMessagesOnRealtimeThread(AEAudioController *THIS, const AudioTimeStamp *time, UInt32 frames);
+static BOOL AEAudioControllerHasPendingMainThreadMessages(AEAudioController *THIS);
+static void AEAudioControllerReleaseRetiredItems(AEAudioController *THIS);
 static void handleCallbacksForChannel(AEChannelRef channel, const AudioTimeStamp *inTimeStamp, UInt32 inNumberFrames, AudioBufferList *ioData);
-static void performLevelMonitoring(audio_level_monitor_t* monitor, AudioBufferList *buffer, UInt32 numberFrames);
+static OSStatus renderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList *ioData);
+static void performLevelMonitoring(render_buffer_pool_t *pool, audio_level_monitor_t* monitor, AudioBufferList *buffer, UInt32 numberFrames);
+static void performLevelMonitoringOfSilence(audio_level_monitor_t* monitor);
+static void compileCallbackTable(const callback_table_t *table, callback_table_t *compiled);
+static void publishCallbackTable(callback_table_t *table, callback_table_t *compiled);
+static void publishChannel(channel_publication_t *publication);
+static BOOL callbackTableHasFlags(callback_table_t *table, uint8_t flags);
 
 @property (nonatomic, retain, readwrite) NSString *audioRoute;
 @property (nonatomic, assign, readwrite) float currentBufferDuration;
@@ -294,122 +1006,840 @@ audioUnit                   = _ioAudioUnit,
 audioGraph                  = _audioGraph,
 audioDescription            = _audioDescription,
 audioRoute                  = _audioRoute,
-audiobusReceiverPort        = _audiobusReceiverPort;
+audiobusReceiverPort        = _audiobusReceiverPort,
+synchronousMessageExchangeTimeout = _synchronousMessageExchangeTimeout,
+softwareMixingEnabled       = _softwareMixingEnabled,
+floatBusesEnabled           = _floatBusesEnabled,
+renderProfilingEnabled      = _renderProfilingEnabled,
+busAudioDescription         = _busAudioDescription;
 
 @dynamic    running, inputGainAvailable, inputGain, audiobusSenderPort, inputAudioDescription, inputChannelSelection;
 
 #pragma mark - Audio session callbacks
 
-static AEAudioController * __interruptionListenerSelf = nil;
+static AEAudioController * __interruptionListenerSelf = nil;
+
+static void interruptionListener(void *inClientData, UInt32 inInterruption) {
+    if ( !__interruptionListenerSelf ) return;
+    
+    AEAudioController *THIS = __interruptionListenerSelf;
+    
+    if (inInterruption == kAudioSessionEndInterruption) {
+        NSLog(@"TAAE: Audio session interruption ended");
+        THIS->_interrupted = NO;
+        
+        if ( [[UIApplication sharedApplication] applicationState] != UIApplicationStateBackground || THIS->_runningPriorToInterruption ) {
+            // make sure we are again the active session
+            checkResult(AudioSessionSetActive(true), "AudioSessionSetActive");
+        }
+        
+        if ( THIS->_runningPriorToInterruption && ![THIS running] ) {
+            [THIS start:NULL];
+        }
+        
+        [[NSNotificationCenter defaultCenter] postNotificationName:AEAudioControllerSessionInterruptionEndedNotification object:THIS];
+    } else if (inInterruption == kAudioSessionBeginInterruption) {
+        NSLog(@"TAAE: Audio session interrupted");
+        THIS->_runningPriorToInterruption = THIS->_running;
+        
+        THIS->_interrupted = YES;
+        
+        if ( THIS->_runningPriorToInterruption ) {
+            [THIS stop];
+        }
+        
+        [[NSNotificationCenter defaultCenter] postNotificationName:AEAudioControllerSessionInterruptionBeganNotification object:THIS];
+        
+        processPendingMessagesOnRealtimeThread(THIS);
+    }
+}
+
+static void audioSessionPropertyListener(void *inClientData, AudioSessionPropertyID inID, UInt32 inDataSize, const void *inData) {
+    AEAudioController *THIS = (AEAudioController *)inClientData;
+    
+    __cachedInputLatency = kNoValue;
+    __cachedOutputLatency = kNoValue;
+    
+    if (inID == kAudioSessionProperty_AudioRouteChange) {
+        int reason = [[(NSDictionary*)inData objectForKey:[NSString stringWithCString:kAudioSession_AudioRouteChangeKey_Reason encoding:NSUTF8StringEncoding]] intValue];
+        
+        CFStringRef route = NULL;
+        UInt32 size = sizeof(route);
+        if ( !checkResult(AudioSessionGetProperty(kAudioSessionProperty_AudioRoute, &size, &route), "AudioSessionGetProperty(kAudioSessionProperty_AudioRoute)") ) return;
+        
+        THIS.audioRoute = [NSString stringWithString:(NSString*)route];
+        
+        NSLog(@"TAAE: Changed audio route to %@", THIS.audioRoute);
+        
+        BOOL playingThroughSpeaker;
+        if ( [(NSString*)route isEqualToString:@"SpeakerAndMicrophone"] || [(NSString*)route isEqualToString:@"Speaker"] ) {
+            playingThroughSpeaker = YES;
+        } else {
+            playingThroughSpeaker = NO;
+        }
+        
+        CFRelease(route);
+        
+        BOOL updatedVP = NO;
+        if ( THIS->_playingThroughDeviceSpeaker != playingThroughSpeaker ) {
+            [THIS willChangeValueForKey:@"playingThroughDeviceSpeaker"];
+            THIS->_playingThroughDeviceSpeaker = playingThroughSpeaker;
+            [THIS didChangeValueForKey:@"playingThroughDeviceSpeaker"];
+            
+            if ( THIS->_voiceProcessingEnabled && THIS->_voiceProcessingOnlyForSpeakerAndMicrophone ) {
+                if ( [THIS mustUpdateVoiceProcessingSettings] ) {
+                    [THIS replaceIONode];
+                    updatedVP = YES;
+                }
+            }
+        }
+        
+        if ( !updatedVP && (reason == kAudioSessionRouteChangeReason_NewDeviceAvailable || reason == kAudioSessionRouteChangeReason_OldDeviceUnavailable) && THIS->_inputEnabled ) {
+            [THIS updateInputDeviceStatus];
+        }
+        
+    } else if ( inID == kAudioSessionProperty_AudioInputAvailable && THIS->_inputEnabled ) {
+        [THIS updateInputDeviceStatus];
+    }
+}
+
+#pragma mark -
+#pragma mark Input and render callbacks
+
+struct fillComplexBufferInputProc_t { AudioBufferList *bufferList; UInt32 frames;  };
+static OSStatus fillComplexBufferInputProc(AudioConverterRef             inAudioConverter,
+                                           UInt32                        *ioNumberDataPackets,
+                                           AudioBufferList               *ioData,
+                                           AudioStreamPacketDescription  **outDataPacketDescription,
+                                           void                          *inUserData) {
+    struct fillComplexBufferInputProc_t *arg = inUserData;
+    for ( int i=0; i<ioData->mNumberBuffers; i++ ) {
+        ioData->mBuffers[i].mData = arg->bufferList->mBuffers[i].mData;
+        ioData->mBuffers[i].mDataByteSize = arg->bufferList->mBuffers[i].mDataByteSize;
+    }
+    *ioNumberDataPackets = arg->frames;
+    return noErr;
+}
+
+static inline uint64_t renderProfileStart(AEAudioController *THIS) {
+    // Host time a node starts rendering, or 0 when profiling is off
+    return THIS->_renderProfilingEnabled ? mach_absolute_time() : 0;
+}
+
+static inline void renderProfileRecord(AEAudioController *THIS, render_profile_t *profile, uint64_t start, uint64_t excludedTicks, UInt32 frames) {
+    // Record a node that started at the given time, leaving out time spent producing its input
+    if ( !start ) return;
+    uint64_t ticks = mach_absolute_time() - start - excludedTicks;
+    
+    if ( profile->reset ) {
+        profile->totalTicks = 0;
+        profile->totalFrames = 0;
+        profile->peakLoad = 0;
+        memset(profile->histogram, 0, sizeof(profile->histogram));
+        profile->reset = NO;
+    }
+    
+    if ( frames == 0 ) return;
+    
+    // Note the slowest node for render timing events (groups include their contents, so aren't candidates).
+    // Render workers may be doing the same, so each thread notes its own, on its render buffer lane's entry.
+    render_timing_monitor_t *monitor = THIS->_activeTimingMonitor;
+    if ( monitor && profile->nodeType != AERenderProfileNodeTypeChannelGroup ) {
+        int lane = (int)(intptr_t)pthread_getspecific(__renderBufferLaneKey);
+        render_slowest_node_t *slowest = &monitor->slowestPerLane[lane < kMaximumRenderLanes ? lane : 0];
+        if ( ticks > slowest->ticks ) {
+            slowest->ticks = ticks;
+            slowest->profile = profile;
+        }
+    }
+    
+    // Load is the processing time as a proportion of the time the buffer lasts
+    float load = (float)(ticks * __hostTicksToSeconds * THIS->_audioDescription.mSampleRate / frames);
+    profile->totalTicks += ticks;
+    profile->totalFrames += frames;
+    if ( load > profile->peakLoad ) profile->peakLoad = load;
+    profile->histogram[MIN((int)(load * (AERenderProfileHistogramBucketCount-1)), AERenderProfileHistogramBucketCount-1)]++;
+}
+
+typedef struct __profiled_producer_arg_t {
+    AEAudioControllerFilterProducer producer;
+    void *producerToken;
+    uint64_t ticks;
+} profiled_producer_arg_t;
+
+static OSStatus profiledAudioProducer(void *userInfo, AudioBufferList *audio, UInt32 *frames) {
+    // Produces a filter's input, timing it so that it can be left out of the filter's own figures
+    profiled_producer_arg_t *arg = (profiled_producer_arg_t*)userInfo;
+    uint64_t start = mach_absolute_time();
+    OSStatus status = arg->producer(arg->producerToken, audio, frames);
+    arg->ticks += mach_absolute_time() - start;
+    return status;
+}
+
+typedef struct __channel_producer_arg_t {
+    AEChannelRef channel;
+    AudioTimeStamp inTimeStamp;
+    AudioUnitRenderActionFlags *ioActionFlags;
+    int nextFilterIndex;
+} channel_producer_arg_t;
+
+static inline float softwareMixerTargetGain(AEChannelRef channel, int inputChannelCount, int outputChannel, int outputChannelCount) {
+    if ( outputChannelCount != 2 ) return channel->volume;
+    
+    if ( inputChannelCount == 1 ) {
+        // Pan mono inputs as the multichannel mixer unit does: equal power, -3dB each side at centre
+        float angle = (channel->pan + 1.0) * M_PI_4;
+        return channel->volume * (outputChannel == 0 ? cosf(angle) : sinf(angle));
+    }
+    
+    // The mixer unit's pan is a balance control for stereo inputs: attenuate the opposite side only
+    return channel->volume * (outputChannel == 0 ? (channel->pan <= 0.0 ? 1.0 : 1.0 - channel->pan)
+                                                 : (channel->pan >= 0.0 ? 1.0 : 1.0 + channel->pan));
+}
+
+static void parameterRampStart(parameter_ramp_t *ramp, float *value, float target, UInt32 frames, BOOL exponential) {
+    frames = MAX(frames, 1);
+    ramp->target = target;
+    ramp->exponential = exponential;
+    if ( exponential ) {
+        // Constant rate in decibels, approaching and leaving silence via kExponentialRampFloor
+        float start = MAX(*value, kExponentialRampFloor);
+        *value = start;
+        ramp->step = powf(MAX(target, kExponentialRampFloor) / start, 1.0f / frames);
+    } else {
+        ramp->step = (target - *value) / frames;
+    }
+    ramp->remainingFrames = frames;
+}
+
+static inline UInt32 parameterRampAdvance(parameter_ramp_t *ramp, float *value, UInt32 frames) {
+    // Moves the value on to where it should be at the end of this buffer, and returns
+    // how many frames into the buffer it takes to get there
+    if ( !ramp->remainingFrames ) return frames;
+    
+    UInt32 rampFrames = MIN(frames, ramp->remainingFrames);
+    ramp->remainingFrames -= rampFrames;
+    if ( !ramp->remainingFrames ) {
+        *value = ramp->target;
+    } else if ( ramp->exponential ) {
+        *value *= powf(ramp->step, rampFrames);
+    } else {
+        *value += ramp->step * rampFrames;
+    }
+    return rampFrames;
+}
+
+static inline void channelAdvanceRamps(AEChannelRef channel, UInt32 frames) {
+    // Without a ramp in progress, immediate changes are smoothed over the whole buffer
+    channel->rampOffset = 0;
+    channel->rampFrames = frames;
+    if ( channel->volumeRamp.remainingFrames || channel->panRamp.remainingFrames ) {
+        UInt32 volumeFrames = channel->volumeRamp.remainingFrames ? parameterRampAdvance(&channel->volumeRamp, &channel->volume, frames) : 0;
+        UInt32 panFrames = channel->panRamp.remainingFrames ? parameterRampAdvance(&channel->panRamp, &channel->pan, frames) : 0;
+        channel->rampFrames = MAX(volumeFrames, panFrames);
+    }
+    if ( channel->stepPending ) {
+        // A timed change: hold the old gains until its frame, then step, as the mixer unit does
+        channel->stepPending = NO;
+        channel->rampOffset = MIN(channel->stepOffset, frames);
+        channel->rampFrames = 0;
+    }
+}
+
+static inline void applyGain(const float *source, float *target, float gain, UInt32 frames, BOOL accumulate) {
+    if ( !frames ) return;
+    
+    if ( accumulate ) {
+        if ( gain == 1.0 ) {
+            vDSP_vadd(source, 1, target, 1, target, 1, frames);
+        } else if ( gain != 0.0 ) {
+            vDSP_vsma(source, 1, &gain, target, 1, target, 1, frames);
+        }
+    } else if ( gain != 1.0 || source != target ) {
+        vDSP_vsmul(source, 1, &gain, target, 1, frames);
+    }
+}
+
+static inline void applyGainRamp(const float *source, float *target, float startGain, float endGain, UInt32 rampOffset, UInt32 rampFrames, UInt32 frames, BOOL accumulate) {
+    // Hold startGain for the first rampOffset frames, ramp to endGain over the next rampFrames frames, then hold endGain
+    if ( startGain != endGain && rampOffset > 0 ) {
+        rampOffset = MIN(rampOffset, frames);
+        applyGain(source, target, startGain, rampOffset, accumulate);
+        source += rampOffset;
+        target += rampOffset;
+        frames -= rampOffset;
+    }
+    
+    if ( startGain != endGain && rampFrames > 0 ) {
+        rampFrames = MIN(rampFrames, frames);
+        float step = (endGain - startGain) / (float)rampFrames;
+        if ( accumulate ) {
+            vDSP_vrampmuladd(source, 1, &startGain, &step, target, 1, rampFrames);
+        } else {
+            vDSP_vrampmul(source, 1, &startGain, &step, target, 1, rampFrames);
+        }
+        source += rampFrames;
+        target += rampFrames;
+        frames -= rampFrames;
+    }
+    
+    applyGain(source, target, endGain, frames, accumulate);
+}
+
+static inline void softwareMixerAccumulate(const float *source, float *target, float startGain, float endGain, UInt32 rampOffset, UInt32 rampFrames, UInt32 frames) {
+    // Changes in volume or pan are ramped, to avoid zipper noise
+    applyGainRamp(source, target, startGain, endGain, rampOffset, rampFrames, frames, YES);
+}
+
+static inline float softwareMixerInputGain(AEChannelRef channel, int inputChannelCount, int outputChannel, int outputChannelCount) {
+    // Muted channels are only rendered in the buffer where a timed change mutes or unmutes them
+    return channel->muted ? 0.0 : softwareMixerTargetGain(channel, inputChannelCount, outputChannel, outputChannelCount);
+}
+
+static inline BOOL channelIsAuxBus(AEChannelRef channel) {
+    return channel && channel->type == kChannelTypeGroup && ((AEChannelGroupRef)channel->ptr)->auxBus;
+}
+
+static void auxSendsProcess(AEChannelRef channel, UInt32 frames, AudioBufferList *audio) {
+    // Mix the channel's output into the current cycle's accumulator of each bus it sends to
+    AEAudioController *THIS = channel->audioController;
+    AEFloatConverter *converter = channel->sendFloatConverter;
+    if ( !converter || frames > kMaximumFramesPerSlice ) return;
+    
+    AudioBufferList *floatAudio = audio;
+    int channelCount = channel->audioDescription.mChannelsPerFrame;
+    char floatAudioSpace[sizeof(AudioBufferList)+(channelCount-1)*sizeof(AudioBuffer)];
+    if ( !AEFloatConverterIsPassThrough(converter) ) {
+        render_buffer_pool_t *pool = THIS->_renderBufferPool;
+        floatAudio = (AudioBufferList*)floatAudioSpace;
+        AudioStreamBasicDescription floatFormat = converter.floatingPointAudioDescription;
+        if ( !renderBufferSlotAssignToBufferList(pool, renderBufferLaneSlot(pool, renderBufferPoolCurrentLane(pool)), &floatFormat, frames, floatAudio)
+                || !AEFloatConverterToFloatBufferList(converter, audio, floatAudio, frames) ) {
+            return;
+        }
+    }
+    
+    int32_t epoch = THIS->_renderEpoch;
+    int lane = (int)(intptr_t)pthread_getspecific(__renderBufferLaneKey);
+    int inputChannelCount = floatAudio->mNumberBuffers;
+    
+    for ( int i=0; i<channel->renderSendCount; i++ ) {
+        aux_send_t *send = &channel->renderSends[i];
+        float gain = send->level * channel->volume;
+        if ( gain == 0.0 && send->gain == 0.0 ) continue;
+        
+        aux_bus_t *bus = send->bus->auxBus;
+        if ( lane >= bus->laneCount ) continue;
+        aux_bus_accumulator_t *accumulator = &bus->lanes[lane].accumulators[epoch & 1];
+        AudioBufferList *target = accumulator->buffer;
+        int outputChannelCount = target->mNumberBuffers;
+        
+        if ( accumulator->epoch != epoch ) {
+            // Sent two cycles ago, and never taken by the bus
+            for ( int out=0; out<outputChannelCount; out++ ) {
+                memset(target->mBuffers[out].mData, 0, accumulator->frames * sizeof(float));
+            }
+            accumulator->epoch = epoch;
+            accumulator->frames = 0;
+        }
+        
+        // Mix as the software mixer would, ramping from last buffer's gain
+        for ( int out=0; out<outputChannelCount; out++ ) {
+            if ( outputChannelCount == 1 && inputChannelCount > 1 ) {
+                for ( int in=0; in<inputChannelCount; in++ ) {
+                    softwareMixerAccumulate(floatAudio->mBuffers[in].mData, target->mBuffers[out].mData, send->gain / inputChannelCount, gain / inputChannelCount, 0, frames, frames);
+                }
+            } else if ( out < inputChannelCount || inputChannelCount == 1 ) {
+                int in = inputChannelCount == 1 ? 0 : out;
+                softwareMixerAccumulate(floatAudio->mBuffers[in].mData, target->mBuffers[out].mData, send->gain, gain, 0, frames, frames);
+            }
+        }
+        accumulator->frames = MAX(accumulator->frames, frames);
+        
+        send->gain = gain;
+    }
+}
+
+static void auxBusMixSends(AEChannelGroupRef group, AudioUnitRenderActionFlags *ioActionFlags, UInt32 frames, AudioBufferList *audio) {
+    // Mix in this cycle's sends, and any that arrived too late for the last one. While a group renders
+    // in parallel, which senders have rendered yet depends on how the channels fell across the lanes,
+    // so then take every lane's sends, including our own, one cycle late, for a fixed latency.
+    aux_bus_t *bus = group->auxBus;
+    AEChannelRef channel = group->channel;
+    AEAudioController *THIS = channel->audioController;
+    AEFloatConverter *converter = bus->outputConverter;
+    if ( !converter || frames > kMaximumFramesPerSlice ) return;
+    
+    int32_t epoch = THIS->_renderEpoch;
+    BOOL parallel = THIS->_parallelRenderInProgress;
+    int laneCount = bus->laneCount;
+    
+    aux_bus_accumulator_t *pending[2*kMaximumRenderLanes];
+    int pendingCount = 0;
+    for ( int lane=0; lane<laneCount; lane++ ) {
+        // Last cycle's sends are complete, but this cycle's may still be being written on other lanes
+        aux_bus_accumulator_t *late = &bus->lanes[lane].accumulators[(epoch-1) & 1];
+        aux_bus_accumulator_t *current = &bus->lanes[lane].accumulators[epoch & 1];
+        if ( late->epoch == epoch-1 && late->frames ) pending[pendingCount++] = late;
+        if ( !parallel && current->epoch == epoch && current->frames ) pending[pendingCount++] = current;
+    }
+    
+    if ( pendingCount == 0 ) return;
+    
+    if ( *ioActionFlags & kAudioUnitRenderAction_OutputIsSilence ) {
+        for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+            memset(audio->mBuffers[i].mData, 0, audio->mBuffers[i].mDataByteSize);
+        }
+        *ioActionFlags &= ~kAudioUnitRenderAction_OutputIsSilence;
+    }
+    
+    // Mix straight into the output if it's float, otherwise via pooled scratch space
+    BOOL passThrough = AEFloatConverterIsPassThrough(converter);
+    AudioBufferList *target = audio;
+    int channelCount = channel->audioDescription.mChannelsPerFrame;
+    char targetSpace[sizeof(AudioBufferList)+(channelCount-1)*sizeof(AudioBuffer)];
+    if ( !passThrough ) {
+        render_buffer_pool_t *pool = THIS->_renderBufferPool;
+        target = (AudioBufferList*)targetSpace;
+        AudioStreamBasicDescription floatFormat = converter.floatingPointAudioDescription;
+        if ( !renderBufferSlotAssignToBufferList(pool, renderBufferLaneSlot(pool, renderBufferPoolCurrentLane(pool)), &floatFormat, frames, target)
+                || !AEFloatConverterToFloatBufferList(converter, audio, target, frames) ) {
+            target = NULL;
+        }
+    }
+    
+    for ( int k=0; k<pendingCount; k++ ) {
+        aux_bus_accumulator_t *accumulator = pending[k];
+        
+        if ( target ) {
+            UInt32 mixFrames = MIN(frames, accumulator->frames);
+            for ( int i=0; i<MIN(target->mNumberBuffers, accumulator->buffer->mNumberBuffers); i++ ) {
+                vDSP_vadd(accumulator->buffer->mBuffers[i].mData, 1, target->mBuffers[i].mData, 1, target->mBuffers[i].mData, 1, mixFrames);
+            }
+        }
+        
+        for ( int i=0; i<accumulator->buffer->mNumberBuffers; i++ ) {
+            memset(accumulator->buffer->mBuffers[i].mData, 0, accumulator->frames * sizeof(float));
+        }
+        accumulator->frames = 0;
+    }
+    
+    if ( target && !passThrough ) {
+        AEFloatConverterFromFloatBufferList(converter, target, audio, frames);
+    }
+}
+
+static void mixerUnitScheduleRamps(AEChannelGroupRef group, UInt32 frames) {
+    // Hand the mixer unit this buffer's stretch of any ramps in progress, for it to interpolate
+    for ( int i=0; i<group->renderChannelCount; i++ ) {
+        AEChannelRef channel = group->renderChannels[i];
+        if ( !channel ) continue;
+        
+        float startVolume = channel->volume;
+        float startPan = channel->pan;
+        BOOL volumeRamping = channel->volumeRamp.remainingFrames > 0;
+        BOOL panRamping = channel->panRamp.remainingFrames > 0;
+        channelAdvanceRamps(channel, frames);
+        if ( !volumeRamping && !panRamping ) continue;
+        
+        AudioUnitParameterEvent events[2];
+        int eventCount = 0;
+        if ( volumeRamping ) {
+            events[eventCount++] = (AudioUnitParameterEvent) {
+                .scope          = kAudioUnitScope_Input,
+                .element        = i,
+                .parameter      = kMultiChannelMixerParam_Volume,
+                .eventType      = kParameterEvent_Ramped,
+                .eventValues.ramp = { .startBufferOffset = 0, .durationInFrames = channel->rampFrames, .startValue = startVolume, .endValue = channel->volume }
+            };
+        }
+        if ( panRamping ) {
+            // Workaround for pan limits bug
+            events[eventCount++] = (AudioUnitParameterEvent) {
+                .scope          = kAudioUnitScope_Input,
+                .element        = i,
+                .parameter      = kMultiChannelMixerParam_Pan,
+                .eventType      = kParameterEvent_Ramped,
+                .eventValues.ramp = { .startBufferOffset = 0, .durationInFrames = channel->rampFrames,
+                                      .startValue = MAX(-0.999, MIN(0.999, startPan)), .endValue = MAX(-0.999, MIN(0.999, channel->pan)) }
+            };
+        }
+        AudioUnitScheduleParameters(group->mixerAudioUnit, events, eventCount);
+    }
+}
+
+static void softwareMixerRenderInput(AEChannelGroupRef group, int index, const AudioTimeStamp *inTimeStamp, UInt32 frames, BOOL auxBusPass) {
+    AEChannelRef channel = group->renderChannels[index];
+    software_mixer_input_t *input = channel ? channel->mixerInput : NULL;
+    
+    if ( channelIsAuxBus(channel) != auxBusPass ) {
+        // Aux buses are rendered in a second pass, after the channels that may send to them
+        return;
+    }
+    
+    if ( channel && channel->type == kChannelTypeGroup && ((AEChannelGroupRef)channel->ptr)->flattened ) {
+        // Already mixed straight into its input buffer by the render schedule
+        return;
+    }
+    
+    group->renderedInputs[index] = NULL;
+    
+    if ( !input || !channel->playing ) return;
+    
+    if ( channel->muted && !channel->rampOffset ) {
+        // Unmuting fades in from silence
+        input->gains[0] = input->gains[1] = 0.0;
+        return;
+    }
+    
+    // Render the channel, as the mixer unit would pull its input bus
+    AudioUnitRenderActionFlags flags = 0;
+    OSStatus result;
+    
+    if ( input->renderInPlace ) {
+        for ( int i=0; i<input->floatBuffer->mNumberBuffers; i++ ) {
+            input->floatBuffer->mBuffers[i].mDataByteSize = frames * sizeof(float);
+        }
+        result = renderCallback(channel, &flags, inTimeStamp, index, frames, input->floatBuffer);
+        if ( !checkResult(result, "Channel render") || (flags & kAudioUnitRenderAction_OutputIsSilence) ) return;
+        
+    } else {
+        // Render into a pooled buffer that's only needed until the audio is converted to float
+        render_buffer_pool_t *pool = channel->audioController->_renderBufferPool;
+        render_buffer_lane_t *lane = renderBufferPoolCurrentLane(pool);
+        int bufferCount = channel->audioDescription.mFormatFlags & kAudioFormatFlagIsNonInterleaved ? channel->audioDescription.mChannelsPerFrame : 1;
+        char bufferListSpace[sizeof(AudioBufferList)+(bufferCount-1)*sizeof(AudioBuffer)];
+        AudioBufferList *renderBuffer = (AudioBufferList*)bufferListSpace;
+        if ( !renderBufferSlotAssignToBufferList(pool, renderBufferLaneSlot(pool, lane), &channel->audioDescription, frames, renderBuffer) ) return;
+        
+        lane->depth++;
+        result = renderCallback(channel, &flags, inTimeStamp, index, frames, renderBuffer);
+        BOOL converted = result == noErr && !(flags & kAudioUnitRenderAction_OutputIsSilence)
+                            && AEFloatConverterToFloatBufferList(input->floatConverter, renderBuffer, input->floatBuffer, frames);
+        lane->depth--;
+        
+        if ( !checkResult(result, "Channel render") || !converted ) return;
+    }
+    
+    group->renderedInputs[index] = input;
+}
+
+static BOOL renderJobPerformNext(render_job_t *job) {
+    int64_t cursor = job->cursor;
+    OSMemoryBarrier();
+    
+    int next = (int)(cursor & 0xFFFF);
+    int count = (int)((cursor >> 16) & 0xFFFF);
+    if ( next >= count ) return NO;
+    
+    AEChannelGroupRef group = job->group;
+    AudioTimeStamp timeStamp = job->timeStamp;
+    UInt32 frames = job->frames;
+    
+    if ( !OSAtomicCompareAndSwap64Barrier(cursor, cursor+1, &job->cursor) ) {
+        // Another thread claimed this index first
+        return YES;
+    }
+    
+    softwareMixerRenderInput(group, next, &timeStamp, frames, NO);
+    if ( OSAtomicDecrement32Barrier(&job->remaining) == 0 && job->waiting ) {
+        semaphore_signal(job->completionSemaphore);
+    }
+    return YES;
+}
+
+static void renderWorkerApplyTimeConstraints(uint32_t period) {
+    // Run with the same time constraints as the Core Audio thread
+    thread_time_constraint_policy_data_t policy = {
+        .period      = period,
+        .computation = period / 2,
+        .constraint  = period,
+        .preemptible = true
+    };
+    checkResult(thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY, (thread_policy_t)&policy, THREAD_TIME_CONSTRAINT_POLICY_COUNT),
+                "thread_policy_set");
+}
+
+static void *renderWorkerThreadEntry(void *userInfo) {
+    render_worker_pool_t *pool = (render_worker_pool_t*)userInfo;
+    
+    pthread_setspecific(__renderBufferLaneKey, (void*)(intptr_t)OSAtomicIncrement32(&pool->nextLane));
+    
+    uint32_t period = pool->period;
+    renderWorkerApplyTimeConstraints(period);
+    
+    while ( 1 ) {
+        semaphore_wait(pool->semaphore);
+        if ( pool->stop ) break;
+        if ( pool->period != period ) {
+            // The buffer duration changed since we last set our time constraints
+            period = pool->period;
+            renderWorkerApplyTimeConstraints(period);
+        }
+        while ( renderJobPerformNext(&pool->job) );
+    }
+    
+    return NULL;
+}
+
+static void renderWorkerPoolSetBufferDuration(render_worker_pool_t *pool, NSTimeInterval bufferDuration) {
+    // Workers pick up the new period next time they wake
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    pool->period = (uint32_t)((bufferDuration * 1.0e9) * timebase.denom / timebase.numer);
+}
+
+static render_worker_pool_t *renderWorkerPoolCreate(int threadCount, NSTimeInterval bufferDuration) {
+    render_worker_pool_t *pool = (render_worker_pool_t*)calloc(1, sizeof(render_worker_pool_t));
+    
+    if ( !checkResult(semaphore_create(mach_task_self(), &pool->semaphore, SYNC_POLICY_FIFO, 0), "semaphore_create") ) {
+        free(pool);
+        return NULL;
+    }
+    if ( !checkResult(semaphore_create(mach_task_self(), &pool->completionSemaphore, SYNC_POLICY_FIFO, 0), "semaphore_create") ) {
+        semaphore_destroy(mach_task_self(), pool->semaphore);
+        free(pool);
+        return NULL;
+    }
+    pool->job.completionSemaphore = pool->completionSemaphore;
+    
+    renderWorkerPoolSetBufferDuration(pool, bufferDuration);
+    
+    pool->threads = (pthread_t*)calloc(threadCount, sizeof(pthread_t));
+    for ( int i=0; i<threadCount; i++ ) {
+        if ( pthread_create(&pool->threads[i], NULL, renderWorkerThreadEntry, pool) != 0 ) {
+            NSLog(@"TAAE: Couldn't create render worker thread");
+            break;
+        }
+        pool->threadCount++;
+    }
+    
+    return pool;
+}
+
+static void renderWorkerPoolDestroy(render_worker_pool_t *pool) {
+    pool->stop = YES;
+    OSMemoryBarrier();
+    for ( int i=0; i<pool->threadCount; i++ ) {
+        semaphore_signal(pool->semaphore);
+    }
+    for ( int i=0; i<pool->threadCount; i++ ) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    semaphore_destroy(mach_task_self(), pool->semaphore);
+    semaphore_destroy(mach_task_self(), pool->completionSemaphore);
+    free(pool->threads);
+    free(pool);
+}
 
-static void interruptionListener(void *inClientData, UInt32 inInterruption) {
-    if ( !__interruptionListenerSelf ) return;
+static BOOL renderWorkerPoolRenderGroup(render_worker_pool_t *pool, AEChannelGroupRef group, const AudioTimeStamp *inTimeStamp, UInt32 frames) {
+    // Only one group renders in parallel at a time; nested groups, and groups rendered on workers, render serially
+    if ( !pool || pool->threadCount == 0 || group->renderChannelCount < 2 || group->renderChannelCount > 0xFFFF || !OSAtomicCompareAndSwap32Barrier(0, 1, &pool->busy) ) return NO;
     
-    AEAudioController *THIS = __interruptionListenerSelf;
+    render_job_t *job = &pool->job;
+    job->group     = group;
+    job->timeStamp = *inTimeStamp;
+    job->frames    = frames;
+    job->remaining = group->renderChannelCount;
+    job->waiting   = 0;
+    group->channel->audioController->_parallelRenderInProgress = YES;
     
-    if (inInterruption == kAudioSessionEndInterruption) {
-        NSLog(@"TAAE: Audio session interruption ended");
-        THIS->_interrupted = NO;
-        
-        if ( [[UIApplication sharedApplication] applicationState] != UIApplicationStateBackground || THIS->_runningPriorToInterruption ) {
-            // make sure we are again the active session
-            checkResult(AudioSessionSetActive(true), "AudioSessionSetActive");
+    // Publish the job under a new sequence number
+    int64_t cursor = job->cursor;
+    int64_t sequence = (cursor >> 32) + 1;
+    OSAtomicCompareAndSwap64Barrier(cursor, (sequence << 32) | ((int64_t)group->renderChannelCount << 16), &job->cursor);
+    
+    for ( int i=0; i<MIN(pool->threadCount, group->renderChannelCount-1); i++ ) {
+        semaphore_signal(pool->semaphore);
+    }
+    
+    // Render alongside the workers, until every channel has been claimed
+    while ( renderJobPerformNext(job) );
+    
+    // Then wait for any still in progress on workers: briefly spin, as they're usually nearly done, then block.
+    // The wait is unbounded: a channel can't be abandoned part-way, as its callbacks would still be running
+    // on the worker when the group next renders it. A slow channel overruns the buffer, as it would serially.
+    for ( int spin=0; spin<kRenderJobCompletionSpinCount && job->remaining > 0; spin++ );
+    if ( job->remaining > 0 ) {
+        OSAtomicCompareAndSwap32Barrier(0, 1, &job->waiting);
+        mach_timespec_t timeout = { 0, kRenderJobCompletionWaitNanoseconds };
+        while ( job->remaining > 0 ) {
+            // The timeout only guards against missing the signal from a worker that finished just before we started waiting
+            semaphore_timedwait(job->completionSemaphore, timeout);
         }
-        
-        if ( THIS->_runningPriorToInterruption && ![THIS running] ) {
-            [THIS start:NULL];
+    }
+    
+    OSMemoryBarrier();
+    group->channel->audioController->_parallelRenderInProgress = NO;
+    pool->busy = 0;
+    return YES;
+}
+
+static void softwareMixerRenderInputs(AEChannelGroupRef group, const AudioTimeStamp *inTimeStamp, UInt32 frames) {
+    AEAudioController *THIS = group->channel->audioController;
+    
+    for ( int i=0; i<group->renderChannelCount; i++ ) {
+        if ( group->renderChannels[i] ) channelAdvanceRamps(group->renderChannels[i], frames);
+    }
+    
+    // Render the channels, in parallel if we can
+    if ( !renderWorkerPoolRenderGroup(THIS->_renderWorkerPool, group, inTimeStamp, frames) ) {
+        for ( int i=0; i<group->renderChannelCount; i++ ) {
+            softwareMixerRenderInput(group, i, inTimeStamp, frames, NO);
         }
-        
-        [[NSNotificationCenter defaultCenter] postNotificationName:AEAudioControllerSessionInterruptionEndedNotification object:THIS];
-    } else if (inInterruption == kAudioSessionBeginInterruption) {
-        NSLog(@"TAAE: Audio session interrupted");
-        THIS->_runningPriorToInterruption = THIS->_running;
-        
-        THIS->_interrupted = YES;
-        
-        if ( THIS->_runningPriorToInterruption ) {
-            [THIS stop];
+    }
+    
+    for ( int i=0; i<group->renderChannelCount; i++ ) {
+        if ( channelIsAuxBus(group->renderChannels[i]) ) {
+            softwareMixerRenderInput(group, i, inTimeStamp, frames, YES);
         }
-        
-        [[NSNotificationCenter defaultCenter] postNotificationName:AEAudioControllerSessionInterruptionBeganNotification object:THIS];
-        
-        processPendingMessagesOnRealtimeThread(THIS);
     }
 }
 
-static void audioSessionPropertyListener(void *inClientData, AudioSessionPropertyID inID, UInt32 inDataSize, const void *inData) {
-    AEAudioController *THIS = (AEAudioController *)inClientData;
+static inline BOOL softwareMixerHasAudio(AEChannelGroupRef group) {
+    for ( int i=0; i<group->renderChannelCount; i++ ) {
+        if ( group->renderedInputs[i] ) return YES;
+    }
+    return NO;
+}
+
+static void softwareMixerAccumulateInputs(AEChannelGroupRef group, AudioBufferList *accumulator, UInt32 frames) {
+    int outputChannelCount = accumulator->mNumberBuffers;
     
-    __cachedInputLatency = kNoValue;
-    __cachedOutputLatency = kNoValue;
+    // Mix, in channel order
+    for ( int i=0; i<outputChannelCount; i++ ) {
+        accumulator->mBuffers[i].mDataByteSize = frames * sizeof(float);
+        memset(accumulator->mBuffers[i].mData, 0, frames * sizeof(float));
+    }
     
-    if (inID == kAudioSessionProperty_AudioRouteChange) {
-        int reason = [[(NSDictionary*)inData objectForKey:[NSString stringWithCString:kAudioSession_AudioRouteChangeKey_Reason encoding:NSUTF8StringEncoding]] intValue];
+    for ( int i=0; i<group->renderChannelCount; i++ ) {
+        AEChannelRef channel = group->renderChannels[i];
+        software_mixer_input_t *input = group->renderedInputs[i];
+        if ( !channel || !input ) continue;
         
-        CFStringRef route = NULL;
-        UInt32 size = sizeof(route);
-        if ( !checkResult(AudioSessionGetProperty(kAudioSessionProperty_AudioRoute, &size, &route), "AudioSessionGetProperty(kAudioSessionProperty_AudioRoute)") ) return;
-        
-        THIS.audioRoute = [NSString stringWithString:(NSString*)route];
+        int inputChannelCount = input->floatBuffer->mNumberBuffers;
+        for ( int out=0; out<outputChannelCount; out++ ) {
+            float startGain = input->gains[MIN(out, 1)];
+            float endGain = softwareMixerInputGain(channel, inputChannelCount, out, outputChannelCount);
+            
+            if ( outputChannelCount == 1 && inputChannelCount > 1 ) {
+                // Mix down to mono
+                startGain /= inputChannelCount;
+                endGain /= inputChannelCount;
+                for ( int in=0; in<inputChannelCount; in++ ) {
+                    softwareMixerAccumulate(input->floatBuffer->mBuffers[in].mData, accumulator->mBuffers[out].mData, startGain, endGain, channel->rampOffset, channel->rampFrames, frames);
+                }
+            } else if ( out < inputChannelCount || inputChannelCount == 1 ) {
+                // Mono inputs are spread across all output channels
+                int in = inputChannelCount == 1 ? 0 : out;
+                softwareMixerAccumulate(input->floatBuffer->mBuffers[in].mData, accumulator->mBuffers[out].mData, startGain, endGain, channel->rampOffset, channel->rampFrames, frames);
+            }
+        }
         
-        NSLog(@"TAAE: Changed audio route to %@", THIS.audioRoute);
+        for ( int out=0; out<MIN(outputChannelCount, 2); out++ ) {
+            input->gains[out] = softwareMixerInputGain(channel, inputChannelCount, out, outputChannelCount);
+        }
+    }
+}
+
+static void softwareMixerRunSchedule(AEChannelGroupRef root, const AudioTimeStamp *inTimeStamp, UInt32 frames) {
+    // Mix nested groups in one pass, deepest first, each straight into its input buffer in its parent
+    AEAudioController *THIS = root->channel->audioController;
+    uint64_t stepStartTimes[root->scheduleLength];
+    
+    for ( int i=0; i<root->scheduleLength; i++ ) {
+        render_schedule_step_t *step = &root->schedule[i];
+        AEChannelGroupRef group = step->group;
+        AEChannelRef channel = group->channel;
+        stepStartTimes[i] = renderProfileStart(THIS);
         
-        BOOL playingThroughSpeaker;
-        if ( [(NSString*)route isEqualToString:@"SpeakerAndMicrophone"] || [(NSString*)route isEqualToString:@"Speaker"] ) {
-            playingThroughSpeaker = YES;
-        } else {
-            playingThroughSpeaker = NO;
+        if ( step->index >= step->parent->renderChannelCount || step->parent->renderChannels[step->index] != channel || !group->softwareMixing ) {
+            // Changed since the schedule was compiled; a new one is on its way
+            continue;
         }
         
-        CFRelease(route);
+        step->parent->renderedInputs[step->index] = NULL;
         
-        BOOL updatedVP = NO;
-        if ( THIS->_playingThroughDeviceSpeaker != playingThroughSpeaker ) {
-            [THIS willChangeValueForKey:@"playingThroughDeviceSpeaker"];
-            THIS->_playingThroughDeviceSpeaker = playingThroughSpeaker;
-            [THIS didChangeValueForKey:@"playingThroughDeviceSpeaker"];
-            
-            if ( THIS->_voiceProcessingEnabled && THIS->_voiceProcessingOnlyForSpeakerAndMicrophone ) {
-                if ( [THIS mustUpdateVoiceProcessingSettings] ) {
-                    [THIS replaceIONode];
-                    updatedVP = YES;
-                }
-            }
+        // Skip groups that are stopped or muted, or inside one that is
+        BOOL active = YES;
+        for ( render_schedule_step_t *ancestor = step; ancestor && active; ancestor = ancestor->parentStep >= 0 ? &root->schedule[ancestor->parentStep] : NULL ) {
+            active = ancestor->group->channel->playing && !ancestor->group->channel->muted;
         }
+        software_mixer_input_t *input = channel->mixerInput;
+        if ( !active || !input ) continue;
         
-        if ( !updatedVP && (reason == kAudioSessionRouteChangeReason_NewDeviceAvailable || reason == kAudioSessionRouteChangeReason_OldDeviceUnavailable) && THIS->_inputEnabled ) {
-            [THIS updateInputDeviceStatus];
+        softwareMixerRenderInputs(group, inTimeStamp, frames);
+        
+        if ( softwareMixerHasAudio(group) ) {
+            softwareMixerAccumulateInputs(group, input->floatBuffer, frames);
+            step->parent->renderedInputs[step->index] = input;
         }
         
-    } else if ( inID == kAudioSessionProperty_AudioInputAvailable && THIS->_inputEnabled ) {
-        [THIS updateInputDeviceStatus];
+        renderProfileRecord(THIS, &channel->renderProfile, stepStartTimes[step->firstStep], 0, frames);
     }
 }
 
-#pragma mark -
-#pragma mark Input and render callbacks
-
-struct fillComplexBufferInputProc_t { AudioBufferList *bufferList; UInt32 frames;  };
-static OSStatus fillComplexBufferInputProc(AudioConverterRef             inAudioConverter,
-                                           UInt32                        *ioNumberDataPackets,
-                                           AudioBufferList               *ioData,
-                                           AudioStreamPacketDescription  **outDataPacketDescription,
-                                           void                          *inUserData) {
-    struct fillComplexBufferInputProc_t *arg = inUserData;
-    for ( int i=0; i<ioData->mNumberBuffers; i++ ) {
-        ioData->mBuffers[i].mData = arg->bufferList->mBuffers[i].mData;
-        ioData->mBuffers[i].mDataByteSize = arg->bufferList->mBuffers[i].mDataByteSize;
+static OSStatus softwareMixerRender(AEChannelGroupRef group, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 frames, AudioBufferList *audio) {
+    AEAudioController *THIS = group->channel->audioController;
+    int outputChannelCount = group->channel->audioDescription.mChannelsPerFrame;
+    
+    if ( frames > kMaximumFramesPerSlice ) {
+        return kAudioUnitErr_TooManyFramesToProcess;
     }
-    *ioNumberDataPackets = arg->frames;
+    
+    if ( group->scheduleLength > 0 ) {
+        softwareMixerRunSchedule(group, inTimeStamp, frames);
+    }
+    
+    softwareMixerRenderInputs(group, inTimeStamp, frames);
+    
+    if ( !softwareMixerHasAudio(group) ) {
+        // All channels are silent or stopped
+        for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+            audio->mBuffers[i].mDataByteSize = frames * group->channel->audioDescription.mBytesPerFrame;
+            memset(audio->mBuffers[i].mData, 0, audio->mBuffers[i].mDataByteSize);
+        }
+        *ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+        return noErr;
+    }
+    
+    // Mix straight into the output if it's float, otherwise into pooled scratch space
+    AudioBufferList *accumulator = audio;
+    char accumulatorSpace[sizeof(AudioBufferList)+(outputChannelCount-1)*sizeof(AudioBuffer)];
+    if ( !group->mixInPlace ) {
+        render_buffer_pool_t *pool = THIS->_renderBufferPool;
+        accumulator = (AudioBufferList*)accumulatorSpace;
+        AudioStreamBasicDescription floatFormat = group->mixerOutputConverter.floatingPointAudioDescription;
+        if ( !renderBufferSlotAssignToBufferList(pool, renderBufferLaneSlot(pool, renderBufferPoolCurrentLane(pool)), &floatFormat, frames, accumulator) ) {
+            return kAudioUnitErr_TooManyFramesToProcess;
+        }
+    }
+    
+    softwareMixerAccumulateInputs(group, accumulator, frames);
+    
+    if ( group->mixInPlace ) return noErr;
+    
+    for ( int i=0; i<audio->mNumberBuffers; i++ ) {
+        audio->mBuffers[i].mDataByteSize = frames * group->channel->audioDescription.mBytesPerFrame;
+    }
+    
+    if ( !AEFloatConverterFromFloatBufferList(group->mixerOutputConverter, accumulator, audio, frames) ) {
+        return kAudioUnitErr_FormatNotSupported;
+    }
+    
     return noErr;
 }
 
-typedef struct __channel_producer_arg_t {
-    AEChannelRef channel;
-    AudioTimeStamp inTimeStamp;
-    AudioUnitRenderActionFlags *ioActionFlags;
-    int nextFilterIndex;
-} channel_producer_arg_t;
+static OSStatus renderedAudioProducer(void *userInfo, AudioBufferList *audio, UInt32 *frames) {
+    // Provides a filter with input that has already been rendered into the output buffer
+    AudioBufferList *rendered = (AudioBufferList*)userInfo;
+    for ( int i=0; i<audio->mNumberBuffers && i<rendered->mNumberBuffers; i++ ) {
+        if ( audio->mBuffers[i].mData != rendered->mBuffers[i].mData ) {
+            memcpy(audio->mBuffers[i].mData, rendered->mBuffers[i].mData, MIN(audio->mBuffers[i].mDataByteSize, rendered->mBuffers[i].mDataByteSize));
+        }
+    }
+    return noErr;
+}
 
 static OSStatus channelAudioProducer(void *userInfo, AudioBufferList *audio, UInt32 *frames) {
     channel_producer_arg_t *arg = (channel_producer_arg_t*)userInfo;
@@ -417,18 +1847,52 @@ static OSStatus channelAudioProducer(void *userInfo, AudioBufferList *audio, UIn
     
     OSStatus status = noErr;
     
-    // See if there's another filter
-    for ( int i=channel->callbacks.count-1, filterIndex=0; i>=0; i-- ) {
-        callback_t *callback = &channel->callbacks.callbacks[i];
-        if ( callback->flags & kFilterFlag ) {
-            if ( filterIndex == arg->nextFilterIndex ) {
-                // Run this filter
-                channel_producer_arg_t filterArg = *arg;
-                filterArg.nextFilterIndex = filterIndex+1;
-                return ((AEAudioControllerFilterCallback)callback->callback)(callback->userInfo, channel->audioController, &channelAudioProducer, (void*)&filterArg, &arg->inTimeStamp, *frames, audio);
+    if ( arg->nextFilterIndex < channel->callbacks.filterCount ) {
+        // Run the next filter
+        callback_t *callback = &channel->callbacks.filters[arg->nextFilterIndex];
+        AEAudioControllerFilterCallback filter = (AEAudioControllerFilterCallback)callback->callback;
+        AudioUnitRenderActionFlags inputFlags = 0;
+        channel_producer_arg_t filterArg = *arg;
+        filterArg.nextFilterIndex++;
+        filterArg.ioActionFlags = &inputFlags;
+        
+        if ( callback->silentFrames >= callback->tailFrames ) {
+            // The filter's tail has decayed: produce its input first, and skip the filter while that's silent
+            status = channelAudioProducer((void*)&filterArg, audio, frames);
+            if ( status != noErr ) return status;
+            
+            if ( inputFlags & kAudioUnitRenderAction_OutputIsSilence ) {
+                *arg->ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+                return noErr;
+            }
+            
+            callback->silentFrames = 0;
+            uint64_t start = renderProfileStart(channel->audioController);
+            status = filter(callback->userInfo, channel->audioController, &renderedAudioProducer, (void*)audio, &arg->inTimeStamp, *frames, audio);
+            renderProfileRecord(channel->audioController, callback->profile, start, 0, *frames);
+        } else {
+            profiled_producer_arg_t producerArg = { .producer = &channelAudioProducer, .producerToken = (void*)&filterArg, .ticks = 0 };
+            uint64_t start = renderProfileStart(channel->audioController);
+            if ( start ) {
+                status = filter(callback->userInfo, channel->audioController, &profiledAudioProducer, (void*)&producerArg, &arg->inTimeStamp, *frames, audio);
+            } else {
+                status = filter(callback->userInfo, channel->audioController, &channelAudioProducer, (void*)&filterArg, &arg->inTimeStamp, *frames, audio);
+            }
+            renderProfileRecord(channel->audioController, callback->profile, start, producerArg.ticks, *frames);
+            
+            if ( !(inputFlags & kAudioUnitRenderAction_OutputIsSilence) ) {
+                callback->silentFrames = 0;
+            } else if ( callback->tailFrames != kUnknownTailFrames ) {
+                callback->silentFrames += *frames;
             }
-            filterIndex++;
         }
+        
+        if ( status == AEAudioControllerOutputIsSilence ) {
+            *arg->ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+            status = noErr;
+        }
+        
+        return status;
     }
     
     if ( channel->type == kChannelTypeChannel ) {
@@ -439,18 +1903,44 @@ static OSStatus channelAudioProducer(void *userInfo, AudioBufferList *audio, UIn
             memset(audio->mBuffers[i].mData, 0, audio->mBuffers[i].mDataByteSize);
         }
         
+        uint64_t start = renderProfileStart(channel->audioController);
         status = callback(channelObj, channel->audioController, &channel->timeStamp, *frames, audio);
+        renderProfileRecord(channel->audioController, &channel->renderProfile, start, 0, *frames);
         channel->timeStamp.mSampleTime += *frames;
         
+        if ( status == AEAudioControllerOutputIsSilence ) {
+            *arg->ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+            status = noErr;
+        }
+        
     } else if ( channel->type == kChannelTypeGroup ) {
         AEChannelGroupRef group = (AEChannelGroupRef)channel->ptr;
+        uint64_t start = renderProfileStart(channel->audioController);
+        
+        if ( group->softwareMixing ) {
+            // Mix the group's channels ourselves
+            status = softwareMixerRender(group, arg->ioActionFlags, &arg->inTimeStamp, *frames, audio);
+            if ( !checkResult(status, "softwareMixerRender") ) return status;
+        } else {
+            // Tell mixer/mixer's converter unit to render into audio
+            mixerUnitScheduleRamps(group, *frames);
+            status = AudioUnitRender(group->converterUnit ? group->converterUnit : group->mixerAudioUnit, arg->ioActionFlags, &arg->inTimeStamp, 0, *frames, audio);
+            if ( !checkResult(status, "AudioUnitRender") ) return status;
+        }
         
-        // Tell mixer/mixer's converter unit to render into audio
-        status = AudioUnitRender(group->converterUnit ? group->converterUnit : group->mixerAudioUnit, arg->ioActionFlags, &arg->inTimeStamp, 0, *frames, audio);
-        if ( !checkResult(status, "AudioUnitRender") ) return status;
+        if ( group->auxBus ) {
+            // Add the audio sent to the bus, ahead of the bus's filters
+            auxBusMixSends(group, arg->ioActionFlags, *frames, audio);
+        }
+        
+        renderProfileRecord(channel->audioController, &channel->renderProfile, start, 0, *frames);
         
         if ( group->level_monitor_data.monitoringEnabled ) {
-            performLevelMonitoring(&group->level_monitor_data, audio, *frames);
+            if ( *arg->ioActionFlags & kAudioUnitRenderAction_OutputIsSilence ) {
+                performLevelMonitoringOfSilence(&group->level_monitor_data);
+            } else {
+                performLevelMonitoring(channel->audioController->_renderBufferPool, &group->level_monitor_data, audio, *frames);
+            }
         }
         
         // Advance the sample time, to make sure we continue to render if we're called again with the same arguments
@@ -460,6 +1950,11 @@ static OSStatus channelAudioProducer(void *userInfo, AudioBufferList *audio, UIn
     return status;
 }
 
+static inline uint64_t downstreamLatencyTicks(AEChannelRef channel) {
+    if ( !channel->downstreamLatencyFrames ) return 0;
+    return (uint64_t)((channel->downstreamLatencyFrames / channel->audioController->_audioDescription.mSampleRate) * __secondsToHostTicks);
+}
+
 static OSStatus renderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioActionFlags, const AudioTimeStamp *inTimeStamp, UInt32 inBusNumber, UInt32 inNumberFrames, AudioBufferList *ioData) {
     AEChannelRef channel = (AEChannelRef)inRefCon;
     
@@ -493,20 +1988,48 @@ static OSStatus renderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioAct
     
     OSStatus result = channelAudioProducer((void*)&arg, ioData, &inNumberFrames);
     
-    handleCallbacksForChannel(channel, &timestamp, inNumberFrames, ioData);
+    if ( channel->renderDelayLine && result == noErr ) {
+        // Line up with slower paths through the parent group
+        delayLineProcess(channel->renderDelayLine, ioActionFlags, inNumberFrames, ioData);
+    }
+    
+    // Receivers hear the audio before any latency still to come on its way to the output
+    AudioTimeStamp receiverTimestamp = timestamp;
+    receiverTimestamp.mHostTime += downstreamLatencyTicks(channel);
+    
+    handleCallbacksForChannel(channel, &receiverTimestamp, inNumberFrames, ioData);
+    
+    if ( channel->renderSendCount && result == noErr && !(*ioActionFlags & kAudioUnitRenderAction_OutputIsSilence) ) {
+        auxSendsProcess(channel, inNumberFrames, ioData);
+    }
     
     if ( channel->audiobusSenderPort && ABSenderPortIsConnected(channel->audiobusSenderPort) && channel->audiobusFloatConverter ) {
-        // Convert the audio to float, and apply volume/pan if necessary
-        if ( AEFloatConverterToFloatBufferList(channel->audiobusFloatConverter, ioData, channel->audiobusScratchBuffer, inNumberFrames) ) {
-            if ( fabs(1.0 - channel->volume) > 0.01 || fabs(0.0 - channel->pan) > 0.01 ) {
-                float volume = channel->volume;
-                for ( int i=0; i<channel->audiobusScratchBuffer->mNumberBuffers; i++ ) {
-                    float gain = (channel->audiobusScratchBuffer->mNumberBuffers == 2 ?
-                                  i == 0 ? (channel->pan <= 0.0 ? 1.0 : (1.0-((channel->pan/2)+0.5))*2.0) :
-                                  i == 1 ? (channel->pan >= 0.0 ? 1.0 : ((channel->pan/2)+0.5)*2.0) :
-                                  1 : 1) * volume;
-                    vDSP_vsmul(channel->audiobusScratchBuffer->mBuffers[i].mData, 1, &gain, channel->audiobusScratchBuffer->mBuffers[i].mData, 1, inNumberFrames);
+        if ( *ioActionFlags & kAudioUnitRenderAction_OutputIsSilence ) {
+            // Nothing to convert
+            for ( int i=0; i<channel->audiobusScratchBuffer->mNumberBuffers; i++ ) {
+                channel->audiobusScratchBuffer->mBuffers[i].mDataByteSize = inNumberFrames * sizeof(float);
+                memset(channel->audiobusScratchBuffer->mBuffers[i].mData, 0, inNumberFrames * sizeof(float));
+            }
+        } else if ( AEFloatConverterIsPassThrough(channel->audiobusFloatConverter)
+                        || AEFloatConverterToFloatBufferList(channel->audiobusFloatConverter, ioData, channel->audiobusScratchBuffer, inNumberFrames) ) {
+            // Apply volume/pan, ramping from the gains used for the last buffer; float audio is copied across as it's scaled
+            BOOL passThrough = AEFloatConverterIsPassThrough(channel->audiobusFloatConverter);
+            int bufferCount = channel->audiobusScratchBuffer->mNumberBuffers;
+            UInt32 rampFrames = channel->rampOffset || (channel->rampFrames && channel->rampFrames < inNumberFrames) ? channel->rampFrames : inNumberFrames;
+            for ( int i=0; i<bufferCount; i++ ) {
+                float startGain = channel->audiobusGains[MIN(i, 1)];
+                float endGain = softwareMixerTargetGain(channel, bufferCount, i, bufferCount);
+                float *source = (float*)(passThrough ? ioData->mBuffers[i].mData : channel->audiobusScratchBuffer->mBuffers[i].mData);
+                float *target = (float*)channel->audiobusScratchBuffer->mBuffers[i].mData;
+                channel->audiobusScratchBuffer->mBuffers[i].mDataByteSize = inNumberFrames * sizeof(float);
+                if ( startGain == 1.0 && endGain == 1.0 ) {
+                    if ( source != target ) memcpy(target, source, inNumberFrames * sizeof(float));
+                    continue;
                 }
+                applyGainRamp(source, target, startGain, endGain, channel->rampOffset, rampFrames, inNumberFrames, NO);
+            }
+            for ( int i=0; i<MIN(bufferCount, 2); i++ ) {
+                channel->audiobusGains[i] = softwareMixerTargetGain(channel, bufferCount, i, bufferCount);
             }
         }
         
@@ -521,6 +2044,85 @@ static OSStatus renderCallback(void *inRefCon, AudioUnitRenderActionFlags *ioAct
     return result;
 }
 
+static void renderEventPost(AEAudioController *THIS, AERenderEventType type, AEAudioTimingContext context, render_timing_monitor_t *monitor, const AudioTimeStamp *timestamp, double duration) {
+    // Claim the next entry in the event log, overwriting the oldest if the main thread hasn't kept up
+    int32_t index = OSAtomicIncrement32(&THIS->_renderEventWriteIndex) - 1;
+    render_event_entry_t *entry = &THIS->_renderEventLog[index & (kRenderEventLogLength-1)];
+    entry->sequence = 0;
+    OSMemoryBarrier();
+    entry->event.type = type;
+    entry->event.context = context;
+    entry->event.hostTime = timestamp->mHostTime;
+    entry->event.sampleTime = timestamp->mSampleTime;
+    entry->event.duration = duration;
+    entry->event.node = monitor->slowestProfile ? monitor->slowestProfile->node : NULL;
+    entry->event.nodeType = monitor->slowestProfile ? monitor->slowestProfile->nodeType : AERenderProfileNodeTypeChannel;
+    OSMemoryBarrier();
+    entry->sequence = index + 1;
+}
+
+static void renderTimingBeginCycle(AEAudioController *THIS, render_timing_monitor_t *monitor, AEAudioTimingContext context, const AudioTimeStamp *timestamp, UInt32 frames) {
+    if ( monitor->reset ) {
+        monitor->cycles = monitor->overruns = monitor->discontinuities = monitor->lateCallbacks = 0;
+        monitor->jitterAccumulator = monitor->maxJitter = monitor->maxProcessingTime = 0;
+        monitor->reset = NO;
+    }
+    
+    monitor->cycleStartTime = mach_absolute_time();
+    
+    if ( monitor->lastFrames > 0 ) {
+        double sampleRate = THIS->_audioDescription.mSampleRate;
+        double expectedInterval = monitor->lastFrames / sampleRate;
+        
+        if ( (timestamp->mFlags & kAudioTimeStampSampleTimeValid) && timestamp->mSampleTime != monitor->lastSampleTime + monitor->lastFrames ) {
+            monitor->discontinuities++;
+            renderEventPost(THIS, AERenderEventDiscontinuity, context, monitor, timestamp,
+                            (timestamp->mSampleTime - (monitor->lastSampleTime + monitor->lastFrames)) / sampleRate);
+        }
+        
+        if ( (timestamp->mFlags & kAudioTimeStampHostTimeValid) && timestamp->mHostTime > monitor->lastHostTime ) {
+            double interval = (timestamp->mHostTime - monitor->lastHostTime) * __hostTicksToSeconds;
+            double jitter = fabs(interval - expectedInterval);
+            monitor->jitterAccumulator += jitter;
+            if ( jitter > monitor->maxJitter ) monitor->maxJitter = jitter;
+            if ( interval - expectedInterval > expectedInterval / 2.0 ) {
+                monitor->lateCallbacks++;
+                renderEventPost(THIS, AERenderEventLateCallback, context, monitor, timestamp, interval - expectedInterval);
+            }
+        }
+    }
+    
+    monitor->lastHostTime = timestamp->mHostTime;
+    monitor->lastSampleTime = timestamp->mSampleTime;
+    monitor->lastFrames = frames;
+    monitor->slowestProfile = NULL;
+    monitor->slowestTicks = 0;
+    memset(monitor->slowestPerLane, 0, sizeof(monitor->slowestPerLane));
+    THIS->_activeTimingMonitor = monitor;
+}
+
+static void renderTimingEndCycle(AEAudioController *THIS, render_timing_monitor_t *monitor, AEAudioTimingContext context, const AudioTimeStamp *timestamp, UInt32 frames) {
+    // The workers are done with this cycle by now, so merge their slowest nodes with ours
+    for ( int i=0; i<kMaximumRenderLanes; i++ ) {
+        if ( monitor->slowestPerLane[i].ticks > monitor->slowestTicks ) {
+            monitor->slowestTicks = monitor->slowestPerLane[i].ticks;
+            monitor->slowestProfile = monitor->slowestPerLane[i].profile;
+        }
+    }
+    
+    if ( !monitor->cycleStartTime || frames == 0 ) return;
+    
+    double processingTime = (mach_absolute_time() - monitor->cycleStartTime) * __hostTicksToSeconds;
+    double bufferDuration = frames / THIS->_audioDescription.mSampleRate;
+    monitor->cycles++;
+    if ( processingTime > monitor->maxProcessingTime ) monitor->maxProcessingTime = processingTime;
+    if ( processingTime > bufferDuration ) {
+        monitor->overruns++;
+        renderEventPost(THIS, AERenderEventOverrun, context, monitor, timestamp, processingTime - bufferDuration);
+    }
+    monitor->cycleStartTime = 0;
+}
+
 typedef struct __input_producer_arg_t {
     AEAudioController *THIS;
     input_callback_table_t *table;
@@ -533,18 +2135,22 @@ static OSStatus inputAudioProducer(void *userInfo, AudioBufferList *audio, UInt3
     input_producer_arg_t *arg = (input_producer_arg_t*)userInfo;
     AEAudioController *THIS = arg->THIS;
     
-    // See if there's another filter
-    for ( int i=arg->table->callbacks.count-1, filterIndex=0; i>=0; i-- ) {
-        callback_t *callback = &arg->table->callbacks.callbacks[i];
-        if ( callback->flags & kFilterFlag ) {
-            if ( filterIndex == arg->nextFilterIndex ) {
-                // Run this filter
-                input_producer_arg_t filterArg = *arg;
-                filterArg.nextFilterIndex = filterIndex+1;
-                return ((AEAudioControllerFilterCallback)callback->callback)(callback->userInfo, THIS, &inputAudioProducer, (void*)&filterArg, &arg->inTimeStamp, *frames, audio);
-            }
-            filterIndex++;
+    if ( arg->nextFilterIndex < arg->table->callbacks.filterCount ) {
+        // Run the next filter
+        callback_t *callback = &arg->table->callbacks.filters[arg->nextFilterIndex];
+        input_producer_arg_t filterArg = *arg;
+        filterArg.nextFilterIndex++;
+        profiled_producer_arg_t producerArg = { .producer = &inputAudioProducer, .producerToken = (void*)&filterArg, .ticks = 0 };
+        uint64_t start = renderProfileStart(THIS);
+        OSStatus status = start
+            ? ((AEAudioControllerFilterCallback)callback->callback)(callback->userInfo, THIS, &profiledAudioProducer, (void*)&producerArg, &arg->inTimeStamp, *frames, audio)
+            : ((AEAudioControllerFilterCallback)callback->callback)(callback->userInfo, THIS, &inputAudioProducer, (void*)&filterArg, &arg->inTimeStamp, *frames, audio);
+        renderProfileRecord(THIS, callback->profile, start, producerArg.ticks, *frames);
+        if ( status == AEAudioControllerOutputIsSilence ) {
+            *arg->ioActionFlags |= kAudioUnitRenderAction_OutputIsSilence;
+            status = noErr;
         }
+        return status;
     }
     
     if ( arg->table->audioConverter ) {
@@ -574,6 +2180,8 @@ static OSStatus inputAvailableCallback(void *inRefCon, AudioUnitRenderActionFlag
     
     if ( !THIS->_inputAudioBufferList ) return noErr;
     
+    renderTimingBeginCycle(THIS, &THIS->_inputTimingMonitor, AEAudioTimingContextInput, inTimeStamp, inNumberFrames);
+    
     AudioTimeStamp timestamp = *inTimeStamp;
     
     BOOL useAudiobus = THIS->_audiobusReceiverPort && THIS->_usingAudiobusInput;
@@ -589,8 +2197,8 @@ static OSStatus inputAvailableCallback(void *inRefCon, AudioUnitRenderActionFlag
         timestamp.mHostTime += AEAudioControllerInputLatency(THIS)*__secondsToHostTicks;
     }
     
-    for ( int i=0; i<THIS->_timingCallbacks.count; i++ ) {
-        callback_t *callback = &THIS->_timingCallbacks.callbacks[i];
+    for ( int i=0; i<THIS->_timingCallbacks.renderCount; i++ ) {
+        callback_t *callback = &THIS->_timingCallbacks.renderCallbacks[i];
         ((AEAudioControllerTimingCallback)callback->callback)(callback->userInfo, THIS, &timestamp, inNumberFrames, AEAudioTimingContextInput);
     }
     
@@ -633,19 +2241,21 @@ static OSStatus inputAvailableCallback(void *inRefCon, AudioUnitRenderActionFlag
         result = inputAudioProducer((void*)&arg, table->audioBufferList, &inNumberFrames);
         
         // Pass audio to callbacks
-        for ( int i=0; i<table->callbacks.count; i++ ) {
-            callback_t *callback = &table->callbacks.callbacks[i];
-            if ( !(callback->flags & kReceiverFlag) ) continue;
-            
+        for ( int i=0; i<table->callbacks.receiverCount; i++ ) {
+            callback_t *callback = &table->callbacks.receivers[i];
+            uint64_t start = renderProfileStart(THIS);
             ((AEAudioControllerAudioCallback)callback->callback)(callback->userInfo, THIS, AEAudioSourceInput, &timestamp, inNumberFrames, table->audioBufferList);
+            renderProfileRecord(THIS, callback->profile, start, 0, inNumberFrames);
         }
     }
     
     // Perform input metering
     if ( THIS->_inputLevelMonitorData.monitoringEnabled ) {
-        performLevelMonitoring(&THIS->_inputLevelMonitorData, THIS->_inputAudioBufferList, inNumberFrames);
+        performLevelMonitoring(THIS->_renderBufferPool, &THIS->_inputLevelMonitorData, THIS->_inputAudioBufferList, inNumberFrames);
     }
     
+    renderTimingEndCycle(THIS, &THIS->_inputTimingMonitor, AEAudioTimingContextInput, inTimeStamp, inNumberFrames);
+    
     return result;
 }
 
@@ -655,10 +2265,16 @@ static OSStatus groupRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionF
     
     if ( !(*ioActionFlags & kAudioUnitRenderAction_PreRender) ) {
         // After render
-        handleCallbacksForChannel(channel, inTimeStamp, inNumberFrames, ioData);
+        AudioTimeStamp timestamp = *inTimeStamp;
+        timestamp.mHostTime += downstreamLatencyTicks(channel);
+        handleCallbacksForChannel(channel, &timestamp, inNumberFrames, ioData);
         
         if ( group->level_monitor_data.monitoringEnabled ) {
-            performLevelMonitoring(&group->level_monitor_data, ioData, inNumberFrames);
+            if ( *ioActionFlags & kAudioUnitRenderAction_OutputIsSilence ) {
+                performLevelMonitoringOfSilence(&group->level_monitor_data);
+            } else {
+                performLevelMonitoring(channel->audioController->_renderBufferPool, &group->level_monitor_data, ioData, inNumberFrames);
+            }
         }
     }
     
@@ -670,9 +2286,16 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     AEAudioController *THIS = (AEAudioController *)inRefCon;
     
     if ( *ioActionFlags & kAudioUnitRenderAction_PreRender ) {
-        // Before render: Perform timing callbacks
-        for ( int i=0; i<THIS->_timingCallbacks.count; i++ ) {
-            callback_t *callback = &THIS->_timingCallbacks.callbacks[i];
+        renderTimingBeginCycle(THIS, &THIS->_outputTimingMonitor, AEAudioTimingContextOutput, inTimeStamp, inNumberFrames);
+        
+        // Before render: Perform any timed messages that fall within this buffer
+        if ( THIS->_timedMessageCount > 0 ) {
+            processTimedMessagesOnRealtimeThread(THIS, inTimeStamp, inNumberFrames);
+        }
+        
+        // Perform timing callbacks
+        for ( int i=0; i<THIS->_timingCallbacks.renderCount; i++ ) {
+            callback_t *callback = &THIS->_timingCallbacks.renderCallbacks[i];
             ((AEAudioControllerTimingCallback)callback->callback)(callback->userInfo, THIS, inTimeStamp, inNumberFrames, AEAudioTimingContextOutput);
         }
     } else {
@@ -684,6 +2307,12 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
         }
         
         processPendingMessagesOnRealtimeThread(THIS);
+        
+        // Mark the end of this render cycle: anything retired before now is no longer in use
+        OSMemoryBarrier();
+        THIS->_renderEpoch++;
+        
+        renderTimingEndCycle(THIS, &THIS->_outputTimingMonitor, AEAudioTimingContextOutput, inTimeStamp, inNumberFrames);
     }
     
     return noErr;
@@ -696,6 +2325,11 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     mach_timebase_info(&tinfo);
     __hostTicksToSeconds = ((double)tinfo.numer / tinfo.denom) * 1.0e-9;
     __secondsToHostTicks = 1.0 / __hostTicksToSeconds;
+    
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&__renderBufferLaneKey, NULL);
+    });
 }
 
 
@@ -781,20 +2415,35 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 }
 
 - (id)initWithAudioDescription:(AudioStreamBasicDescription)audioDescription inputEnabled:(BOOL)enableInput useVoiceProcessing:(BOOL)useVoiceProcessing {
+    return [self initWithAudioDescription:audioDescription inputEnabled:enableInput useVoiceProcessing:useVoiceProcessing offline:NO];
+}
+
+- (id)initForOfflineRenderingWithAudioDescription:(AudioStreamBasicDescription)audioDescription {
+    return [self initWithAudioDescription:audioDescription inputEnabled:NO useVoiceProcessing:NO offline:YES];
+}
+
+- (id)initWithAudioDescription:(AudioStreamBasicDescription)audioDescription inputEnabled:(BOOL)enableInput useVoiceProcessing:(BOOL)useVoiceProcessing offline:(BOOL)offline {
     if ( !(self = [super init]) ) return nil;
     
     NSAssert(audioDescription.mFormatID == kAudioFormatLinearPCM, @"Only linear PCM supported");
     
-    __interruptionListenerSelf = self;
+    _offline = offline;
+    
+    if ( !_offline ) {
+        __interruptionListenerSelf = self;
+    }
     
     _audioSessionCategory = enableInput ? kAudioSessionCategory_PlayAndRecord : kAudioSessionCategory_MediaPlayback;
     _allowMixingWithOtherApps = YES;
     _audioDescription = audioDescription;
+    _busAudioDescription = audioDescription;
     _inputEnabled = enableInput;
     _masterOutputVolume = 1.0;
     _voiceProcessingEnabled = useVoiceProcessing;
     _inputMode = AEInputModeFixedAudioFormat;
     _voiceProcessingOnlyForSpeakerAndMicrophone = YES;
+    _synchronousMessageExchangeTimeout = 1.0;
+    _renderProfilingEnabled = YES;
     _inputCallbacks = (input_callback_table_t*)calloc(sizeof(input_callback_table_t), 1);
     _inputCallbackCount = 1;
     
@@ -805,12 +2454,15 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     }
     
     TPCircularBufferInit(&_realtimeThreadMessageBuffer, kMessageBufferLength);
-    TPCircularBufferInit(&_mainThreadMessageBuffer, kMessageBufferLength);
+    messageQueueInit(&_mainThreadMessageQueue, kMessageBufferLength);
+    checkResult(semaphore_create(mach_task_self(), &_mainThreadMessageSemaphore, SYNC_POLICY_FIFO, 0), "semaphore_create");
     
-    if ( ![self initAudioSession] || ![self setup] ) {
+    if ( (!_offline && ![self initAudioSession]) || ![self setup] ) {
         _audioGraph = NULL;
     }
     
+    if ( _offline ) return self;
+    
     self.housekeepingTimer = [NSTimer scheduledTimerWithTimeInterval:1.0 target:[[[AEAudioControllerProxy alloc] initWithAudioController:self] autorelease] selector:@selector(housekeeping) userInfo:nil repeats:YES];
     
     return self;
@@ -836,22 +2488,41 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     
     [self releaseResourcesForChannel:_topChannel];
     
-    OSStatus result = AudioSessionRemovePropertyListenerWithUserData(kAudioSessionProperty_AudioRouteChange, audioSessionPropertyListener, self);
-    checkResult(result, "AudioSessionRemovePropertyListenerWithUserData");
-    
-    result = AudioSessionRemovePropertyListenerWithUserData(kAudioSessionProperty_AudioInputAvailable, audioSessionPropertyListener, self);
-    checkResult(result, "AudioSessionRemovePropertyListenerWithUserData");
+    if ( !_offline ) {
+        OSStatus result = AudioSessionRemovePropertyListenerWithUserData(kAudioSessionProperty_AudioRouteChange, audioSessionPropertyListener, self);
+        checkResult(result, "AudioSessionRemovePropertyListenerWithUserData");
+        
+        result = AudioSessionRemovePropertyListenerWithUserData(kAudioSessionProperty_AudioInputAvailable, audioSessionPropertyListener, self);
+        checkResult(result, "AudioSessionRemovePropertyListenerWithUserData");
+    }
     
     self.audioRoute = nil;
     
     if ( _audiobusReceiverPort ) [_audiobusReceiverPort release];
     
     TPCircularBufferCleanup(&_realtimeThreadMessageBuffer);
-    TPCircularBufferCleanup(&_mainThreadMessageBuffer);
-    
-    if ( _inputLevelMonitorData.scratchBuffer ) {
-        AEFreeAudioBufferList(_inputLevelMonitorData.scratchBuffer);
-    }
+    for ( int i=0; i<_transactionBlockCount; i++ ) {
+        [_transactionBlocks[i] release];
+    }
+    if ( _transactionBlocks ) free(_transactionBlocks);
+    [_transactionResponseBlocks release];
+    [_pendingGroupConfigurations release];
+    [_pendingChannelReleases release];
+    [_pendingGroupPublications release];
+    [_pendingCallbackTablePublications release];
+    [_pendingChannelPublications release];
+    [_pendingUpdateBlock release];
+    [_pendingUpdateCompletions release];
+    
+    // Nothing is rendering any more, so everything retired so far can go (including anything retired in turn)
+    while ( _retiredItemCount > 0 ) {
+        AEAudioControllerReleaseRetiredItems(self);
+    }
+    if ( _retiredItems ) free(_retiredItems);
+    if ( _renderWorkerPool ) renderWorkerPoolDestroy(_renderWorkerPool);
+    if ( _renderBufferPool ) renderBufferPoolDestroy(_renderBufferPool);
+    messageQueueCleanup(&_mainThreadMessageQueue);
+    semaphore_destroy(mach_task_self(), _mainThreadMessageSemaphore);
     
     if ( _inputLevelMonitorData.floatConverter ) {
         [_inputLevelMonitorData.floatConverter release];
@@ -865,8 +2536,12 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
         if ( _inputCallbacks[i].channelMap ) {
             [_inputCallbacks[i].channelMap release];
         }
+        free(_inputCallbacks[i].callbacks.callbacks);
+        free(_inputCallbacks[i].callbacks.renderCallbacks);
     }
     free(_inputCallbacks);
+    free(_timingCallbacks.callbacks);
+    free(_timingCallbacks.renderCallbacks);
     
     [super dealloc];
 }
@@ -886,6 +2561,17 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
         return NO;
     }
     
+    if ( _offline ) {
+        // Nothing to start: rendering happens when renderOfflineFrames:intoBufferList:atTime: is called
+        if ( !_pollThread ) {
+            _pollThread = [[AEAudioControllerMessagePollThread alloc] initWithAudioController:self];
+            OSMemoryBarrier();
+            [_pollThread start];
+        }
+        _running = YES;
+        return YES;
+    }
+    
     if ( !checkResult(status=AudioSessionSetActive(true), "AudioSessionSetActive") ) {
         if ( error ) *error = [NSError audioControllerErrorWithMessage:@"Couldn't activate audio session" OSStatus:status];
         return NO;
@@ -913,7 +2599,6 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     if ( !_pollThread ) {
         // Start messaging poll thread
         _pollThread = [[AEAudioControllerMessagePollThread alloc] initWithAudioController:self];
-        _pollThread.pollInterval = kIdleMessagingPollDuration;
         OSMemoryBarrier();
         [_pollThread start];
     }
@@ -937,25 +2622,120 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     NSLog(@"TAAE: Stopping Engine");
     
     if ( _running ) {
-        checkResult(AUGraphStop(_audioGraph), "AUGraphStop");
+        if ( !_offline ) {
+            checkResult(AUGraphStop(_audioGraph), "AUGraphStop");
+        }
         
         _running = NO;
         
-        if ( !_interrupted ) {
-            AudioSessionSetActive(false);
+        if ( !_offline && !_interrupted ) {
+            AudioSessionSetActive(false);
+        }
+        
+        processPendingMessagesOnRealtimeThread(self);
+        
+        // Perform any timed messages that are still waiting, as they'll never come due now
+        for ( int i=0; i<_timedMessageCount; i++ ) {
+            _timedMessages[i].timedBlock(0);
+            sendMessageResponse(self, &_timedMessages[i]);
+        }
+        _timedMessageCount = 0;
+    }
+    
+    if ( _pollThread ) {
+        [_pollThread cancel];
+        semaphore_signal(_mainThreadMessageSemaphore);
+        while ( [_pollThread isExecuting] ) {
+            [NSThread sleepForTimeInterval:0.01];
+        }
+        [_pollThread release];
+        _pollThread = nil;
+    }
+    
+    // Nothing's rendering now, so all retired items can go
+    AEAudioControllerReleaseRetiredItems(self);
+}
+
+#pragma mark - Offline rendering
+
+- (OSStatus)renderOfflineFrames:(UInt32)frames intoBufferList:(AudioBufferList*)bufferList atTime:(const AudioTimeStamp*)time {
+    NSAssert(_offline, @"Not in offline rendering mode");
+    if ( !_running ) return kAudioUnitErr_Uninitialized;
+    
+    @synchronized ( self ) {
+        _offlineRenderInProgress = YES;
+    }
+    OSStatus result = [self renderOfflineSlicesOfFrames:frames intoBufferList:bufferList atTime:time];
+    @synchronized ( self ) {
+        _offlineRenderInProgress = NO;
+        
+        // Perform anything sent since the last slice began, rather than leaving it until the next render
+        processPendingMessagesOnRealtimeThread(self);
+    }
+    AEAudioControllerReleaseRetiredItems(self);
+    
+    return result;
+}
+
+- (OSStatus)renderOfflineSlicesOfFrames:(UInt32)frames intoBufferList:(AudioBufferList*)bufferList atTime:(const AudioTimeStamp*)time {
+    if ( !time && !_offlineHostTimeBase ) {
+        _offlineHostTimeBase = mach_absolute_time();
+    }
+    
+    // Render in slices no bigger than the units in the graph can handle
+    char bufferListSpace[sizeof(AudioBufferList)+(bufferList->mNumberBuffers-1)*sizeof(AudioBuffer)];
+    AudioBufferList *slice = (AudioBufferList*)bufferListSpace;
+    slice->mNumberBuffers = bufferList->mNumberBuffers;
+    
+    UInt32 bytesPerFrame = _audioDescription.mBytesPerFrame;
+    UInt32 offset = 0;
+    while ( offset < frames ) {
+        UInt32 sliceFrames = MIN(frames - offset, kMaximumFramesPerSlice);
+        for ( int i=0; i<bufferList->mNumberBuffers; i++ ) {
+            slice->mBuffers[i].mNumberChannels = bufferList->mBuffers[i].mNumberChannels;
+            slice->mBuffers[i].mData = (char*)bufferList->mBuffers[i].mData + offset * bytesPerFrame;
+            slice->mBuffers[i].mDataByteSize = sliceFrames * bytesPerFrame;
+        }
+        
+        AudioTimeStamp timeStamp;
+        if ( time ) {
+            // Caller's clock
+            timeStamp = *time;
+            if ( timeStamp.mFlags & kAudioTimeStampSampleTimeValid ) {
+                timeStamp.mSampleTime += offset;
+            }
+            if ( timeStamp.mFlags & kAudioTimeStampHostTimeValid ) {
+                timeStamp.mHostTime += (uint64_t)((offset / _audioDescription.mSampleRate) * __secondsToHostTicks);
+            }
+        } else {
+            // Our own clock, which runs as fast as we render
+            memset(&timeStamp, 0, sizeof(timeStamp));
+            timeStamp.mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid;
+            timeStamp.mSampleTime = _offlineSampleTime;
+            timeStamp.mHostTime = _offlineHostTimeBase + (uint64_t)((_offlineSampleTime / _audioDescription.mSampleRate) * __secondsToHostTicks);
         }
         
-        processPendingMessagesOnRealtimeThread(self);
+        AudioUnitRenderActionFlags flags = 0;
+        uint64_t start = mach_absolute_time();
+        OSStatus result = AudioUnitRender(_ioAudioUnit, &flags, &timeStamp, 0, sliceFrames, slice);
+        _offlineRenderTicks += mach_absolute_time() - start;
+        if ( !checkResult(result, "AudioUnitRender") ) return result;
+        
+        _offlineSampleTime += sliceFrames;
+        _offlineRenderedFrames += sliceFrames;
+        offset += sliceFrames;
     }
     
-    if ( _pollThread ) {
-        [_pollThread cancel];
-        while ( [_pollThread isExecuting] ) {
-            [NSThread sleepForTimeInterval:0.01];
-        }
-        [_pollThread release];
-        _pollThread = nil;
-    }
+    return noErr;
+}
+
+-(double)offlineRenderSpeed {
+    if ( !_offlineRenderTicks ) return 0.0;
+    return ((double)_offlineRenderedFrames / _audioDescription.mSampleRate) / (_offlineRenderTicks * __hostTicksToSeconds);
+}
+
+-(BOOL)offline {
+    return _offline;
 }
 
 #pragma mark - Channel and channel group management
@@ -968,13 +2748,13 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     // Remove the channels from the system, if they're already added
     [self removeChannels:channels];
     
-    // Add to group's channel array
+    int channelCount = (int)[channels count];
+    if ( channelCount == 0 ) return;
+    
+    // Create channel entries
+    AEChannelRef channelElements[channelCount];
+    int channelIndex = 0;
     for ( id<AEAudioPlayable> channel in channels ) {
-        if ( group->channelCount == kMaximumChannelsPerGroup ) {
-            NSLog(@"Warning: Channel limit reached");
-            break;
-        }
-        
         [channel retain];
         
         for ( NSString *property in [NSArray arrayWithObjects:@"volume", @"pan", @"channelIsPlaying", @"channelIsMuted", @"audioDescription", nil] ) {
@@ -991,17 +2771,22 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
         channelElement->muted       = [channel respondsToSelector:@selector(channelIsMuted)] ? channel.channelIsMuted : NO;
         channelElement->audioDescription = [channel respondsToSelector:@selector(audioDescription)] && channel.audioDescription.mSampleRate ? channel.audioDescription : _audioDescription;
         memset(&channelElement->timeStamp, 0, sizeof(channelElement->timeStamp));
+        channelElement->renderProfile.node = channel;
+        channelElement->renderProfile.nodeType = AERenderProfileNodeTypeChannel;
         channelElement->audioController = self;
         
-        group->channels[group->channelCount++] = channelElement;
+        channelElements[channelIndex++] = channelElement;
     }
     
-    int channelCount = (int)[channels count];
+    // Add to group's channel array
+    [self appendChannels:channelElements count:channelCount toGroup:group];
     
-    // Set bus count
-    UInt32 busCount = group->channelCount;
-    OSStatus result = AudioUnitSetProperty(group->mixerAudioUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount));
-    if ( !checkResult(result, "AudioUnitSetProperty(kAudioUnitProperty_ElementCount)") ) return;
+    if ( group->mixerAudioUnit ) {
+        // Set bus count
+        UInt32 busCount = group->channelCount;
+        OSStatus result = AudioUnitSetProperty(group->mixerAudioUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount));
+        if ( !checkResult(result, "AudioUnitSetProperty(kAudioUnitProperty_ElementCount)") ) return;
+    }
     
     // Configure each channel
     [self configureChannelsInRange:NSMakeRange(group->channelCount - channelCount, channelCount) forGroup:group];
@@ -1036,7 +2821,7 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 
 - (void)removeChannels:(NSArray*)channels fromChannelGroup:(AEChannelGroupRef)group {
     
-    // Remove the channels from the tables, on the core audio thread
+    // Remove the channels from the table; the realtime thread sees the change once it's published
     int count = (int)[channels count];
     
     if ( count == 0 ) return;
@@ -1049,11 +2834,8 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     }
     AEChannelRef removedChannels[count];
     memset(removedChannels, 0, sizeof(removedChannels));
-    AEChannelRef *removedChannels_p = removedChannels;
     int priorCount = group->channelCount;
-    [self performSynchronousMessageExchangeWithBlock:^{
-        removeChannelsFromGroup(self, group, ptrMatchArray, objectMatchArray, removedChannels_p, count);
-    }];
+    removeChannelsFromGroup(self, group, ptrMatchArray, objectMatchArray, removedChannels, count);
     free(ptrMatchArray);
     free(objectMatchArray);
     
@@ -1061,10 +2843,23 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     
     checkResult([self updateGraph], "Update graph");
     
-    // Set new bus count of group
-    UInt32 busCount = group->channelCount;
-    if ( !checkResult(AudioUnitSetProperty(group->mixerAudioUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount)),
-                      "AudioUnitSetProperty(kAudioUnitProperty_ElementCount)") ) return;
+    if ( _updateBatchDepth > 0 ) {
+        // The graph may still refer to the removed channels until the batch is committed
+        [self pendingConfigurationForGroup:group]->trimBusCount = YES;
+        for ( int i=0; i<count; i++ ) {
+            if ( removedChannels[i] ) {
+                [_pendingChannelReleases appendBytes:&removedChannels[i] length:sizeof(AEChannelRef)];
+            }
+        }
+        return;
+    }
+    
+    if ( group->mixerAudioUnit ) {
+        // Set new bus count of group
+        UInt32 busCount = group->channelCount;
+        if ( !checkResult(AudioUnitSetProperty(group->mixerAudioUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount)),
+                          "AudioUnitSetProperty(kAudioUnitProperty_ElementCount)") ) return;
+    }
     
     
     // Release channel resources
@@ -1083,13 +2878,31 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     NSAssert(group == _topGroup || parentGroup != NULL, @"Channel group not found");
     
     if ( parentGroup ) {
-        // Remove the group from the parent group's table, on the core audio thread
-        [self performSynchronousMessageExchangeWithBlock:^{
-            removeChannelsFromGroup(self, parentGroup, (void*[1]){ group }, (void*[1]){ NULL }, NULL, 1);
-        }];
+        // Drop sends to any aux buses going with the group
+        NSMutableData *buses = [NSMutableData data];
+        [self gatherAuxBusesFromGroup:group intoData:buses];
+        NSMutableData *sendUpdateData = [NSMutableData data];
+        if ( buses.length > 0 ) {
+            [self gatherSendsToAuxBuses:(AEChannelGroupRef*)buses.bytes count:(int)(buses.length / sizeof(AEChannelGroupRef)) fromChannel:_topChannel intoData:sendUpdateData];
+        }
+        send_table_update_t *sendUpdates = (send_table_update_t*)sendUpdateData.mutableBytes;
+        int sendUpdateCount = (int)(sendUpdateData.length / sizeof(send_table_update_t));
+        
+        // Remove the group from the parent group's table, along with the sends; both are published together
+        removeChannelsFromGroup(self, parentGroup, (void*[1]){ group }, (void*[1]){ NULL }, NULL, 1);
+        for ( int i=0; i<sendUpdateCount; i++ ) {
+            [self setSends:sendUpdates[i].sends count:sendUpdates[i].sendCount forChannel:sendUpdates[i].channel];
+        }
+        
         [self configureChannelsInRange:NSMakeRange(0, parentGroup->channelCount) forGroup:parentGroup];
         
         checkResult([self updateGraph], "Update graph");
+        
+        if ( _updateBatchDepth > 0 ) {
+            // The graph may still refer to the group until the batch is committed
+            [_pendingChannelReleases appendBytes:&group->channel length:sizeof(AEChannelRef)];
+            return;
+        }
     }
     
     [self releaseResourcesForChannel:group->channel];
@@ -1117,13 +2930,13 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 }
 
 - (AEChannelGroupRef)createChannelGroupWithinChannelGroup:(AEChannelGroupRef)parentGroup {
-    if ( parentGroup->channelCount == kMaximumChannelsPerGroup ) {
-        NSLog(@"Maximum channels reached in group %p\n", parentGroup);
-        return NULL;
-    }
-    
+    return [self createChannelGroupWithinChannelGroup:parentGroup auxBus:NULL];
+}
+
+- (AEChannelGroupRef)createChannelGroupWithinChannelGroup:(AEChannelGroupRef)parentGroup auxBus:(aux_bus_t*)auxBus {
     // Allocate group
     AEChannelGroupRef group = (AEChannelGroupRef)calloc(1, sizeof(channel_group_t));
+    group->auxBus = auxBus;
     
     // Add group as a channel to the parent group
     int groupIndex = parentGroup->channelCount;
@@ -1137,11 +2950,12 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     channel->pan     = 0.0;
     channel->muted   = NO;
     channel->audioController = self;
+    channel->renderProfile.node = group;
+    channel->renderProfile.nodeType = AERenderProfileNodeTypeChannelGroup;
     
-    parentGroup->channels[groupIndex] = channel;
     group->channel   = channel;
     
-    parentGroup->channelCount++;
+    [self appendChannels:&channel count:1 toGroup:parentGroup];
     
     [self configureChannelsInRange:NSMakeRange(groupIndex, 1) forGroup:parentGroup];
     checkResult([self updateGraph], "Update graph");
@@ -1168,9 +2982,17 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     AEChannelGroupRef parentGroup = [self searchForGroupContainingChannelMatchingPtr:group userInfo:NULL index:&index];
     NSAssert(parentGroup != NULL, @"Channel not found");
     
+    if ( group->channel->volumeRamp.remainingFrames ) {
+        // Let the render thread replace the ramp with a one-buffer glide, so the two don't race
+        [self rampParameter:kMultiChannelMixerParam_Volume ofChannelMatchingPtr:group object:NULL to:volume duration:_currentBufferDuration exponential:NO];
+        return;
+    }
+    
     AudioUnitParameterValue value = group->channel->volume = volume;
-    OSStatus result = AudioUnitSetParameter(parentGroup->mixerAudioUnit, kMultiChannelMixerParam_Volume, kAudioUnitScope_Input, index, value, 0);
-    checkResult(result, "AudioUnitSetParameter(kMultiChannelMixerParam_Volume)");
+    if ( parentGroup->mixerAudioUnit ) {
+        OSStatus result = AudioUnitSetParameter(parentGroup->mixerAudioUnit, kMultiChannelMixerParam_Volume, kAudioUnitScope_Input, index, value, 0);
+        checkResult(result, "AudioUnitSetParameter(kMultiChannelMixerParam_Volume)");
+    }
 }
 
 -(float)volumeForChannelGroup:(AEChannelGroupRef)group {
@@ -1182,46 +3004,430 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     AEChannelGroupRef parentGroup = [self searchForGroupContainingChannelMatchingPtr:group userInfo:NULL index:&index];
     NSAssert(parentGroup != NULL, @"Channel not found");
     
+    if ( group->channel->panRamp.remainingFrames ) {
+        [self rampParameter:kMultiChannelMixerParam_Pan ofChannelMatchingPtr:group object:NULL to:pan duration:_currentBufferDuration exponential:NO];
+        return;
+    }
+    
     AudioUnitParameterValue value = group->channel->pan = pan;
     if ( value == -1.0 ) value = -0.999; // Workaround for pan limits bug
     if ( value == 1.0 ) value = 0.999;
-    OSStatus result = AudioUnitSetParameter(parentGroup->mixerAudioUnit, kMultiChannelMixerParam_Pan, kAudioUnitScope_Input, index, value, 0);
-    checkResult(result, "AudioUnitSetParameter(kMultiChannelMixerParam_Pan)");
+    if ( parentGroup->mixerAudioUnit ) {
+        OSStatus result = AudioUnitSetParameter(parentGroup->mixerAudioUnit, kMultiChannelMixerParam_Pan, kAudioUnitScope_Input, index, value, 0);
+        checkResult(result, "AudioUnitSetParameter(kMultiChannelMixerParam_Pan)");
+    }
 }
 
 -(float)panForChannelGroup:(AEChannelGroupRef)group {
     return group->channel->pan;
 }
 
+- (void)setVolume:(float)volume forChannelGroup:(AEChannelGroupRef)group rampDuration:(NSTimeInterval)duration curve:(AERampCurve)curve {
+    [self rampParameter:kMultiChannelMixerParam_Volume ofChannelMatchingPtr:group object:NULL to:volume duration:duration exponential:curve == AERampCurveExponential];
+}
+
+- (void)setPan:(float)pan forChannelGroup:(AEChannelGroupRef)group rampDuration:(NSTimeInterval)duration {
+    [self rampParameter:kMultiChannelMixerParam_Pan ofChannelMatchingPtr:group object:NULL to:pan duration:duration exponential:NO];
+}
+
 - (void)setMuted:(BOOL)muted forChannelGroup:(AEChannelGroupRef)group {
     int index;
     AEChannelGroupRef parentGroup = [self searchForGroupContainingChannelMatchingPtr:group userInfo:NULL index:&index];
     NSAssert(parentGroup != NULL, @"Channel not found");
     group->channel->muted = muted;
     AudioUnitParameterValue value = !muted && group->channel->playing;
-    OSStatus result = AudioUnitSetParameter(parentGroup->mixerAudioUnit, kMultiChannelMixerParam_Enable, kAudioUnitScope_Input, index, value, 0);
-    checkResult(result, "AudioUnitSetParameter(kMultiChannelMixerParam_Enable)");
+    if ( parentGroup->mixerAudioUnit ) {
+        OSStatus result = AudioUnitSetParameter(parentGroup->mixerAudioUnit, kMultiChannelMixerParam_Enable, kAudioUnitScope_Input, index, value, 0);
+        checkResult(result, "AudioUnitSetParameter(kMultiChannelMixerParam_Enable)");
+    }
 }
 
 -(BOOL)channelGroupIsMuted:(AEChannelGroupRef)group {
     return group->channel->muted;
 }
 
+- (AEChannelGroupRef)createAuxBusWithinChannelGroup:(AEChannelGroupRef)parentGroup {
+    return [self createChannelGroupWithinChannelGroup:parentGroup auxBus:auxBusCreate(&_audioDescription, _renderBufferPool ? _renderBufferPool->laneCount : (int)self.renderThreadCount + 1)];
+}
+
+- (void)setSendLevel:(float)level toAuxBus:(AEChannelGroupRef)auxBus forChannel:(id<AEAudioPlayable>)channel {
+    int index;
+    AEChannelGroupRef parentGroup = [self searchForGroupContainingChannelMatchingPtr:channel.renderCallback userInfo:channel index:&index];
+    NSAssert(parentGroup != NULL, @"Channel not found");
+    [self setSendLevel:level toAuxBus:auxBus forChannelElement:parentGroup->channels[index] inGroup:parentGroup index:index];
+}
+
+- (float)sendLevelToAuxBus:(AEChannelGroupRef)auxBus forChannel:(id<AEAudioPlayable>)channel {
+    int index;
+    AEChannelGroupRef parentGroup = [self searchForGroupContainingChannelMatchingPtr:channel.renderCallback userInfo:channel index:&index];
+    NSAssert(parentGroup != NULL, @"Channel not found");
+    return [self sendLevelToAuxBus:auxBus forChannelElement:parentGroup->channels[index]];
+}
+
+- (void)setSendLevel:(float)level toAuxBus:(AEChannelGroupRef)auxBus forChannelGroup:(AEChannelGroupRef)group {
+    int index;
+    AEChannelGroupRef parentGroup = [self searchForGroupContainingChannelMatchingPtr:group userInfo:NULL index:&index];
+    NSAssert(parentGroup != NULL, @"Channel group not found");
+    [self setSendLevel:level toAuxBus:auxBus forChannelElement:group->channel inGroup:parentGroup index:index];
+}
+
+- (float)sendLevelToAuxBus:(AEChannelGroupRef)auxBus forChannelGroup:(AEChannelGroupRef)group {
+    return [self sendLevelToAuxBus:auxBus forChannelElement:group->channel];
+}
+
+- (void)setSendLevel:(float)level toAuxBus:(AEChannelGroupRef)auxBus forChannelElement:(AEChannelRef)channel inGroup:(AEChannelGroupRef)parentGroup index:(int)index {
+    NSAssert(auxBus->auxBus != NULL, @"Not an aux bus");
+    NSAssert(channel != auxBus->channel, @"An aux bus can't send to itself");
+    level = MAX(0.0, level);
+    
+    int sendIndex = -1;
+    for ( int i=0; i<channel->sendCount; i++ ) {
+        if ( channel->sends[i].bus == auxBus ) {
+            sendIndex = i;
+            break;
+        }
+    }
+    
+    if ( sendIndex != -1 && level > 0 ) {
+        // The realtime thread ramps to the new level (straight away if it shares this table, otherwise once it's published)
+        channel->sends[sendIndex].level = level;
+        return;
+    }
+    
+    if ( sendIndex == -1 && level == 0 ) return;
+    
+    // Adding or removing a send: prepare a new table, to be published to the realtime thread
+    int newCount = channel->sendCount + (sendIndex == -1 ? 1 : -1);
+    aux_send_t *newSends = newCount ? (aux_send_t*)malloc(newCount * sizeof(aux_send_t)) : NULL;
+    int count = 0;
+    for ( int i=0; i<channel->sendCount; i++ ) {
+        if ( i != sendIndex ) newSends[count++] = channel->sends[i];
+    }
+    if ( sendIndex == -1 ) {
+        newSends[count] = (aux_send_t){ .bus = auxBus, .level = level, .gain = 0.0 };
+        [self updateSendFloatConverterForChannel:channel];
+    }
+    
+    BOOL wasSending = channel->sendCount > 0;
+    [self setSends:newSends count:newCount forChannel:channel];
+    
+    if ( !newCount && channel->sendFloatConverter ) {
+        // Keep the converter until the realtime thread has stopped sending
+        [self releaseObjectWhenUpdatesPublished:channel->sendFloatConverter];
+        channel->sendFloatConverter = nil;
+    }
+    
+    if ( channel->type == kChannelTypeGroup && wasSending != (newCount > 0) ) {
+        // Groups only send when pulled through our render callback
+        [self configureChannelsInRange:NSMakeRange(index, 1) forGroup:parentGroup];
+        checkResult([self updateGraph], "Update graph");
+    }
+    
+    [self publishUpdates];
+}
+
+- (void)setSends:(aux_send_t*)sends count:(int)count forChannel:(AEChannelRef)channel {
+    if ( channel->sends != channel->renderSends ) {
+        // Never published, so the realtime thread hasn't seen it
+        free(channel->sends);
+    }
+    channel->sends = sends;
+    channel->sendCount = count;
+    [self markChannelForPublication:channel];
+}
+
+static void publishChannel(channel_publication_t *publication) {
+    // Performed on the realtime thread. Afterwards, the publication holds what it replaced.
+    AEChannelRef channel = publication->channel;
+    
+    if ( publication->sends != channel->renderSends ) {
+        // Carry over the gains applied last buffer, so sends that remain keep ramping from where they are
+        for ( int i=0; i<publication->sendCount; i++ ) {
+            for ( int j=0; j<channel->renderSendCount; j++ ) {
+                if ( channel->renderSends[j].bus == publication->sends[i].bus ) {
+                    publication->sends[i].gain = channel->renderSends[j].gain;
+                    break;
+                }
+            }
+        }
+    }
+    
+    aux_send_t *oldSends = channel->renderSends;
+    int oldSendCount = channel->renderSendCount;
+    delay_line_t *oldDelayLine = channel->renderDelayLine;
+    channel->renderSends = publication->sends;
+    channel->renderSendCount = publication->sendCount;
+    channel->renderDelayLine = publication->delayLine;
+    publication->sends = oldSends;
+    publication->sendCount = oldSendCount;
+    publication->delayLine = oldDelayLine;
+}
+
+- (float)sendLevelToAuxBus:(AEChannelGroupRef)auxBus forChannelElement:(AEChannelRef)channel {
+    for ( int i=0; i<channel->sendCount; i++ ) {
+        if ( channel->sends[i].bus == auxBus ) return channel->sends[i].level;
+    }
+    return 0.0;
+}
+
+- (void)beginUpdates {
+    if ( _updateBatchDepth++ == 0 ) {
+        if ( !_pendingGroupConfigurations ) _pendingGroupConfigurations = [[NSMutableData alloc] init];
+        if ( !_pendingChannelReleases ) _pendingChannelReleases = [[NSMutableData alloc] init];
+        [self beginMessageExchangeTransaction];
+    }
+}
+
+- (void)commitUpdates {
+    NSAssert(_updateBatchDepth > 0, @"No batch of updates in progress");
+    if ( --_updateBatchDepth > 0 ) return;
+    
+    pending_group_configuration_t *pending = (pending_group_configuration_t*)_pendingGroupConfigurations.mutableBytes;
+    int pendingCount = (int)(_pendingGroupConfigurations.length / sizeof(pending_group_configuration_t));
+    BOOL attached[MAX(pendingCount, 1)];
+    
+    // Configure each affected group once, skipping groups that have since been removed, and those
+    // that will be configured anyway as part of a pending ancestor (which only reaches current channels,
+    // so groups with buses left to disconnect are still configured themselves). Table changes are held
+    // back meanwhile, to be published in one exchange with the graph update's.
+    _holdingUpdates = YES;
+    for ( int i=0; i<pendingCount; i++ ) {
+        BOOL covered;
+        attached[i] = [self groupIsAttached:pending[i].group coveredByPendingConfiguration:&covered];
+        if ( covered && pending[i].group && NSMaxRange(pending[i].range) > pending[i].group->channelCount ) {
+            covered = NO;
+        }
+        if ( attached[i] && !covered ) {
+            [self configureChannelsInRange:pending[i].range forGroup:pending[i].group];
+        }
+    }
+    _holdingUpdates = NO;
+    
+    if ( _graphUpdatePending ) {
+        _graphUpdatePending = NO;
+        checkResult([self updateGraph], "Update graph");
+    } else {
+        [self publishUpdates];
+    }
+    
+    // Now the graph no longer refers to them, drop surplus mixer buses and release removed channels
+    for ( int i=0; i<pendingCount; i++ ) {
+        if ( attached[i] && pending[i].trimBusCount && pending[i].group && pending[i].group->mixerAudioUnit ) {
+            UInt32 busCount = pending[i].group->channelCount;
+            checkResult(AudioUnitSetProperty(pending[i].group->mixerAudioUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount)),
+                        "AudioUnitSetProperty(kAudioUnitProperty_ElementCount)");
+        }
+    }
+    [_pendingGroupConfigurations setLength:0];
+    
+    AEChannelRef *releases = (AEChannelRef*)_pendingChannelReleases.mutableBytes;
+    int releaseCount = (int)(_pendingChannelReleases.length / sizeof(AEChannelRef));
+    for ( int i=0; i<releaseCount; i++ ) {
+        [self releaseResourcesForChannel:releases[i]];
+    }
+    [_pendingChannelReleases setLength:0];
+    
+    [self commitMessageExchangeTransaction];
+}
+
+- (void)markGroupForPublication:(AEChannelGroupRef)group {
+    if ( group->publishPending ) return;
+    group->publishPending = YES;
+    if ( !_pendingGroupPublications ) _pendingGroupPublications = [[NSMutableData alloc] init];
+    [_pendingGroupPublications appendBytes:&group length:sizeof(group)];
+}
+
+- (void)markCallbackTableForPublication:(callback_table_t*)table {
+    if ( table->publishPending ) return;
+    table->publishPending = YES;
+    if ( !_pendingCallbackTablePublications ) _pendingCallbackTablePublications = [[NSMutableData alloc] init];
+    [_pendingCallbackTablePublications appendBytes:&table length:sizeof(table)];
+}
+
+- (void)markChannelForPublication:(AEChannelRef)channel {
+    if ( channel->publishPending ) return;
+    channel->publishPending = YES;
+    if ( !_pendingChannelPublications ) _pendingChannelPublications = [[NSMutableData alloc] init];
+    [_pendingChannelPublications appendBytes:&channel length:sizeof(channel)];
+}
+
+- (void)movePendingPublicationsFromInputTables:(input_callback_table_t*)oldTables count:(int)count toInputTables:(input_callback_table_t*)newTables {
+    // Input callback tables live in the array of input tables, so follow them when it's replaced
+    if ( oldTables == newTables ) return;
+    callback_table_t **tables = (callback_table_t**)_pendingCallbackTablePublications.mutableBytes;
+    int tableCount = (int)(_pendingCallbackTablePublications.length / sizeof(callback_table_t*));
+    for ( int i=0; i<tableCount; i++ ) {
+        for ( int j=0; j<count; j++ ) {
+            if ( tables[i] == &oldTables[j].callbacks ) {
+                tables[i] = &newTables[j].callbacks;
+                break;
+            }
+        }
+    }
+}
+
+- (void)performUpdateWithBlock:(void (^)())block completionBlock:(void (^)())completionBlock {
+    if ( block ) {
+        // Performed on the realtime thread after the tables are swapped in, in the order queued
+        void (^previousBlock)() = _pendingUpdateBlock;
+        _pendingUpdateBlock = previousBlock ? [^{ previousBlock(); block(); } copy] : [block copy];
+        [previousBlock release];
+    }
+    
+    if ( completionBlock ) {
+        // Performed on the main thread once rendering no longer sees what the update replaced
+        if ( !_pendingUpdateCompletions ) _pendingUpdateCompletions = [[NSMutableArray alloc] init];
+        void (^completion)() = [completionBlock copy];
+        [_pendingUpdateCompletions addObject:completion];
+        [completion release];
+    }
+    
+    [self publishUpdates];
+}
+
+- (void)releaseObjectWhenUpdatesPublished:(id)object {
+    if ( !object ) return;
+    [self performUpdateWithBlock:nil completionBlock:^{ [object release]; }];
+}
+
+- (void)publishUpdates {
+    if ( _updateBatchDepth > 0 || _holdingUpdates ) return;
+    [self publishPendingUpdates];
+}
+
+- (void)publishPendingUpdates {
+    int groupCount = (int)(_pendingGroupPublications.length / sizeof(AEChannelGroupRef));
+    int tableCount = (int)(_pendingCallbackTablePublications.length / sizeof(callback_table_t*));
+    int channelCount = (int)(_pendingChannelPublications.length / sizeof(AEChannelRef));
+    void (^updateBlock)() = _pendingUpdateBlock;
+    _pendingUpdateBlock = nil;
+    NSArray *completions = _pendingUpdateCompletions;
+    _pendingUpdateCompletions = nil;
+    
+    group_publication_t *groups = NULL;
+    callback_table_publication_t *tables = NULL;
+    channel_publication_t *channels = NULL;
+    
+    if ( groupCount > 0 || tableCount > 0 || channelCount > 0 || updateBlock ) {
+        // Prepare render copies of everything that's changed
+        groups = (group_publication_t*)calloc(MAX(groupCount, 1), sizeof(group_publication_t));
+        AEChannelGroupRef *pendingGroups = (AEChannelGroupRef*)_pendingGroupPublications.mutableBytes;
+        for ( int i=0; i<groupCount; i++ ) {
+            AEChannelGroupRef group = pendingGroups[i];
+            groups[i].group = group;
+            groups[i].channelCount = group->channelCount;
+            if ( group->channelCount > 0 ) {
+                groups[i].channels = (AEChannelRef*)malloc(group->channelCount * sizeof(AEChannelRef));
+                memcpy(groups[i].channels, group->channels, group->channelCount * sizeof(AEChannelRef));
+                groups[i].renderedInputs = (software_mixer_input_t**)calloc(group->channelCount, sizeof(software_mixer_input_t*));
+            }
+            group->publishPending = NO;
+        }
+        
+        tables = (callback_table_publication_t*)calloc(MAX(tableCount, 1), sizeof(callback_table_publication_t));
+        callback_table_t **pendingTables = (callback_table_t**)_pendingCallbackTablePublications.mutableBytes;
+        for ( int i=0; i<tableCount; i++ ) {
+            tables[i].table = pendingTables[i];
+            compileCallbackTable(pendingTables[i], &tables[i].compiled);
+            pendingTables[i]->publishPending = NO;
+        }
+        
+        channels = (channel_publication_t*)calloc(MAX(channelCount, 1), sizeof(channel_publication_t));
+        AEChannelRef *pendingChannels = (AEChannelRef*)_pendingChannelPublications.mutableBytes;
+        for ( int i=0; i<channelCount; i++ ) {
+            channels[i].channel = pendingChannels[i];
+            channels[i].sends = pendingChannels[i]->sends;
+            channels[i].sendCount = pendingChannels[i]->sendCount;
+            channels[i].delayLine = pendingChannels[i]->delayLine;
+            pendingChannels[i]->publishPending = NO;
+        }
+        
+        [_pendingGroupPublications setLength:0];
+        [_pendingCallbackTablePublications setLength:0];
+        [_pendingChannelPublications setLength:0];
+        
+        // Swap everything in at once, between render cycles, so the tables always agree with each other
+        [self performSynchronousMessageExchangeWithBlock:^{
+            for ( int i=0; i<groupCount; i++ ) {
+                group_publication_t *publication = &groups[i];
+                AEChannelRef *oldChannels = publication->group->renderChannels;
+                int oldChannelCount = publication->group->renderChannelCount;
+                software_mixer_input_t **oldRenderedInputs = publication->group->renderedInputs;
+                publication->group->renderChannels = publication->channels;
+                publication->group->renderChannelCount = publication->channelCount;
+                publication->group->renderedInputs = publication->renderedInputs;
+                publication->channels = oldChannels;
+                publication->channelCount = oldChannelCount;
+                publication->renderedInputs = oldRenderedInputs;
+            }
+            for ( int i=0; i<tableCount; i++ ) {
+                publishCallbackTable(tables[i].table, &tables[i].compiled);
+            }
+            for ( int i=0; i<channelCount; i++ ) {
+                publishChannel(&channels[i]);
+            }
+            if ( updateBlock ) updateBlock();
+        }];
+        
+        for ( int i=0; i<channelCount; i++ ) {
+            // Keep whatever the channel is still using
+            if ( channels[i].sends == channels[i].channel->renderSends ) channels[i].sends = NULL;
+            if ( channels[i].delayLine == channels[i].channel->renderDelayLine ) channels[i].delayLine = NULL;
+        }
+        
+        // Free the old render copies once the realtime thread is done with them
+        [self performBlockWhenRenderingComplete:^{
+            for ( int i=0; i<groupCount; i++ ) {
+                free(groups[i].channels);
+                free(groups[i].renderedInputs);
+            }
+            for ( int i=0; i<tableCount; i++ ) {
+                free(tables[i].compiled.renderCallbacks);
+            }
+            for ( int i=0; i<channelCount; i++ ) {
+                free(channels[i].sends);
+                if ( channels[i].delayLine ) delayLineDestroy(channels[i].delayLine);
+            }
+            free(groups);
+            free(tables);
+            free(channels);
+        }];
+        
+        [updateBlock release];
+        
+        if ( tableCount > 0 ) {
+            // Converters only needed by receivers that have now gone can go too
+            [self updateClientFormatConvertersForChannel:_topChannel];
+        }
+    }
+    
+    for ( void (^completion)() in completions ) {
+        [self performBlockWhenRenderingComplete:completion];
+    }
+    [completions release];
+}
+
 #pragma mark - Filters
 
 - (void)addFilter:(id<AEAudioFilter>)filter {
-    if ( [self addCallback:filter.filterCallback userInfo:filter flags:kFilterFlag forChannelGroup:_topGroup] ) {
-        [filter retain];
-    }
+    [self addFilter:filter toChannelGroup:_topGroup];
 }
 
 - (void)addFilter:(id<AEAudioFilter>)filter toChannel:(id<AEAudioPlayable>)channel {
+    int index;
+    AEChannelGroupRef group = [self searchForGroupContainingChannelMatchingPtr:channel.renderCallback userInfo:channel index:&index];
+    if ( group ) {
+        [self setClientFormat:group->channels[index]->audioDescription ofFilter:filter];
+    }
+    
     if ( [self addCallback:filter.filterCallback userInfo:filter flags:kFilterFlag forChannel:channel] ) {
         [filter retain];
     }
 }
 
 - (void)addFilter:(id<AEAudioFilter>)filter toChannelGroup:(AEChannelGroupRef)group {
+    [self setClientFormat:_busAudioDescription ofFilter:filter];
+    
     if ( [self addCallback:filter.filterCallback userInfo:filter flags:kFilterFlag forChannelGroup:group] ) {
         [filter retain];
     }
@@ -1232,6 +3438,22 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 }
 
 - (void)addInputFilter:(id<AEAudioFilter>)filter forChannels:(NSArray *)channels {
+    // Input audio arrives in the input table's format, or one with a channel for each selected input channel
+    AudioStreamBasicDescription inputFormat = _inputCallbacks[0].audioDescription.mSampleRate ? _inputCallbacks[0].audioDescription : _audioDescription;
+    if ( channels ) {
+        BOOL found = NO;
+        for ( int i=1; i<_inputCallbackCount; i++ ) {
+            if ( [_inputCallbacks[i].channelMap isEqualToArray:channels] && _inputCallbacks[i].audioDescription.mSampleRate ) {
+                inputFormat = _inputCallbacks[i].audioDescription;
+                found = YES;
+            }
+        }
+        if ( !found ) {
+            AEAudioStreamBasicDescriptionSetChannelsPerFrame(&inputFormat, (int)[channels count]);
+        }
+    }
+    [self setClientFormat:inputFormat ofFilter:filter];
+    
     void *callback = filter.filterCallback;
     if ( [self addCallback:callback userInfo:filter flags:kFilterFlag forInputChannels:channels] ) {
         [filter retain];
@@ -1240,33 +3462,33 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 
 - (void)removeFilter:(id<AEAudioFilter>)filter {
     if ( [self removeCallback:filter.filterCallback userInfo:filter fromChannelGroup:_topGroup] ) {
-        [filter release];
+        [self releaseObjectWhenUpdatesPublished:filter];
     }
 }
 
 - (void)removeFilter:(id<AEAudioFilter>)filter fromChannel:(id<AEAudioPlayable>)channel {
     if ( [self removeCallback:filter.filterCallback userInfo:filter fromChannel:channel] ) {
-        [filter release];
+        [self releaseObjectWhenUpdatesPublished:filter];
     }
 }
 
 - (void)removeFilter:(id<AEAudioFilter>)filter fromChannelGroup:(AEChannelGroupRef)group {
     if ( [self removeCallback:filter.filterCallback userInfo:filter fromChannelGroup:group] ) {
-        [filter release];
+        [self releaseObjectWhenUpdatesPublished:filter];
     }
 }
 
 - (void)removeInputFilter:(id<AEAudioFilter>)filter {
     void *callback = filter.filterCallback;
-    __block BOOL found = NO;
-    [self performSynchronousMessageExchangeWithBlock:^{
-        for ( int i=0; i<_inputCallbackCount; i++ ) {
-            removeCallbackFromTable(self, &_inputCallbacks[i].callbacks, callback, filter, &found);
-        }
-    }];
+    BOOL found = NO;
+    for ( int i=0; i<_inputCallbackCount; i++ ) {
+        removeCallbackFromTable(self, &_inputCallbacks[i].callbacks, callback, filter, &found);
+    }
+    
+    [self publishUpdates];
     
     if ( found ) {
-        [filter release];
+        [self releaseObjectWhenUpdatesPublished:filter];
     }
 }
 
@@ -1290,6 +3512,33 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
     return result;
 }
 
+- (void)setClientFormat:(AudioStreamBasicDescription)format ofFilter:(id<AEAudioFilter>)filter {
+    if ( !format.mSampleRate || ![filter respondsToSelector:@selector(setClientFormat:)] ) return;
+    
+    if ( [filter respondsToSelector:@selector(clientFormat)] ) {
+        AudioStreamBasicDescription currentFormat = filter.clientFormat;
+        if ( memcmp(&currentFormat, &format, sizeof(format)) == 0 ) return;
+    }
+    
+    filter.clientFormat = format;
+}
+
+- (void)setClientFormat:(AudioStreamBasicDescription)format ofFiltersInTable:(callback_table_t*)table {
+    for ( id<AEAudioFilter> filter in [self associatedObjectsFromTable:table matchingFlag:kFilterFlag] ) {
+        [self setClientFormat:format ofFilter:filter];
+    }
+}
+
+- (void)updateClientFormatOfFiltersInGroup:(AEChannelGroupRef)group {
+    [self setClientFormat:_busAudioDescription ofFiltersInTable:&group->channel->callbacks];
+    for ( int i=0; i<group->channelCount; i++ ) {
+        AEChannelRef channel = group->channels[i];
+        if ( channel && channel->type == kChannelTypeGroup ) {
+            [self updateClientFormatOfFiltersInGroup:(AEChannelGroupRef)channel->ptr];
+        }
+    }
+}
+
 #pragma mark - Output receivers
 
 - (void)addOutputReceiver:(id<AEAudioReceiver>)receiver {
@@ -1312,19 +3561,19 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 
 - (void)removeOutputReceiver:(id<AEAudioReceiver>)receiver {
     if ( [self removeCallback:receiver.receiverCallback userInfo:receiver fromChannelGroup:_topGroup] ) {
-        [receiver release];
+        [self releaseObjectWhenUpdatesPublished:receiver];
     }
 }
 
 - (void)removeOutputReceiver:(id<AEAudioReceiver>)receiver fromChannel:(id<AEAudioPlayable>)channel {
     if ( [self removeCallback:receiver.receiverCallback userInfo:receiver fromChannel:channel] ) {
-        [receiver release];
+        [self releaseObjectWhenUpdatesPublished:receiver];
     }
 }
 
 - (void)removeOutputReceiver:(id<AEAudioReceiver>)receiver fromChannelGroup:(AEChannelGroupRef)group {
     if ( [self removeCallback:receiver.receiverCallback userInfo:receiver fromChannelGroup:group] ) {
-        [receiver release];
+        [self releaseObjectWhenUpdatesPublished:receiver];
     }
 }
 
@@ -1356,15 +3605,15 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 
 - (void)removeInputReceiver:(id<AEAudioReceiver>)receiver {
     void *callback = receiver.receiverCallback;
-    __block BOOL found = NO;
-    [self performSynchronousMessageExchangeWithBlock:^{
-        for ( int i=0; i<_inputCallbackCount; i++ ) {
-            removeCallbackFromTable(self, &_inputCallbacks[i].callbacks, callback, receiver, &found);
-        }
-    }];
+    BOOL found = NO;
+    for ( int i=0; i<_inputCallbackCount; i++ ) {
+        removeCallbackFromTable(self, &_inputCallbacks[i].callbacks, callback, receiver, &found);
+    }
+    
+    [self publishUpdates];
     
     if ( found ) {
-        [receiver release];
+        [self releaseObjectWhenUpdatesPublished:receiver];
     }
 }
 
@@ -1379,28 +3628,21 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 #pragma mark - Timing receivers
 
 - (void)addTimingReceiver:(id<AEAudioTimingReceiver>)receiver {
-    if ( _timingCallbacks.count == kMaximumCallbacksPerSource ) {
-        NSLog(@"Warning: Maximum number of callbacks reached");
-        return;
-    }
-    
     [receiver retain];
     
-    void *callback = receiver.timingReceiverCallback;
-    [self performSynchronousMessageExchangeWithBlock:^{
-        addCallbackToTable(self, &_timingCallbacks, callback, receiver, 0);
-    }];
+    [self addCallback:receiver.timingReceiverCallback userInfo:receiver flags:0 toTable:&_timingCallbacks];
+    [self publishUpdates];
 }
 
 - (void)removeTimingReceiver:(id<AEAudioTimingReceiver>)receiver {
     void *callback = receiver.timingReceiverCallback;
-    __block BOOL found = NO;
-    [self performSynchronousMessageExchangeWithBlock:^{
-        removeCallbackFromTable(self, &_timingCallbacks, callback, receiver, &found);
-    }];
+    BOOL found = NO;
+    removeCallbackFromTable(self, &_timingCallbacks, callback, receiver, &found);
+    
+    [self publishUpdates];
     
     if ( found ) {
-        [receiver release];
+        [self releaseObjectWhenUpdatesPublished:receiver];
     }
 }
 
@@ -1410,6 +3652,30 @@ static OSStatus topRenderNotifyCallback(void *inRefCon, AudioUnitRenderActionFla
 
 #pragma mark - Main thread-realtime thread message sending
 
+static inline void signalMainThreadMessagePending(AEAudioController *THIS) {
+    // Only wake the poll thread for the first message since it last woke; it drains the whole queue
+    if ( OSAtomicCompareAndSwap32Barrier(NO, YES, &THIS->_mainThreadMessageSignalled) ) {
+        semaphore_signal(THIS->_mainThreadMessageSemaphore);
+    }
+}
+
+static void sendMessageResponse(AEAudioController *THIS, message_t *message) {
+    if ( message->responseSemaphore ) {
+        // Release the thread waiting in performSynchronousMessageExchangeWithBlock:
+        semaphore_signal(message->responseSemaphore);
+    }
+    
+    if ( message->responseBlock || message->timedBlock ) {
+        // Send the message back so the main thread can perform the response and release the blocks
+        message_t *reply = messageQueueReserve(&THIS->_mainThreadMessageQueue, sizeof(message_t));
+        assert(reply != NULL);
+        memcpy(reply, message, sizeof(message_t));
+        reply->sendTime = mach_absolute_time();
+        messageQueueCommit(&THIS->_mainThreadMessageQueue, reply);
+        signalMainThreadMessagePending(THIS);
+    }
+}
+
 static void processPendingMessagesOnRealtimeThread(AEAudioController *THIS) {
     // Only call this from the Core Audio thread, or the main thread if audio system is not yet running
     int32_t availableBytes;
@@ -1434,42 +3700,70 @@ static void processPendingMessagesOnRealtimeThread(AEAudioController *THIS) {
 #endif
         }
         
-        if ( message.responseBlock ) {
-            int32_t availableBytes;
-            message_t *reply = TPCircularBufferHead(&THIS->_mainThreadMessageBuffer, &availableBytes);
-            assert(availableBytes >= sizeof(message_t));
-            memcpy(reply, &message, sizeof(message_t));
-            TPCircularBufferProduce(&THIS->_mainThreadMessageBuffer, sizeof(message_t));
+        if ( message.timedBlock ) {
+            if ( THIS->_running && THIS->_timedMessageCount < kMaximumTimedMessages ) {
+                // Hold on to it until the render cycle containing its target time
+                THIS->_timedMessages[THIS->_timedMessageCount++] = message;
+                messagePtr++;
+                continue;
+            }
+            
+#ifdef DEBUG
+            if ( THIS->_running ) printf("Warning: Too many timed messages pending; performing immediately\n");
+#endif
+            message.timedBlock(0);
+        }
+        
+        sendMessageResponse(THIS, &message);
+        
+        messagePtr++;
+    }
+}
+
+static BOOL frameOffsetForTime(const AudioTimeStamp *target, const AudioTimeStamp *bufferTime, UInt32 frames, double sampleRate, UInt32 *outOffset) {
+    double offset;
+    if ( (target->mFlags & kAudioTimeStampHostTimeValid) && (bufferTime->mFlags & kAudioTimeStampHostTimeValid) ) {
+        offset = (double)(int64_t)(target->mHostTime - bufferTime->mHostTime) * __hostTicksToSeconds * sampleRate;
+    } else if ( (target->mFlags & kAudioTimeStampSampleTimeValid) && (bufferTime->mFlags & kAudioTimeStampSampleTimeValid) ) {
+        offset = target->mSampleTime - bufferTime->mSampleTime;
+    } else {
+        offset = 0;
+    }
+    
+    if ( offset >= frames ) return NO;
+    *outOffset = offset < 0 ? 0 : (UInt32)offset;
+    return YES;
+}
+
+static void processTimedMessagesOnRealtimeThread(AEAudioController *THIS, const AudioTimeStamp *time, UInt32 frames) {
+    int remaining = 0;
+    for ( int i=0; i<THIS->_timedMessageCount; i++ ) {
+        message_t *message = &THIS->_timedMessages[i];
+        UInt32 offset;
+        if ( frameOffsetForTime(&message->targetTime, time, frames, THIS->_audioDescription.mSampleRate, &offset) ) {
+            message->timedBlock(offset);
+            sendMessageResponse(THIS, message);
+        } else {
+            // Not yet; keep it, preserving order
+            THIS->_timedMessages[remaining++] = *message;
         }
-        
-        messagePtr++;
     }
+    THIS->_timedMessageCount = remaining;
 }
 
 -(void)pollForMessageResponses {
-    pthread_t thread = pthread_self();
-    while ( 1 ) {
-        message_t *message = NULL;
-        @synchronized ( self ) {
-            int32_t availableBytes;
-            message_t *buffer = TPCircularBufferTail(&_mainThreadMessageBuffer, &availableBytes);
-            if ( !buffer ) break;
-            
-            if ( buffer->sourceThread && buffer->sourceThread != thread ) break;
-            
-            int messageLength = sizeof(message_t) + (buffer->userInfoLength && !buffer->userInfoByReference ? buffer->userInfoLength : 0);
-            message = malloc(messageLength);
-            memcpy(message, buffer, messageLength);
-            
-            TPCircularBufferConsume(&_mainThreadMessageBuffer, messageLength);
-            
-            _pendingResponses--;
-            
-            if ( _pollThread && _pendingResponses == 0 ) {
-                _pollThread.pollInterval = kIdleMessagingPollDuration;
-            }
-        }
+    // Only call this from the main thread; it's the sole consumer of the main thread message queue
+    if ( _pollingForMessageResponses ) {
+        // A handler has led back here; the outer loop will pick up any remaining messages
+        return;
+    }
+    _pollingForMessageResponses = YES;
+    
+    message_t *message;
+    while ( (message = messageQueueNext(&_mainThreadMessageQueue)) ) {
+        uint64_t latency = mach_absolute_time() - message->sendTime;
         
+        // Perform the message in place; the record stays reserved until we consume it below
         if ( message->responseBlock ) {
             message->responseBlock();
             [message->responseBlock release];
@@ -1485,81 +3779,297 @@ static void processPendingMessagesOnRealtimeThread(AEAudioController *THIS) {
             [message->block release];
         }
         
-        free(message);
+        if ( message->timedBlock ) {
+            [message->timedBlock release];
+        }
+        
+        @synchronized ( self ) {
+            messageQueueConsume(&_mainThreadMessageQueue);
+            
+            _mainThreadMessageLatencyTotal += latency;
+            _mainThreadMessageLatencyMaximum = MAX(_mainThreadMessageLatencyMaximum, latency);
+            _mainThreadMessageLatencyCount++;
+        }
+    }
+    
+    _pollingForMessageResponses = NO;
+}
+
+- (void)publishMessageToRealtimeThread:(message_t*)message {
+    // Must be called within @synchronized ( self )
+    uint64_t waitStart = 0;
+    int32_t availableBytes;
+    message_t *head;
+    while ( !(head = TPCircularBufferHead(&_realtimeThreadMessageBuffer, &availableBytes)) || availableBytes < (int32_t)sizeof(message_t) ) {
+        // Buffer is full: wait for the realtime thread to make room, or make it ourselves if it's not around
+        if ( !waitStart ) waitStart = mach_absolute_time();
+        if ( !self.running || (_offline && !_offlineRenderInProgress) || (mach_absolute_time() - waitStart) * __hostTicksToSeconds > _synchronousMessageExchangeTimeout ) {
+            if ( self.running ) NSLog(@"TAAE: Timed out waiting for room in the message buffer");
+            processPendingMessagesOnRealtimeThread(self);
+            waitStart = 0;
+        } else {
+            [NSThread sleepForTimeInterval:0.001];
+        }
+    }
+    
+    memcpy(head, message, sizeof(message_t));
+    TPCircularBufferProduce(&_realtimeThreadMessageBuffer, sizeof(message_t));
+    
+    if ( _offline && self.running && !_offlineRenderInProgress ) {
+        // Offline, messages are otherwise only performed within renderOfflineFrames:intoBufferList:atTime:, so
+        // perform them now. Rendering can't start meanwhile, as it waits on the lock we hold.
+        processPendingMessagesOnRealtimeThread(self);
+    } else if ( !self.running ) {
+        if ( [NSThread isMainThread] ) {
+            processPendingMessagesOnRealtimeThread(self);
+            [self pollForMessageResponses];
+        } else {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                processPendingMessagesOnRealtimeThread(self);
+                [self pollForMessageResponses];
+            });
+        }
+    }
+}
+
+- (void)publishMessageExchangeTransactionWithResponseSemaphore:(semaphore_t)responseSemaphore {
+    // Must be called within @synchronized ( self )
+    if ( _transactionBlockCount == 0 && [_transactionResponseBlocks count] == 0 && !responseSemaphore ) return;
+    
+    // The whole transaction goes as one message, so it's performed in one go whatever its size
+    void (^*blocks)() = _transactionBlocks;
+    int blockCount = _transactionBlockCount;
+    NSArray *responseBlocks = _transactionResponseBlocks;
+    _transactionBlocks = NULL;
+    _transactionBlockCount = 0;
+    _transactionBlockCapacity = 0;
+    _transactionResponseBlocks = nil;
+    
+    message_t message;
+    memset(&message, 0, sizeof(message_t));
+    message.block = [^{
+        for ( int i=0; i<blockCount; i++ ) {
+            blocks[i]();
+        }
+    } copy];
+    message.responseBlock = [^{
+        // Performed on the main thread once the realtime thread is done with the blocks
+        for ( int i=0; i<blockCount; i++ ) {
+            [blocks[i] release];
+        }
+        free(blocks);
+        for ( void (^responseBlock)() in responseBlocks ) {
+            responseBlock();
+        }
+        [responseBlocks release];
+    } copy];
+    message.responseSemaphore = responseSemaphore;
+    
+    [self publishMessageToRealtimeThread:&message];
+}
+
+- (void)beginMessageExchangeTransaction {
+    @synchronized ( self ) {
+        NSAssert(_transactionDepth == 0 || pthread_equal(_transactionThread, pthread_self()), @"Message exchange transaction already in progress on another thread");
+        if ( _transactionDepth++ == 0 ) {
+            _transactionThread = pthread_self();
+        }
+    }
+}
+
+- (void)commitMessageExchangeTransaction {
+    @synchronized ( self ) {
+        NSAssert(_transactionDepth > 0, @"No message exchange transaction in progress");
+        if ( --_transactionDepth == 0 ) {
+            [self publishMessageExchangeTransactionWithResponseSemaphore:0];
+        }
     }
 }
 
 - (void)performAsynchronousMessageExchangeWithBlock:(void (^)())block
                                       responseBlock:(void (^)())responseBlock
-                                       sourceThread:(pthread_t)sourceThread {
+                                  responseSemaphore:(semaphore_t)responseSemaphore {
     @synchronized ( self ) {
         if ( block ) {
             block = [block copy];
         }
         if ( responseBlock ) {
             responseBlock = [responseBlock copy];
-            _pendingResponses++;
-            
-            if ( self.running && _pollThread.pollInterval == kIdleMessagingPollDuration ) {
-                // Perform more rapid active polling while we expect a response
-                _pollThread.pollInterval = _preferredBufferDuration ? _preferredBufferDuration : 0.01;
-            }
         }
         
-        int32_t availableBytes;
-        message_t *message = TPCircularBufferHead(&_realtimeThreadMessageBuffer, &availableBytes);
-        assert(availableBytes >= sizeof(message_t));
-        memset(message, 0, sizeof(message_t));
-        message->block         = block;
-        message->responseBlock = responseBlock;
-        message->sourceThread  = sourceThread;
-        
-        TPCircularBufferProduce(&_realtimeThreadMessageBuffer, sizeof(message_t));
+        message_t message;
+        memset(&message, 0, sizeof(message_t));
+        message.block             = block;
+        message.responseBlock     = responseBlock;
+        message.responseSemaphore = responseSemaphore;
         
-        if ( !self.running ) {
-            if ( [NSThread isMainThread] ) {
-                processPendingMessagesOnRealtimeThread(self);
-                [self pollForMessageResponses];
-            } else {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    processPendingMessagesOnRealtimeThread(self);
-                    [self pollForMessageResponses];
-                });
+        if ( _transactionDepth > 0 && pthread_equal(_transactionThread, pthread_self()) ) {
+            // Add to the current transaction
+            if ( block ) {
+                if ( _transactionBlockCount == _transactionBlockCapacity ) {
+                    _transactionBlockCapacity = _transactionBlockCapacity ? _transactionBlockCapacity*2 : 16;
+                    _transactionBlocks = realloc(_transactionBlocks, sizeof(*_transactionBlocks) * _transactionBlockCapacity);
+                }
+                _transactionBlocks[_transactionBlockCount++] = block;
+            }
+            if ( responseBlock ) {
+                if ( !_transactionResponseBlocks ) _transactionResponseBlocks = [[NSMutableArray alloc] init];
+                [_transactionResponseBlocks addObject:responseBlock];
+                [responseBlock release];
+            }
+            
+            if ( responseSemaphore ) {
+                // Synchronous exchange: the caller is about to wait, so publish what we have now, along with it
+                [self publishMessageExchangeTransactionWithResponseSemaphore:responseSemaphore];
             }
+            return;
         }
+        
+        [self publishMessageToRealtimeThread:&message];
     }
 }
 
 - (void)performAsynchronousMessageExchangeWithBlock:(void (^)())block responseBlock:(void (^)())responseBlock {
-    [self performAsynchronousMessageExchangeWithBlock:block responseBlock:responseBlock sourceThread:NULL];
+    [self performAsynchronousMessageExchangeWithBlock:block responseBlock:responseBlock responseSemaphore:0];
 }
 
-- (void)performSynchronousMessageExchangeWithBlock:(void (^)())block {
-    __block BOOL finished = NO;
-    [self performAsynchronousMessageExchangeWithBlock:block
-                                        responseBlock:^{ finished = YES; }
-                                         sourceThread:pthread_self()];
-    
-    // Wait for response
-    uint64_t giveUpTime = mach_absolute_time() + (1.0 * __secondsToHostTicks);
-    while ( !finished && mach_absolute_time() < giveUpTime ) {
-        if ( [NSThread isMainThread] ) {
-            [self pollForMessageResponses];
-        } else {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                [self pollForMessageResponses];
-            });
+- (void)performAsynchronousMessageExchangeWithTimedBlock:(AEAudioControllerTimedMessageBlock)block
+                                                  atTime:(const AudioTimeStamp*)time
+                                           responseBlock:(void (^)())responseBlock {
+    NSParameterAssert(block && time);
+    @synchronized ( self ) {
+        message_t message;
+        memset(&message, 0, sizeof(message_t));
+        message.timedBlock    = [block copy];
+        message.targetTime    = *time;
+        message.responseBlock = responseBlock ? [responseBlock copy] : nil;
+        [self publishMessageToRealtimeThread:&message];
+    }
+}
+
+static BOOL findChannel(AEChannelGroupRef group, void *ptr, void *object, AEChannelGroupRef *outGroup, int *outIndex) {
+    // Realtime-safe equivalent of searchForGroupContainingChannelMatchingPtr:userInfo:index:
+    for ( int i=0; i < group->renderChannelCount; i++ ) {
+        AEChannelRef channel = group->renderChannels[i];
+        if ( !channel ) continue;
+        if ( channel->ptr == ptr && channel->object == object ) {
+            *outGroup = group;
+            *outIndex = i;
+            return YES;
+        }
+        if ( channel->type == kChannelTypeGroup && findChannel((AEChannelGroupRef)channel->ptr, ptr, object, outGroup, outIndex) ) {
+            return YES;
         }
-        if ( finished ) break;
-        [NSThread sleepForTimeInterval:_preferredBufferDuration ? _preferredBufferDuration : 0.01];
     }
+    return NO;
+}
+
+- (void)setMixerParameter:(AudioUnitParameterID)parameter value:(AudioUnitParameterValue)value forChannel:(id<AEAudioPlayable>)channel atTime:(const AudioTimeStamp*)time {
+    void *ptr = channel.renderCallback;
+    void *object = channel; // Identity only; don't retain
+    [self performAsynchronousMessageExchangeWithTimedBlock:^(UInt32 frameOffset) {
+        // Look the channel up now, in case the graph has changed since this was sent
+        AEChannelGroupRef group;
+        int index;
+        if ( !findChannel(_topGroup, ptr, object, &group, &index) ) return;
+        
+        if ( group->softwareMixing ) {
+            // The software mixer holds the old gains until the offset, then steps to the new ones
+            AEChannelRef channelElement = group->renderChannels[index];
+            switch ( parameter ) {
+                case kMultiChannelMixerParam_Volume: channelElement->volume = value; channelElement->volumeRamp.remainingFrames = 0; break;
+                case kMultiChannelMixerParam_Pan: channelElement->pan = value; channelElement->panRamp.remainingFrames = 0; break;
+                case kMultiChannelMixerParam_Enable: channelElement->muted = !value; break;
+                default: return;
+            }
+            channelElement->stepOffset = frameOffset;
+            channelElement->stepPending = YES;
+            return;
+        }
+        
+        if ( !group->mixerAudioUnit ) return;
+        
+        AudioUnitParameterEvent event = {
+            .scope          = kAudioUnitScope_Input,
+            .element        = index,
+            .parameter      = parameter,
+            .eventType      = kParameterEvent_Immediate,
+            .eventValues.immediate = { .bufferOffset = frameOffset, .value = value }
+        };
+        AudioUnitScheduleParameters(group->mixerAudioUnit, &event, 1);
+    } atTime:time responseBlock:nil];
+}
+
+- (void)setVolume:(float)volume forChannel:(id<AEAudioPlayable>)channel rampDuration:(NSTimeInterval)duration curve:(AERampCurve)curve {
+    [self rampParameter:kMultiChannelMixerParam_Volume ofChannelMatchingPtr:channel.renderCallback object:channel to:volume duration:duration exponential:curve == AERampCurveExponential];
+}
+
+- (void)setPan:(float)pan forChannel:(id<AEAudioPlayable>)channel rampDuration:(NSTimeInterval)duration {
+    [self rampParameter:kMultiChannelMixerParam_Pan ofChannelMatchingPtr:channel.renderCallback object:channel to:pan duration:duration exponential:NO];
+}
+
+- (void)rampParameter:(AudioUnitParameterID)parameter ofChannelMatchingPtr:(void*)ptr object:(void*)object to:(float)target duration:(NSTimeInterval)duration exponential:(BOOL)exponential {
+    UInt32 frames = (UInt32)round(MAX(duration, 0) * _audioDescription.mSampleRate);
+    [self performAsynchronousMessageExchangeWithBlock:^{
+        // Look the channel up now, in case the graph has changed since this was sent
+        AEChannelGroupRef group;
+        int index;
+        if ( !findChannel(_topGroup, ptr, object, &group, &index) ) return;
+        
+        AEChannelRef channelElement = group->renderChannels[index];
+        if ( parameter == kMultiChannelMixerParam_Volume ) {
+            parameterRampStart(&channelElement->volumeRamp, &channelElement->volume, target, frames, exponential);
+        } else {
+            parameterRampStart(&channelElement->panRamp, &channelElement->pan, target, frames, NO);
+        }
+    } responseBlock:nil];
+}
+
+- (void)performSynchronousMessageExchangeWithBlock:(void (^)())block {
+    semaphore_t semaphore;
+    if ( !checkResult(semaphore_create(mach_task_self(), &semaphore, SYNC_POLICY_FIFO, 0), "semaphore_create") ) return;
+    
+    uint64_t start = mach_absolute_time();
+    [self performAsynchronousMessageExchangeWithBlock:block responseBlock:nil responseSemaphore:semaphore];
+    
+    // Wait for the realtime thread to perform the block. An interrupted wait (KERN_ABORTED) says nothing about
+    // the block, so keep waiting out the remainder of the timeout
+    uint64_t deadline = start + (uint64_t)(_synchronousMessageExchangeTimeout * __secondsToHostTicks);
+    kern_return_t result;
+    do {
+        uint64_t now = mach_absolute_time();
+        double remaining = now < deadline ? (deadline - now) * __hostTicksToSeconds : 0.0;
+        mach_timespec_t timeout = { .tv_sec = (unsigned int)remaining,
+                                    .tv_nsec = (clock_res_t)((remaining - floor(remaining)) * 1.0e9) };
+        result = semaphore_timedwait(semaphore, timeout);
+    } while ( result == KERN_ABORTED );
     
-    if ( !finished ) {
+    if ( result == KERN_OPERATION_TIMED_OUT ) {
         NSLog(@"TAAE: Timed out while performing message exchange");
         @synchronized ( self ) {
             processPendingMessagesOnRealtimeThread(self);
-            [self pollForMessageResponses];
         }
+        // The block has now been performed by one thread or the other; don't destroy the semaphore until it's been signalled
+        while ( semaphore_wait(semaphore) == KERN_ABORTED );
+    } else {
+        uint64_t latency = mach_absolute_time() - start;
+        @synchronized ( self ) {
+            _synchronousMessageExchangeLatencyTotal += latency;
+            _synchronousMessageExchangeLatencyMaximum = MAX(_synchronousMessageExchangeLatencyMaximum, latency);
+            _synchronousMessageExchangeLatencyCount++;
+        }
+    }
+    
+    semaphore_destroy(mach_task_self(), semaphore);
+}
+
+- (void)synchronousMessageExchangeLatencyAverage:(NSTimeInterval*)average maximum:(NSTimeInterval*)maximum {
+    @synchronized ( self ) {
+        if ( average ) *average = _synchronousMessageExchangeLatencyCount ? ((double)_synchronousMessageExchangeLatencyTotal / _synchronousMessageExchangeLatencyCount) * __hostTicksToSeconds : 0.0;
+        if ( maximum ) *maximum = _synchronousMessageExchangeLatencyMaximum * __hostTicksToSeconds;
+        _synchronousMessageExchangeLatencyTotal = 0;
+        _synchronousMessageExchangeLatencyMaximum = 0;
+        _synchronousMessageExchangeLatencyCount = 0;
     }
 }
 
@@ -1568,23 +4078,117 @@ void AEAudioControllerSendAsynchronousMessageToMainThread(AEAudioController
                                                           void                              *userInfo,
                                                           int                                userInfoLength) {
     
-    int32_t availableBytes;
-    message_t *message = TPCircularBufferHead(&THIS->_mainThreadMessageBuffer, &availableBytes);
-    assert(availableBytes >= sizeof(message_t) + userInfoLength);
+    // May be called concurrently from the output and input threads, so space is reserved, not just written
+    message_t *message = messageQueueReserve(&THIS->_mainThreadMessageQueue, sizeof(message_t) + userInfoLength);
+    assert(message != NULL);
+    if ( !message ) return;
+    
     memset(message, 0, sizeof(message_t));
     message->handler                = handler;
     message->userInfoLength         = userInfoLength;
+    message->sendTime               = mach_absolute_time();
     
     if ( userInfoLength > 0 ) {
         memcpy((message+1), userInfo, userInfoLength);
     }
     
-    TPCircularBufferProduce(&THIS->_mainThreadMessageBuffer, sizeof(message_t) + userInfoLength);
+    messageQueueCommit(&THIS->_mainThreadMessageQueue, message);
+    signalMainThreadMessagePending(THIS);
 }
 
 static BOOL AEAudioControllerHasPendingMainThreadMessages(AEAudioController *THIS) {
-    int32_t ignore;
-    return TPCircularBufferTail(&THIS->_mainThreadMessageBuffer, &ignore) != NULL;
+    return messageQueueNext(&THIS->_mainThreadMessageQueue) != NULL;
+}
+
+static void AEAudioControllerWaitForMainThreadMessages(AEAudioController *THIS) {
+    if ( THIS->_retiredItemCount > 0 ) {
+        // Come back after the next render cycle or so to release retired items
+        NSTimeInterval interval = THIS->_preferredBufferDuration ? THIS->_preferredBufferDuration : 0.01;
+        mach_timespec_t timeout = { .tv_sec = 0, .tv_nsec = (clock_res_t)(interval * 1.0e9) };
+        semaphore_timedwait(THIS->_mainThreadMessageSemaphore, timeout);
+    } else {
+        semaphore_wait(THIS->_mainThreadMessageSemaphore);
+    }
+    THIS->_mainThreadMessageSignalled = NO;
+    OSMemoryBarrier();
+}
+
+- (void)mainThreadMessageLatencyAverage:(NSTimeInterval*)average maximum:(NSTimeInterval*)maximum {
+    @synchronized ( self ) {
+        if ( average ) *average = _mainThreadMessageLatencyCount ? ((double)_mainThreadMessageLatencyTotal / _mainThreadMessageLatencyCount) * __hostTicksToSeconds : 0.0;
+        if ( maximum ) *maximum = _mainThreadMessageLatencyMaximum * __hostTicksToSeconds;
+        _mainThreadMessageLatencyTotal = 0;
+        _mainThreadMessageLatencyMaximum = 0;
+        _mainThreadMessageLatencyCount = 0;
+    }
+}
+
+-(NSUInteger)mainThreadMessageRetryCount {
+    return _mainThreadMessageQueue.retryCount;
+}
+
+#pragma mark - Deferred release
+
+- (void)releaseObjectWhenRenderingComplete:(id)object {
+    if ( !object ) return;
+    [self performBlockWhenRenderingComplete:^{ [object release]; }];
+}
+
+- (void)performBlockWhenRenderingComplete:(void (^)())block {
+    if ( !_running ) {
+        // Nothing can be rendering
+        block();
+        return;
+    }
+    
+    @synchronized ( self ) {
+        if ( _retiredItemCount == _retiredItemCapacity ) {
+            _retiredItemCapacity = _retiredItemCapacity ? _retiredItemCapacity*2 : 16;
+            _retiredItems = realloc(_retiredItems, sizeof(retired_item_t) * _retiredItemCapacity);
+        }
+        
+        // Any render cycle that could still see the old value will have finished once the epoch moves on
+        OSMemoryBarrier();
+        _retiredItems[_retiredItemCount].releaseBlock = [block copy];
+        _retiredItems[_retiredItemCount].renderEpoch = _renderEpoch;
+        _retiredItemCount++;
+    }
+    
+    // Make sure the poll thread is on the lookout
+    signalMainThreadMessagePending(self);
+}
+
+static void AEAudioControllerReleaseRetiredItems(AEAudioController *THIS) {
+    retired_item_t *items = NULL;
+    int count = 0;
+    
+    @synchronized ( THIS ) {
+        if ( THIS->_retiredItemCount == 0 ) return;
+        
+        // Items are in epoch order, so take everything up to the first that may still be in use
+        if ( !THIS->_running || (THIS->_offline && !THIS->_offlineRenderInProgress) ) {
+            count = THIS->_retiredItemCount;
+        } else {
+            int32_t epoch = THIS->_renderEpoch;
+            while ( count < THIS->_retiredItemCount && epoch - THIS->_retiredItems[count].renderEpoch > 0 ) {
+                count++;
+            }
+        }
+        
+        if ( count == 0 ) return;
+        
+        items = malloc(sizeof(retired_item_t) * count);
+        memcpy(items, THIS->_retiredItems, sizeof(retired_item_t) * count);
+        memmove(THIS->_retiredItems, THIS->_retiredItems + count, sizeof(retired_item_t) * (THIS->_retiredItemCount - count));
+        THIS->_retiredItemCount -= count;
+    }
+    
+    // Release outside the lock, so we don't hold up any message exchanges
+    for ( int i=0; i<count; i++ ) {
+        items[i].releaseBlock();
+        [items[i].releaseBlock release];
+    }
+    free(items);
 }
 
 #pragma mark - Metering
@@ -1600,7 +4204,6 @@ static BOOL AEAudioControllerHasPendingMainThreadMessages(AEAudioController *THI
         } else {
             group->level_monitor_data.channels = group->channel->audioDescription.mChannelsPerFrame;
             group->level_monitor_data.floatConverter = [[AEFloatConverter alloc] initWithSourceFormat:group->channel->audioDescription];
-            group->level_monitor_data.scratchBuffer = AEAllocateAndInitAudioBufferList(group->level_monitor_data.floatConverter.floatingPointAudioDescription, kLevelMonitorScratchBufferSize);
             OSMemoryBarrier();
             group->level_monitor_data.monitoringEnabled = YES;
             
@@ -1626,7 +4229,6 @@ static BOOL AEAudioControllerHasPendingMainThreadMessages(AEAudioController *THI
     if ( !_inputLevelMonitorData.monitoringEnabled ) {
         _inputLevelMonitorData.channels = _rawInputAudioDescription.mChannelsPerFrame;
         _inputLevelMonitorData.floatConverter = [[AEFloatConverter alloc] initWithSourceFormat:_rawInputAudioDescription];
-        _inputLevelMonitorData.scratchBuffer = AEAllocateAndInitAudioBufferList(_inputLevelMonitorData.floatConverter.floatingPointAudioDescription, kLevelMonitorScratchBufferSize);
         OSMemoryBarrier();
         _inputLevelMonitorData.monitoringEnabled = YES;
     }
@@ -1637,12 +4239,128 @@ static BOOL AEAudioControllerHasPendingMainThreadMessages(AEAudioController *THI
     _inputLevelMonitorData.reset = YES;
 }
 
+#pragma mark - Profiling
+
+- (NSArray*)renderProfile {
+    NSMutableArray *result = [NSMutableArray array];
+    if ( _topChannel ) [self addRenderProfileEntriesForChannel:_topChannel toArray:result];
+    for ( int i=0; i<_inputCallbackCount; i++ ) {
+        [self addRenderProfileEntriesForTable:&_inputCallbacks[i].callbacks toArray:result];
+    }
+    return result;
+}
+
+- (void)addRenderProfileEntriesForChannel:(AEChannelRef)channel toArray:(NSMutableArray*)array {
+    if ( channel->type == kChannelTypeGroup ) {
+        AEChannelGroupRef group = (AEChannelGroupRef)channel->ptr;
+        [array addObject:[self renderProfileEntryForNode:[NSValue valueWithPointer:group] type:AERenderProfileNodeTypeChannelGroup profile:&channel->renderProfile]];
+        [self addRenderProfileEntriesForTable:&channel->callbacks toArray:array];
+        for ( int i=0; i<group->channelCount; i++ ) {
+            if ( group->channels[i] ) [self addRenderProfileEntriesForChannel:group->channels[i] toArray:array];
+        }
+    } else {
+        [array addObject:[self renderProfileEntryForNode:(id)channel->object type:AERenderProfileNodeTypeChannel profile:&channel->renderProfile]];
+        [self addRenderProfileEntriesForTable:&channel->callbacks toArray:array];
+    }
+}
+
+- (void)addRenderProfileEntriesForTable:(callback_table_t*)table toArray:(NSMutableArray*)array {
+    // Profiles are kept alongside the copy of the table the realtime thread uses
+    for ( int i=0; i<table->renderCount; i++ ) {
+        callback_t *callback = &table->renderCallbacks[i];
+        AERenderProfileNodeType type = callback->flags & kFilterFlag ? AERenderProfileNodeTypeFilter : AERenderProfileNodeTypeReceiver;
+        [array addObject:[self renderProfileEntryForNode:(id)callback->userInfo type:type profile:&table->profiles[i]]];
+    }
+}
+
+- (NSDictionary*)renderProfileEntryForNode:(id)node type:(AERenderProfileNodeType)type profile:(render_profile_t*)profile {
+    double averageLoad = 0.0;
+    if ( profile->totalFrames > 0 && !profile->reset ) {
+        double seconds = profile->totalTicks * __hostTicksToSeconds;
+        averageLoad = seconds / (profile->totalFrames / _audioDescription.mSampleRate);
+    }
+    
+    NSMutableArray *histogram = [NSMutableArray arrayWithCapacity:AERenderProfileHistogramBucketCount];
+    for ( int i=0; i<AERenderProfileHistogramBucketCount; i++ ) {
+        [histogram addObject:[NSNumber numberWithUnsignedInt:profile->reset ? 0 : profile->histogram[i]]];
+    }
+    
+    NSDictionary *entry = [NSDictionary dictionaryWithObjectsAndKeys:
+                           node, AERenderProfileNodeKey,
+                           [NSNumber numberWithInt:type], AERenderProfileNodeTypeKey,
+                           [NSNumber numberWithDouble:averageLoad * 100.0], AERenderProfileAverageLoadKey,
+                           [NSNumber numberWithDouble:profile->reset ? 0.0 : profile->peakLoad * 100.0], AERenderProfilePeakLoadKey,
+                           histogram, AERenderProfileHistogramKey,
+                           nil];
+    
+    profile->reset = YES;
+    return entry;
+}
+
+- (NSUInteger)drainRenderEvents:(AERenderEvent*)events maxCount:(NSUInteger)maxCount statistics:(AERenderStatistics*)statistics {
+    NSUInteger count = 0;
+    while ( 1 ) {
+        int32_t writeIndex = _renderEventWriteIndex;
+        if ( writeIndex - _renderEventReadIndex > kRenderEventLogLength ) {
+            // The log wrapped around: skip to the oldest entry still in it
+            _renderEventsDropped += (writeIndex - kRenderEventLogLength) - _renderEventReadIndex;
+            _renderEventReadIndex = writeIndex - kRenderEventLogLength;
+        }
+        if ( _renderEventReadIndex == writeIndex || (events && count == maxCount) ) break;
+        
+        render_event_entry_t *entry = &_renderEventLog[_renderEventReadIndex & (kRenderEventLogLength-1)];
+        if ( entry->sequence != _renderEventReadIndex + 1 ) {
+            if ( entry->sequence == 0 || entry->sequence - (_renderEventReadIndex + 1) < 0 ) break; // Still being written
+            continue; // Overwritten since: go round again to skip ahead
+        }
+        
+        OSMemoryBarrier();
+        AERenderEvent event = entry->event;
+        OSMemoryBarrier();
+        if ( entry->sequence != _renderEventReadIndex + 1 ) continue; // Overwritten while we read it
+        
+        if ( events ) events[count++] = event;
+        _renderEventReadIndex++;
+    }
+    
+    if ( statistics ) {
+        memset(statistics, 0, sizeof(AERenderStatistics));
+        render_timing_monitor_t *monitors[] = { &_outputTimingMonitor, &_inputTimingMonitor };
+        double jitterAccumulator = 0;
+        UInt32 jitterCount = 0;
+        for ( int i=0; i<2; i++ ) {
+            render_timing_monitor_t *monitor = monitors[i];
+            if ( monitor->reset ) continue;
+            statistics->cycles += monitor->cycles;
+            statistics->overruns += monitor->overruns;
+            statistics->discontinuities += monitor->discontinuities;
+            statistics->lateCallbacks += monitor->lateCallbacks;
+            jitterAccumulator += monitor->jitterAccumulator;
+            jitterCount += monitor->cycles;
+            statistics->maxJitter = MAX(statistics->maxJitter, monitor->maxJitter);
+            statistics->maxProcessingTime = MAX(statistics->maxProcessingTime, monitor->maxProcessingTime);
+        }
+        statistics->meanJitter = jitterCount > 0 ? jitterAccumulator / jitterCount : 0;
+        statistics->droppedEvents = _renderEventsDropped;
+    }
+    
+    _outputTimingMonitor.reset = YES;
+    _inputTimingMonitor.reset = YES;
+    _renderEventsDropped = 0;
+    
+    return count;
+}
+
 #pragma mark - Utilities
 
 AudioStreamBasicDescription *AEAudioControllerAudioDescription(AEAudioController *THIS) {
     return &THIS->_audioDescription;
 }
 
+AudioStreamBasicDescription *AEAudioControllerBusAudioDescription(AEAudioController *THIS) {
+    return &THIS->_busAudioDescription;
+}
+
 AudioStreamBasicDescription *AEAudioControllerInputAudioDescription(AEAudioController *THIS) {
     return &THIS->_inputCallbacks[0].audioDescription;
 }
@@ -1655,6 +4373,19 @@ NSTimeInterval AEConvertFramesToSeconds(AEAudioController *THIS, long frames) {
     return (double)frames / THIS->_audioDescription.mSampleRate;
 }
 
+BOOL AEAudioControllerGetScratchBuffers(AEAudioController *THIS, int channels, UInt32 frames, float **buffers) {
+    // Filters run one at a time on each thread, so they share the scratch slot at the top of the thread's lane
+    render_buffer_pool_t *pool = THIS->_renderBufferPool;
+    char *slot = renderBufferLaneSlot(pool, renderBufferPoolCurrentLane(pool));
+    size_t stride = renderBufferAlign(frames * sizeof(float));
+    if ( !slot || channels * stride > pool->slotSize ) return NO;
+    
+    for ( int i=0; i<channels; i++ ) {
+        buffers[i] = (float*)(slot + i * stride);
+    }
+    return YES;
+}
+
 #pragma mark - Setters, getters
 
 -(void)setAudioSessionCategory:(UInt32)audioSessionCategory {
@@ -1848,6 +4579,15 @@ NSTimeInterval AEAudioControllerInputLatency(AEAudioController *controller) {
     return AEAudioControllerOutputLatency(self);
 }
 
+-(NSTimeInterval)graphLatency {
+    return AEAudioControllerGraphLatency(self);
+}
+
+NSTimeInterval AEAudioControllerGraphLatency(AEAudioController *controller) {
+    if ( !controller->_topChannel || !controller->_audioDescription.mSampleRate ) return 0;
+    return controller->_topChannel->latencyFrames / controller->_audioDescription.mSampleRate;
+}
+
 NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
     if ( __cachedOutputLatency == kNoValue ) {
         UInt32 size = sizeof(__cachedOutputLatency);
@@ -1868,6 +4608,83 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
     }
 }
 
+-(void)setSoftwareMixingEnabled:(BOOL)softwareMixingEnabled {
+    if ( _softwareMixingEnabled == softwareMixingEnabled ) return;
+    
+    _softwareMixingEnabled = softwareMixingEnabled;
+    
+    if ( _topGroup ) {
+        // Reconfigure existing groups to use the new mixer
+        [self configureChannelsInRange:NSMakeRange(0, _topGroup->channelCount) forGroup:_topGroup];
+        checkResult([self updateGraph], "Update graph");
+    }
+}
+
+-(void)setFloatBusesEnabled:(BOOL)floatBusesEnabled {
+    if ( _floatBusesEnabled == floatBusesEnabled ) return;
+    
+    _floatBusesEnabled = floatBusesEnabled;
+    
+    _busAudioDescription = _audioDescription;
+    if ( _floatBusesEnabled ) {
+        AEFloatConverter *converter = [[AEFloatConverter alloc] initWithSourceFormat:_audioDescription];
+        _busAudioDescription = converter.floatingPointAudioDescription;
+        [converter release];
+    }
+    
+    if ( _topGroup ) {
+        // Reconfigure the whole tree, from the top group's connection to the IO unit down, in the new format
+        [self configureChannelsInRange:NSMakeRange(0, 1) forGroup:NULL];
+        checkResult([self updateGraph], "Update graph");
+        
+        [self updateClientFormatOfFiltersInGroup:_topGroup];
+    }
+}
+
+-(void)setRenderThreadCount:(NSUInteger)renderThreadCount {
+    // Leave a core free for the Core Audio thread, which renders alongside the workers
+    int processorCount = 1;
+    size_t size = sizeof(processorCount);
+    sysctlbyname("hw.activecpu", &processorCount, &size, NULL, 0);
+    renderThreadCount = MIN(renderThreadCount, (NSUInteger)MIN(MAX(processorCount - 1, 0), kMaximumRenderLanes - 1));
+    
+    if ( renderThreadCount == self.renderThreadCount ) return;
+    
+    // Make sure there are render buffer and aux bus lanes for the new workers before they start, even within a batch
+    [self updateRenderBufferPoolWithLaneCount:(int)MAX(renderThreadCount, self.renderThreadCount) + 1];
+    [self publishPendingUpdates];
+    NSMutableData *buses = [NSMutableData data];
+    [self gatherAuxBusesFromGroup:_topGroup intoData:buses];
+    for ( int i=0; i<buses.length / sizeof(AEChannelGroupRef); i++ ) {
+        auxBusSetLaneCount(((AEChannelGroupRef*)buses.bytes)[i]->auxBus, (int)renderThreadCount + 1);
+    }
+    
+    render_worker_pool_t *oldPool = _renderWorkerPool;
+    render_worker_pool_t *newPool = renderThreadCount > 0 ? renderWorkerPoolCreate((int)renderThreadCount, _currentBufferDuration ? _currentBufferDuration : _preferredBufferDuration ? _preferredBufferDuration : 0.01) : NULL;
+    
+    OSMemoryBarrier();
+    _renderWorkerPool = newPool;
+    
+    if ( oldPool ) {
+        [self performBlockWhenRenderingComplete:^{ renderWorkerPoolDestroy(oldPool); }];
+    }
+    
+    [self updateRenderBufferPool];
+}
+
+-(void)setCurrentBufferDuration:(float)currentBufferDuration {
+    _currentBufferDuration = currentBufferDuration;
+    if ( _renderWorkerPool ) renderWorkerPoolSetBufferDuration(_renderWorkerPool, currentBufferDuration);
+}
+
+-(NSUInteger)renderThreadCount {
+    return _renderWorkerPool ? _renderWorkerPool->threadCount : 0;
+}
+
+-(NSUInteger)renderWorkingSetSize {
+    return _renderWorkingSetSize;
+}
+
 -(void)setVoiceProcessingOnlyForSpeakerAndMicrophone:(BOOL)voiceProcessingOnlyForSpeakerAndMicrophone {
     _voiceProcessingOnlyForSpeakerAndMicrophone = voiceProcessingOnlyForSpeakerAndMicrophone;
     if ( [self mustUpdateVoiceProcessingSettings] ) {
@@ -1932,6 +4749,10 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
         }
         if ( !channelElement->audiobusScratchBuffer ) {
             channelElement->audiobusScratchBuffer = AEAllocateAndInitAudioBufferList(channelElement->audiobusFloatConverter.floatingPointAudioDescription, kScratchBufferFrames);
+            int bufferCount = channelElement->audiobusScratchBuffer->mNumberBuffers;
+            for ( int i=0; i<MIN(bufferCount, 2); i++ ) {
+                channelElement->audiobusGains[i] = softwareMixerTargetGain(channelElement, bufferCount, i, bufferCount);
+            }
         }
         [audiobusSenderPort setClientFormat:channelElement->audiobusFloatConverter.floatingPointAudioDescription];
         if ( channelElement->type == kChannelTypeGroup ) {
@@ -1983,6 +4804,14 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
     AEChannelRef channelElement = group->channels[index];
     
     if ( [keyPath isEqualToString:@"volume"] ) {
+        if ( channelElement->volumeRamp.remainingFrames ) {
+            // A ramp is in progress: leave it be if it's heading here already, otherwise cut it short
+            if ( channel.volume != channelElement->volumeRamp.target ) {
+                [self rampParameter:kMultiChannelMixerParam_Volume ofChannelMatchingPtr:channel.renderCallback object:channel to:channel.volume duration:_currentBufferDuration exponential:NO];
+            }
+            return;
+        }
+        
         channelElement->volume = channel.volume;
         
         if ( group->mixerAudioUnit ) {
@@ -1992,6 +4821,13 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
         }
         
     } else if ( [keyPath isEqualToString:@"pan"] ) {
+        if ( channelElement->panRamp.remainingFrames ) {
+            if ( channel.pan != channelElement->panRamp.target ) {
+                [self rampParameter:kMultiChannelMixerParam_Pan ofChannelMatchingPtr:channel.renderCallback object:channel to:channel.pan duration:_currentBufferDuration exponential:NO];
+            }
+            return;
+        }
+        
         channelElement->pan = channel.pan;
         
         if ( group->mixerAudioUnit ) {
@@ -2024,17 +4860,21 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
         
     } else if ( [keyPath isEqualToString:@"audioDescription"] ) {
         channelElement->audioDescription = channel.audioDescription;
+        [self setClientFormat:channelElement->audioDescription ofFiltersInTable:&channelElement->callbacks];
         
         if ( group->mixerAudioUnit ) {
             OSStatus result = AudioUnitSetProperty(group->mixerAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, index, &channelElement->audioDescription, sizeof(AudioStreamBasicDescription));
             checkResult(result, "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
+        } else if ( group->softwareMixing ) {
+            [self updateSoftwareMixerInputForChannel:channelElement];
         }
         
         if ( channelElement->audiobusFloatConverter ) {
             AEFloatConverter *newFloatConverter = [[AEFloatConverter alloc] initWithSourceFormat:channel.audioDescription];
             AEFloatConverter *oldFloatConverter = channelElement->audiobusFloatConverter;
-            [self performSynchronousMessageExchangeWithBlock:^{ channelElement->audiobusFloatConverter = newFloatConverter; }];
-            [oldFloatConverter release];
+            OSMemoryBarrier();
+            channelElement->audiobusFloatConverter = newFloatConverter;
+            [self releaseObjectWhenRenderingComplete:oldFloatConverter];
         }
     }
 }
@@ -2154,7 +4994,7 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
     // Input/output unit description
     AudioComponentDescription io_desc = {
         .componentType = kAudioUnitType_Output,
-        .componentSubType = useVoiceProcessing ? kAudioUnitSubType_VoiceProcessingIO : kAudioUnitSubType_RemoteIO,
+        .componentSubType = _offline ? kAudioUnitSubType_GenericOutput : useVoiceProcessing ? kAudioUnitSubType_VoiceProcessingIO : kAudioUnitSubType_RemoteIO,
         .componentManufacturer = kAudioUnitManufacturer_Apple,
         .componentFlags = 0,
         .componentFlagsMask = 0
@@ -2190,6 +5030,8 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
         _topChannel->pan      = 0.0;
         _topChannel->muted    = NO;
         _topChannel->audioController = self;
+        _topChannel->renderProfile.node = _topGroup;
+        _topChannel->renderProfile.nodeType = AERenderProfileNodeTypeChannelGroup;
         _topGroup->channel   = _topChannel;
         
         UInt32 size = sizeof(_topChannel->audioDescription);
@@ -2199,6 +5041,7 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
     
     // Initialise group
     [self configureChannelsInRange:NSMakeRange(0, 1) forGroup:NULL];
+    [self updateRenderBufferPool];
     
     // Register a callback to be notified when the main mixer unit renders
     checkResult(AudioUnitAddRenderNotify(_topGroup->mixerAudioUnit, &topRenderNotifyCallback, self), "AudioUnitAddRenderNotify");
@@ -2268,6 +5111,16 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
 }
 
 - (void)configureAudioUnit {
+    if ( _offline ) {
+        // The generic output unit delivers to the caller of renderOfflineFrames:intoBufferList:atTime:, in our format
+        checkResult(AudioUnitSetProperty(_ioAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &_audioDescription, sizeof(_audioDescription)),
+                    "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
+        UInt32 maxFPS = kMaximumFramesPerSlice;
+        checkResult(AudioUnitSetProperty(_ioAudioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFPS, sizeof(maxFPS)),
+                    "AudioUnitSetProperty(kAudioUnitProperty_MaximumFramesPerSlice)");
+        return;
+    }
+    
     if ( _inputEnabled ) {
         // Enable input
         UInt32 enableInputFlag = 1;
@@ -2309,7 +5162,7 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
     }
     
     // Set the audio unit to handle up to 4096 frames per slice to keep rendering during screen lock
-    UInt32 maxFPS = 4096;
+    UInt32 maxFPS = kMaximumFramesPerSlice;
     checkResult(AudioUnitSetProperty(_ioAudioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFPS, sizeof(maxFPS)),
                 "AudioUnitSetProperty(kAudioUnitProperty_MaximumFramesPerSlice)");
 }
@@ -2338,6 +5191,23 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
 }
 
 - (OSStatus)updateGraph {
+    if ( _updateBatchDepth > 0 ) {
+        // Performed once the batch is committed
+        _graphUpdatePending = YES;
+        return noErr;
+    }
+    
+    BOOL holdingUpdates = _holdingUpdates;
+    _holdingUpdates = YES;
+    [self updateLatencyCompensation];
+    [self updateClientFormatConvertersForChannel:_topChannel];
+    [self updateRenderBufferPool];
+    [self updateRenderSchedules];
+    _holdingUpdates = holdingUpdates;
+    
+    // Publish before the graph update, so new connections render with their tables in place
+    [self publishUpdates];
+    
     // Only update if graph is running
     if ( _running ) {
         // Retry a few times (as sometimes the graph will be in the wrong state to update)
@@ -2512,7 +5382,6 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
                 if ( inputLevelMonitorData.monitoringEnabled && memcmp(&_rawInputAudioDescription, &rawAudioDescription, sizeof(_rawInputAudioDescription)) != 0 ) {
                     inputLevelMonitorData.channels = rawAudioDescription.mChannelsPerFrame;
                     inputLevelMonitorData.floatConverter = [[AEFloatConverter alloc] initWithSourceFormat:rawAudioDescription];
-                    inputLevelMonitorData.scratchBuffer = AEAllocateAndInitAudioBufferList(inputLevelMonitorData.floatConverter.floatingPointAudioDescription, kLevelMonitorScratchBufferSize);
                 }
             }
             
@@ -2618,90 +5487,652 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
         }
     }
     
-    // Set input stream format and update the properties, on the realtime thread
-    [self performSynchronousMessageExchangeWithBlock:^{
-        _numberOfInputChannels    = numberOfInputChannels;
-        _rawInputAudioDescription = rawAudioDescription;
-        _inputAudioBufferList     = inputAudioBufferList;
-        _audioInputAvailable      = inputAvailable;
-        _hardwareInputAvailable   = hardwareInputAvailable;
-        _inputCallbacks           = inputCallbacks;
-        _inputCallbackCount       = inputCallbackCount;
-        _usingAudiobusInput       = usingAudiobus;
-        _inputLevelMonitorData    = inputLevelMonitorData;
-    }];
+    // Set input stream format and update the properties, on the realtime thread
+    [self performSynchronousMessageExchangeWithBlock:^{
+        _numberOfInputChannels    = numberOfInputChannels;
+        _rawInputAudioDescription = rawAudioDescription;
+        _inputAudioBufferList     = inputAudioBufferList;
+        _audioInputAvailable      = inputAvailable;
+        _hardwareInputAvailable   = hardwareInputAvailable;
+        _inputCallbacks           = inputCallbacks;
+        _inputCallbackCount       = inputCallbackCount;
+        _usingAudiobusInput       = usingAudiobus;
+        _inputLevelMonitorData    = inputLevelMonitorData;
+    }];
+    [self movePendingPublicationsFromInputTables:oldInputCallbacks count:MIN(oldInputCallbackCount, inputCallbackCount) toInputTables:inputCallbacks];
+    
+    if ( inputAvailable && (!_audiobusReceiverPort || !ABReceiverPortIsConnected(_audiobusReceiverPort)) ) {
+        AudioStreamBasicDescription currentAudioDescription;
+        UInt32 size = sizeof(currentAudioDescription);
+        OSStatus result = AudioUnitGetProperty(_ioAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 1, &currentAudioDescription, &size);
+        checkResult(result, "AudioUnitGetProperty(kAudioUnitProperty_StreamFormat)");
+        
+        if ( memcmp(&currentAudioDescription, &rawAudioDescription, sizeof(AudioStreamBasicDescription)) != 0 ) {
+            result = AudioUnitSetProperty(_ioAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 1, &rawAudioDescription, sizeof(AudioStreamBasicDescription));
+            checkResult(result, "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
+        }
+    }
+    
+    if ( oldInputBuffer && oldInputBuffer != inputAudioBufferList ) {
+        AEFreeAudioBufferList(oldInputBuffer);
+    }
+    
+    if ( oldInputCallbacks != inputCallbacks ) {
+        for ( int entryIndex = 0; entryIndex < oldInputCallbackCount; entryIndex++ ) {
+            input_callback_table_t *oldEntry = &oldInputCallbacks[entryIndex];
+            input_callback_table_t *entry = entryIndex < inputCallbackCount ? &inputCallbacks[entryIndex] : NULL;
+            
+            if ( oldEntry->audioConverter && (!entry || oldEntry->audioConverter != entry->audioConverter) ) {
+                AudioConverterDispose(oldEntry->audioConverter);
+            }
+            if ( oldEntry->audioBufferList && (!entry || oldEntry->audioBufferList != entry->audioBufferList) ) {
+                AEFreeAudioBufferList(oldEntry->audioBufferList);
+            }
+        }
+        free(oldInputCallbacks);
+    }
+    
+    if ( oldInputLevelMonitorData.floatConverter != inputLevelMonitorData.floatConverter ) {
+        [oldInputLevelMonitorData.floatConverter release];
+    }
+    
+    // Input formats size the pooled render buffers used by input filters and metering
+    [self updateRenderBufferPool];
+    
+    if ( inputChannelsChanged ) {
+        [self didChangeValueForKey:@"numberOfInputChannels"];
+    }
+    
+    if ( inputDescriptionChanged ) {
+        [self didChangeValueForKey:@"inputAudioDescription"];
+    }
+    
+    if ( inputAvailableChanged ) {
+        [self didChangeValueForKey:@"audioInputAvailable"];
+    }
+    
+    if ( inputChannelsChanged || inputAvailableChanged || inputDescriptionChanged ) {
+        if ( inputAvailable ) {
+            NSLog(@"TAAE: Input status updated (%u channel, %@%@%@%@)",
+                  (unsigned int)numberOfInputChannels,
+                  usingAudiobus ? @"using Audiobus, " : @"",
+                  rawAudioDescription.mFormatFlags & kAudioFormatFlagIsNonInterleaved ? @"non-interleaved" : @"interleaved",
+                  [self usingVPIO] ? @", using voice processing" : @"",
+                  inputCallbacks[0].audioConverter ? @", with converter" : @"");
+        } else {
+            NSLog(@"TAAE: Input status updated: No input avaliable");
+        }
+    }
+    
+    return success;
+}
+
+static void freeSoftwareMixerInput(software_mixer_input_t *input) {
+    [input->floatConverter release];
+    AEFreeAudioBufferList(input->floatBuffer);
+    free(input);
+}
+
+- (void)updateSoftwareMixerInputForChannel:(AEChannelRef)channel {
+    software_mixer_input_t *oldInput = channel->mixerInput;
+    
+    if ( oldInput ) {
+        AudioStreamBasicDescription converterFormat = oldInput->floatConverter.sourceFormat;
+        if ( memcmp(&converterFormat, &channel->audioDescription, sizeof(channel->audioDescription)) == 0 ) return;
+    }
+    
+    // Allocate a converter and float buffer for the channel's current format; native-format audio is rendered into pooled buffers
+    software_mixer_input_t *input = (software_mixer_input_t*)calloc(1, sizeof(software_mixer_input_t));
+    input->floatConverter = [[AEFloatConverter alloc] initWithSourceFormat:channel->audioDescription];
+    AudioStreamBasicDescription floatFormat = input->floatConverter.floatingPointAudioDescription;
+    input->floatBuffer = AEAllocateAndInitAudioBufferList(floatFormat, kMaximumFramesPerSlice);
+    input->renderInPlace = memcmp(&floatFormat, &channel->audioDescription, sizeof(floatFormat)) == 0;
+    
+    // Start at the current gains, so a newly-added channel doesn't ramp in
+    int outputChannelCount = _audioDescription.mChannelsPerFrame;
+    for ( int i=0; i<MIN(outputChannelCount, 2); i++ ) {
+        input->gains[i] = oldInput ? oldInput->gains[i] : softwareMixerTargetGain(channel, floatFormat.mChannelsPerFrame, i, outputChannelCount);
+    }
+    
+    OSMemoryBarrier();
+    channel->mixerInput = input;
+    
+    if ( oldInput ) {
+        [self performBlockWhenRenderingComplete:^{ freeSoftwareMixerInput(oldInput); }];
+    }
+}
+
+- (void)releaseSoftwareMixerInputForChannel:(AEChannelRef)channel {
+    software_mixer_input_t *oldInput = channel->mixerInput;
+    if ( !oldInput ) return;
+    
+    channel->mixerInput = NULL;
+    [self performBlockWhenRenderingComplete:^{ freeSoftwareMixerInput(oldInput); }];
+}
+
+- (void)setupSoftwareMixingForGroup:(AEChannelGroupRef)group {
+    AudioStreamBasicDescription converterFormat = {};
+    if ( group->mixerOutputConverter ) converterFormat = group->mixerOutputConverter.sourceFormat;
+    
+    if ( !group->mixerOutputConverter || memcmp(&converterFormat, &_busAudioDescription, sizeof(converterFormat)) != 0 ) {
+        // Mix in, or into, the format carried by groups
+        AEFloatConverter *converter = [[AEFloatConverter alloc] initWithSourceFormat:_busAudioDescription];
+        BOOL mixInPlace = AEFloatConverterIsPassThrough(converter);
+        AEFloatConverter *oldConverter = group->mixerOutputConverter;
+        
+        if ( group->softwareMixing ) {
+            [self performSynchronousMessageExchangeWithBlock:^{
+                group->mixerOutputConverter = converter;
+                group->mixInPlace = mixInPlace;
+                group->channel->audioDescription = _busAudioDescription;
+            }];
+        } else {
+            group->mixerOutputConverter = converter;
+            group->mixInPlace = mixInPlace;
+        }
+        
+        if ( oldConverter ) {
+            [self releaseObjectWhenRenderingComplete:oldConverter];
+        }
+    }
+    
+    group->channel->audioDescription = _busAudioDescription;
+    
+    OSMemoryBarrier();
+    group->softwareMixing = YES;
+    
+    // Remove the mixer unit and its converter, which are no longer used
+    if ( group->mixerNode ) {
+        if ( group->channel->setRenderNotification ) {
+            checkResult(AudioUnitRemoveRenderNotify(group->converterUnit ? group->converterUnit : group->mixerAudioUnit, &groupRenderNotifyCallback, group->channel), "AudioUnitRemoveRenderNotify");
+            group->channel->setRenderNotification = NO;
+        }
+        if ( group->converterNode ) {
+            checkResult(AUGraphRemoveNode(_audioGraph, group->converterNode), "AUGraphRemoveNode");
+            group->converterNode = 0;
+            group->converterUnit = NULL;
+        }
+        checkResult(AUGraphRemoveNode(_audioGraph, group->mixerNode), "AUGraphRemoveNode");
+        group->mixerNode = 0;
+        group->mixerAudioUnit = NULL;
+    }
+}
+
+- (void)teardownSoftwareMixingForGroup:(AEChannelGroupRef)group {
+    group->softwareMixing = NO;
+    
+    AEFloatConverter *oldConverter = group->mixerOutputConverter;
+    group->mixerOutputConverter = nil;
+    [self releaseObjectWhenRenderingComplete:oldConverter];
+}
+
+- (void)measureRenderBuffersForGroup:(AEChannelGroupRef)group slotSize:(size_t*)slotSize depth:(int*)depth persistentSize:(size_t*)persistentSize {
+    *slotSize = MAX(*slotSize, renderBufferSlotSizeForFormat(&group->channel->audioDescription));
+    
+    int childDepth = 0;
+    for ( int i=0; i<group->channelCount; i++ ) {
+        AEChannelRef channel = group->channels[i];
+        if ( !channel ) continue;
+        
+        *slotSize = MAX(*slotSize, renderBufferSlotSizeForFormat(&channel->audioDescription));
+        
+        if ( channel->mixerInput ) {
+            *persistentSize += channel->mixerInput->floatBuffer->mNumberBuffers * kMaximumFramesPerSlice * sizeof(float);
+        }
+        if ( channel->audiobusScratchBuffer ) {
+            *persistentSize += channel->audiobusScratchBuffer->mNumberBuffers * kScratchBufferFrames * sizeof(float);
+        }
+        
+        if ( channel->type == kChannelTypeGroup ) {
+            int groupDepth = 0;
+            [self measureRenderBuffersForGroup:(AEChannelGroupRef)channel->ptr slotSize:slotSize depth:&groupDepth persistentSize:persistentSize];
+            childDepth = MAX(childDepth, groupDepth);
+        }
+    }
+    
+    // Each level of software mixing holds one slot while its channels render
+    *depth = childDepth + (group->softwareMixing ? 1 : 0);
+}
+
+- (void)updateRenderBufferPoolWithLaneCount:(int)laneCount {
+    size_t slotSize = renderBufferSlotSizeForFormat(&_audioDescription);
+    size_t persistentSize = 0;
+    int depth = 0;
+    
+    slotSize = MAX(slotSize, renderBufferSlotSizeForFormat(&_rawInputAudioDescription));
+    for ( int i=0; i<_inputCallbackCount; i++ ) {
+        slotSize = MAX(slotSize, renderBufferSlotSizeForFormat(&_inputCallbacks[i].audioDescription));
+    }
+    
+    if ( _topGroup ) {
+        [self measureRenderBuffersForGroup:_topGroup slotSize:&slotSize depth:&depth persistentSize:&persistentSize];
+    }
+    
+    // One slot per level of software mixing, plus scratch space on top
+    int slotCount = depth + 1;
+    
+    render_buffer_pool_t *oldPool = _renderBufferPool;
+    if ( !oldPool || oldPool->laneCount != laneCount || oldPool->slotCount != slotCount || oldPool->slotSize != slotSize ) {
+        render_buffer_pool_t *pool = renderBufferPoolCreate(laneCount, slotCount, slotSize);
+        if ( !pool ) {
+            NSLog(@"TAAE: Couldn't allocate render buffers");
+            return;
+        }
+        
+        // Swap between render cycles, so no lane is part-way through its stack
+        __block render_buffer_pool_t *replacedPool = NULL;
+        [self performUpdateWithBlock:^{
+            replacedPool = _renderBufferPool;
+            _renderBufferPool = pool;
+        } completionBlock:^{
+            if ( replacedPool ) renderBufferPoolDestroy(replacedPool);
+        }];
+        
+        _renderWorkingSetSize = pool->size + persistentSize;
+        return;
+    }
+    
+    _renderWorkingSetSize = (oldPool ? oldPool->size : 0) + persistentSize;
+}
+
+- (void)updateRenderBufferPool {
+    [self updateRenderBufferPoolWithLaneCount:(int)self.renderThreadCount + 1];
+}
+
+static BOOL groupCanBeFlattened(AEChannelGroupRef group, AEChannelGroupRef parentGroup) {
+    // A nested group can be mixed by its ancestor's schedule if nothing but the parent's mix needs its output
+    AEChannelRef channel = group->channel;
+    return parentGroup->softwareMixing
+        && group->softwareMixing
+        && group->mixInPlace
+        && channel->mixerInput && channel->mixerInput->renderInPlace
+        && channel->callbacks.count == 0
+        && !channel->delayLine
+        && !channel->audiobusSenderPort
+        && !channel->sendCount
+        && !group->auxBus
+        && !group->level_monitor_data.monitoringEnabled;
+}
+
+static void appendScheduleSteps(AEChannelGroupRef group, render_schedule_step_t **schedule, int *length, int *capacity) {
+    for ( int i=0; i<group->channelCount; i++ ) {
+        AEChannelRef channel = group->channels[i];
+        if ( !channel || channel->type != kChannelTypeGroup ) continue;
+        
+        AEChannelGroupRef subgroup = (AEChannelGroupRef)channel->ptr;
+        if ( !groupCanBeFlattened(subgroup, group) ) continue;
+        
+        int firstStep = *length;
+        appendScheduleSteps(subgroup, schedule, length, capacity);
+        
+        if ( *length == *capacity ) {
+            *capacity = MAX(*capacity * 2, 8);
+            *schedule = (render_schedule_step_t*)realloc(*schedule, *capacity * sizeof(render_schedule_step_t));
+        }
+        
+        int step = (*length)++;
+        (*schedule)[step] = (render_schedule_step_t) {
+            .group = subgroup,
+            .parent = group,
+            .index = i,
+            .parentStep = -1,
+            .firstStep = firstStep
+        };
+        
+        for ( int j=firstStep; j<step; j++ ) {
+            if ( (*schedule)[j].parent == subgroup ) (*schedule)[j].parentStep = step;
+        }
+    }
+}
+
+- (void)gatherGroupsFromGroup:(AEChannelGroupRef)group intoData:(NSMutableData*)data {
+    [data appendBytes:&group length:sizeof(AEChannelGroupRef)];
+    for ( int i=0; i<group->channelCount; i++ ) {
+        AEChannelRef channel = group->channels[i];
+        if ( channel && channel->type == kChannelTypeGroup ) {
+            [self gatherGroupsFromGroup:(AEChannelGroupRef)channel->ptr intoData:data];
+        }
+    }
+}
+
+- (void)updateRenderSchedules {
+    if ( !_topGroup ) return;
+    
+    // Flatten each tree of nested software-mixed groups into a schedule owned by its root, the group that's still pulled
+    NSMutableData *groupData = [NSMutableData data];
+    [self gatherGroupsFromGroup:_topGroup intoData:groupData];
+    int groupCount = (int)(groupData.length / sizeof(AEChannelGroupRef));
+    AEChannelGroupRef *groups = (AEChannelGroupRef*)groupData.mutableBytes;
+    
+    render_schedule_step_t **schedules = (render_schedule_step_t**)calloc(groupCount, sizeof(render_schedule_step_t*));
+    int *scheduleLengths = (int*)calloc(groupCount, sizeof(int));
+    BOOL *flattened = (BOOL*)calloc(groupCount, sizeof(BOOL));
+    
+    for ( int i=0; i<groupCount; i++ ) {
+        if ( !groups[i]->softwareMixing ) continue;
+        int capacity = 0;
+        appendScheduleSteps(groups[i], &schedules[i], &scheduleLengths[i], &capacity);
+        for ( int j=0; j<scheduleLengths[i]; j++ ) {
+            for ( int k=0; k<groupCount; k++ ) {
+                if ( groups[k] == schedules[i][j].group ) flattened[k] = YES;
+            }
+        }
+    }
+    
+    // Groups that are themselves flattened are mixed by their root's schedule, not their own
+    for ( int i=0; i<groupCount; i++ ) {
+        if ( flattened[i] && schedules[i] ) {
+            free(schedules[i]);
+            schedules[i] = NULL;
+            scheduleLengths[i] = 0;
+        }
+    }
+    
+    BOOL changed = NO;
+    for ( int i=0; i<groupCount && !changed; i++ ) {
+        changed = groups[i]->flattened != flattened[i] || groups[i]->scheduleLength != scheduleLengths[i]
+                    || (scheduleLengths[i] > 0 && memcmp(groups[i]->schedule, schedules[i], scheduleLengths[i] * sizeof(render_schedule_step_t)) != 0);
+    }
+    
+    if ( changed ) {
+        // Swap between render cycles, along with the tables the schedules were compiled from
+        AEChannelGroupRef *scheduledGroups = (AEChannelGroupRef*)malloc(groupCount * sizeof(AEChannelGroupRef));
+        memcpy(scheduledGroups, groups, groupCount * sizeof(AEChannelGroupRef));
+        [self performUpdateWithBlock:^{
+            for ( int i=0; i<groupCount; i++ ) {
+                render_schedule_step_t *oldSchedule = scheduledGroups[i]->schedule;
+                scheduledGroups[i]->schedule = schedules[i];
+                scheduledGroups[i]->scheduleLength = scheduleLengths[i];
+                scheduledGroups[i]->flattened = flattened[i];
+                schedules[i] = oldSchedule;
+            }
+        } completionBlock:^{
+            for ( int i=0; i<groupCount; i++ ) {
+                free(schedules[i]);
+            }
+            free(schedules);
+            free(scheduleLengths);
+            free(flattened);
+            free(scheduledGroups);
+        }];
+        return;
+    }
+    
+    for ( int i=0; i<groupCount; i++ ) {
+        free(schedules[i]);
+    }
+    free(schedules);
+    free(scheduleLengths);
+    free(flattened);
+}
+
+- (void)updateClientFormatConvertersForChannel:(AEChannelRef)channel {
+    if ( !channel ) return;
+    
+    // Receivers that need the client format get audio converted from bus audio, where it differs
+    BOOL needsConverter = NO;
+    if ( memcmp(&channel->audioDescription, &_busAudioDescription, sizeof(_busAudioDescription)) == 0
+            && memcmp(&_busAudioDescription, &_audioDescription, sizeof(_audioDescription)) != 0 ) {
+        needsConverter = callbackTableHasFlags(&channel->callbacks, kReceiverFlag | kClientFormatFlag);
+        
+        // Keep the converter until receivers that use it are no longer rendered
+        for ( int i=0; i<channel->callbacks.receiverCount && !needsConverter; i++ ) {
+            needsConverter = (channel->callbacks.receivers[i].flags & kClientFormatFlag) != 0;
+        }
+    }
+    
+    if ( needsConverter != (channel->clientFormatConverter != nil) ) {
+        AEFloatConverter *oldConverter = channel->clientFormatConverter;
+        AEFloatConverter *newConverter = needsConverter ? [[AEFloatConverter alloc] initWithSourceFormat:_audioDescription] : nil;
+        OSMemoryBarrier();
+        channel->clientFormatConverter = newConverter;
+        if ( oldConverter ) [self releaseObjectWhenRenderingComplete:oldConverter];
+    }
+    
+    if ( channel->type == kChannelTypeGroup ) {
+        AEChannelGroupRef group = (AEChannelGroupRef)channel->ptr;
+        for ( int i=0; i<group->channelCount; i++ ) {
+            [self updateClientFormatConvertersForChannel:group->channels[i]];
+        }
+    }
+}
+
+- (void)updateSendFloatConverterForChannel:(AEChannelRef)channel {
+    // Sends are mixed as float, converted from the channel's own format
+    AudioStreamBasicDescription converterFormat = {};
+    if ( channel->sendFloatConverter ) converterFormat = channel->sendFloatConverter.sourceFormat;
+    if ( channel->sendFloatConverter && memcmp(&converterFormat, &channel->audioDescription, sizeof(converterFormat)) == 0 ) return;
+    
+    AEFloatConverter *oldConverter = channel->sendFloatConverter;
+    AEFloatConverter *newConverter = [[AEFloatConverter alloc] initWithSourceFormat:channel->audioDescription];
+    OSMemoryBarrier();
+    channel->sendFloatConverter = newConverter;
+    if ( oldConverter ) [self releaseObjectWhenRenderingComplete:oldConverter];
+}
+
+- (void)gatherAuxBusesFromGroup:(AEChannelGroupRef)group intoData:(NSMutableData*)data {
+    if ( group->auxBus ) {
+        [data appendBytes:&group length:sizeof(group)];
+    }
+    for ( int i=0; i<group->channelCount; i++ ) {
+        if ( group->channels[i] && group->channels[i]->type == kChannelTypeGroup ) {
+            [self gatherAuxBusesFromGroup:(AEChannelGroupRef)group->channels[i]->ptr intoData:data];
+        }
+    }
+}
+
+- (void)gatherSendsToAuxBuses:(AEChannelGroupRef*)buses count:(int)busCount fromChannel:(AEChannelRef)channel intoData:(NSMutableData*)data {
+    if ( !channel ) return;
+    
+    // Prepare a table without the sends to these buses, if the channel has any
+    aux_send_t *remainingSends = channel->sendCount ? (aux_send_t*)malloc(channel->sendCount * sizeof(aux_send_t)) : NULL;
+    int remainingCount = 0;
+    for ( int i=0; i<channel->sendCount; i++ ) {
+        BOOL removed = NO;
+        for ( int j=0; j<busCount && !removed; j++ ) {
+            removed = channel->sends[i].bus == buses[j];
+        }
+        if ( !removed ) remainingSends[remainingCount++] = channel->sends[i];
+    }
+    
+    if ( remainingCount != channel->sendCount ) {
+        if ( remainingCount == 0 ) {
+            free(remainingSends);
+            remainingSends = NULL;
+        }
+        send_table_update_t update = { .channel = channel, .sends = remainingSends, .sendCount = remainingCount };
+        [data appendBytes:&update length:sizeof(update)];
+    } else if ( remainingSends ) {
+        free(remainingSends);
+    }
+    
+    if ( channel->type == kChannelTypeGroup ) {
+        AEChannelGroupRef group = (AEChannelGroupRef)channel->ptr;
+        for ( int i=0; i<group->channelCount; i++ ) {
+            [self gatherSendsToAuxBuses:buses count:busCount fromChannel:group->channels[i] intoData:data];
+        }
+    }
+}
+
+static UInt32 filterLatencyFrames(callback_table_t *table) {
+    UInt32 latency = 0;
+    for ( int i=0; i<table->count; i++ ) {
+        if ( table->callbacks[i].flags & kFilterFlag ) latency += table->callbacks[i].latencyFrames;
+    }
+    return latency;
+}
+
+static UInt32 mixLatencyFrames(AEChannelGroupRef group);
+
+static UInt32 channelLatencyFrames(AEChannelRef channel) {
+    UInt32 latency = filterLatencyFrames(&channel->callbacks);
+    if ( channel->type == kChannelTypeGroup ) {
+        latency += mixLatencyFrames((AEChannelGroupRef)channel->ptr);
+    }
+    return latency;
+}
+
+static UInt32 mixLatencyFrames(AEChannelGroupRef group) {
+    // The slowest path through the group sets the latency of its mix; the others are delayed to match
+    UInt32 latency = 0;
+    for ( int i=0; i<group->channelCount; i++ ) {
+        if ( group->channels[i] ) latency = MAX(latency, channelLatencyFrames(group->channels[i]));
+    }
+    return latency;
+}
+
+typedef struct {
+    AEChannelRef        channel;
+    AEChannelGroupRef   parent;
+    int                 index;
+    UInt32              latencyFrames;
+    UInt32              downstreamLatencyFrames;
+    UInt32              compensationFrames;
+    BOOL                replaceDelayLine;
+    delay_line_t       *delayLine;
+} latency_compensation_t;
+
+- (void)gatherLatencyCompensationForGroup:(AEChannelGroupRef)group downstreamLatency:(UInt32)downstreamLatency intoData:(NSMutableData*)data {
+    UInt32 mixLatency = mixLatencyFrames(group);
+    for ( int i=0; i<group->channelCount; i++ ) {
+        AEChannelRef channel = group->channels[i];
+        if ( !channel ) continue;
+        
+        latency_compensation_t entry = {
+            .channel = channel,
+            .parent = group,
+            .index = i,
+            .latencyFrames = channelLatencyFrames(channel),
+            .downstreamLatencyFrames = downstreamLatency
+        };
+        entry.compensationFrames = mixLatency - entry.latencyFrames;
+        [data appendBytes:&entry length:sizeof(entry)];
+        
+        if ( channel->type == kChannelTypeGroup ) {
+            // Audio inside the group still has the group's compensation and filters ahead of it
+            UInt32 nestedDownstreamLatency = downstreamLatency + entry.compensationFrames + filterLatencyFrames(&channel->callbacks);
+            [self gatherLatencyCompensationForGroup:(AEChannelGroupRef)channel->ptr downstreamLatency:nestedDownstreamLatency intoData:data];
+        }
+    }
+}
+
+- (void)updateLatencyCompensation {
+    if ( !_topGroup ) return;
+    
+    NSMutableData *data = [NSMutableData data];
+    latency_compensation_t top = { .channel = _topChannel, .latencyFrames = channelLatencyFrames(_topChannel) };
+    [data appendBytes:&top length:sizeof(top)];
+    [self gatherLatencyCompensationForGroup:_topGroup downstreamLatency:filterLatencyFrames(&_topChannel->callbacks) intoData:data];
     
-    if ( inputAvailable && (!_audiobusReceiverPort || !ABReceiverPortIsConnected(_audiobusReceiverPort)) ) {
-        AudioStreamBasicDescription currentAudioDescription;
-        UInt32 size = sizeof(currentAudioDescription);
-        OSStatus result = AudioUnitGetProperty(_ioAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 1, &currentAudioDescription, &size);
-        checkResult(result, "AudioUnitGetProperty(kAudioUnitProperty_StreamFormat)");
+    int count = (int)(data.length / sizeof(latency_compensation_t));
+    latency_compensation_t *entries = (latency_compensation_t*)data.mutableBytes;
+    
+    // Prepare new delay lines wherever the compensation or the channel's format has changed
+    BOOL changed = NO;
+    for ( int i=0; i<count; i++ ) {
+        latency_compensation_t *entry = &entries[i];
+        AEChannelRef channel = entry->channel;
+        const AudioStreamBasicDescription *format = &channel->audioDescription;
+        UInt32 frames = format->mBytesPerFrame ? entry->compensationFrames : 0;
+        int bufferCount = format->mFormatFlags & kAudioFormatFlagIsNonInterleaved ? format->mChannelsPerFrame : 1;
         
-        if ( memcmp(&currentAudioDescription, &rawAudioDescription, sizeof(AudioStreamBasicDescription)) != 0 ) {
-            result = AudioUnitSetProperty(_ioAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 1, &rawAudioDescription, sizeof(AudioStreamBasicDescription));
-            checkResult(result, "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
+        delay_line_t *current = channel->delayLine;
+        if ( current ? (current->frames != frames || current->bytesPerFrame != format->mBytesPerFrame || current->bufferCount != bufferCount) : frames > 0 ) {
+            entry->replaceDelayLine = YES;
+            entry->delayLine = frames > 0 ? delayLineCreate(format, frames) : NULL;
+            changed = YES;
+        }
+        
+        if ( channel->latencyFrames != entry->latencyFrames || channel->downstreamLatencyFrames != entry->downstreamLatencyFrames ) {
+            changed = YES;
         }
     }
     
-    if ( oldInputBuffer && oldInputBuffer != inputAudioBufferList ) {
-        AEFreeAudioBufferList(oldInputBuffer);
-    }
+    if ( !changed ) return;
     
-    if ( oldInputCallbacks != inputCallbacks ) {
-        for ( int entryIndex = 0; entryIndex < oldInputCallbackCount; entryIndex++ ) {
-            input_callback_table_t *oldEntry = &oldInputCallbacks[entryIndex];
-            input_callback_table_t *entry = entryIndex < inputCallbackCount ? &inputCallbacks[entryIndex] : NULL;
-            
-            if ( oldEntry->audioConverter && (!entry || oldEntry->audioConverter != entry->audioConverter) ) {
-                AudioConverterDispose(oldEntry->audioConverter);
-            }
-            if ( oldEntry->audioBufferList && (!entry || oldEntry->audioBufferList != entry->audioBufferList) ) {
-                AEFreeAudioBufferList(oldEntry->audioBufferList);
-            }
+    // Latencies are published with the tables they were worked out from
+    latency_compensation_t *latencies = (latency_compensation_t*)malloc(count * sizeof(latency_compensation_t));
+    memcpy(latencies, entries, count * sizeof(latency_compensation_t));
+    [self performUpdateWithBlock:^{
+        for ( int i=0; i<count; i++ ) {
+            latencies[i].channel->latencyFrames = latencies[i].latencyFrames;
+            latencies[i].channel->downstreamLatencyFrames = latencies[i].downstreamLatencyFrames;
         }
-        free(oldInputCallbacks);
-    }
-    
-    if ( oldInputLevelMonitorData.floatConverter != inputLevelMonitorData.floatConverter ) {
-        [oldInputLevelMonitorData.floatConverter release];
-    }
-    if ( oldInputLevelMonitorData.scratchBuffer != inputLevelMonitorData.scratchBuffer ) {
-        AEFreeAudioBufferList(oldInputLevelMonitorData.scratchBuffer);
-    }
+    } completionBlock:^{
+        free(latencies);
+    }];
     
-    if ( inputChannelsChanged ) {
-        [self didChangeValueForKey:@"numberOfInputChannels"];
+    for ( int i=0; i<count; i++ ) {
+        latency_compensation_t *entry = &entries[i];
+        if ( !entry->replaceDelayLine ) continue;
+        
+        AEChannelRef channel = entry->channel;
+        delay_line_t *oldDelayLine = channel->delayLine;
+        channel->delayLine = entry->delayLine;
+        [self markChannelForPublication:channel];
+        
+        if ( oldDelayLine && oldDelayLine != channel->renderDelayLine ) {
+            // Never published; otherwise retired once its replacement is
+            delayLineDestroy(oldDelayLine);
+        }
+        
+        if ( channel->type == kChannelTypeGroup && entry->parent && !entry->parent->softwareMixing && !oldDelayLine != !channel->delayLine ) {
+            // Groups wired straight into their parent's mixer must now be pulled through our render callback, or no longer need to be
+            [self configureChannelsInRange:NSMakeRange(entry->index, 1) forGroup:entry->parent];
+        }
     }
-    
-    if ( inputDescriptionChanged ) {
-        [self didChangeValueForKey:@"inputAudioDescription"];
+}
+
+- (pending_group_configuration_t*)pendingConfigurationForGroup:(AEChannelGroupRef)group {
+    pending_group_configuration_t *pending = (pending_group_configuration_t*)_pendingGroupConfigurations.mutableBytes;
+    int pendingCount = (int)(_pendingGroupConfigurations.length / sizeof(pending_group_configuration_t));
+    for ( int i=0; i<pendingCount; i++ ) {
+        if ( pending[i].group == group ) return &pending[i];
     }
-    
-    if ( inputAvailableChanged ) {
-        [self didChangeValueForKey:@"audioInputAvailable"];
+    return NULL;
+}
+
+- (BOOL)groupIsAttached:(AEChannelGroupRef)group coveredByPendingConfiguration:(BOOL*)covered {
+    // Walk up to the top group, looking for an ancestor whose pending configuration includes our branch
+    *covered = NO;
+    for ( AEChannelGroupRef child = group; child; ) {
+        int index = 0;
+        AEChannelGroupRef parent = child == _topGroup ? NULL : [self searchForGroupContainingChannelMatchingPtr:child userInfo:NULL index:&index];
+        if ( child != _topGroup && !parent ) return NO;
+        
+        pending_group_configuration_t *entry = [self pendingConfigurationForGroup:parent];
+        if ( entry && NSLocationInRange(index, entry->range) ) *covered = YES;
+        
+        child = parent;
     }
-    
-    if ( inputChannelsChanged || inputAvailableChanged || inputDescriptionChanged ) {
-        if ( inputAvailable ) {
-            NSLog(@"TAAE: Input status updated (%u channel, %@%@%@%@)",
-                  (unsigned int)numberOfInputChannels,
-                  usingAudiobus ? @"using Audiobus, " : @"",
-                  rawAudioDescription.mFormatFlags & kAudioFormatFlagIsNonInterleaved ? @"non-interleaved" : @"interleaved",
-                  [self usingVPIO] ? @", using voice processing" : @"",
-                  inputCallbacks[0].audioConverter ? @", with converter" : @"");
+    return YES;
+}
+
+- (void)configureChannelsInRange:(NSRange)range forGroup:(AEChannelGroupRef)group {
+    if ( _updateBatchDepth > 0 ) {
+        // Note the affected channels, to be configured once the batch is committed
+        pending_group_configuration_t *entry = [self pendingConfigurationForGroup:group];
+        if ( entry ) {
+            entry->range = entry->range.length ? NSUnionRange(entry->range, range) : range;
         } else {
-            NSLog(@"TAAE: Input status updated: No input avaliable");
+            pending_group_configuration_t newEntry = { .group = group, .range = range, .trimBusCount = NO };
+            [_pendingGroupConfigurations appendBytes:&newEntry length:sizeof(newEntry)];
         }
+        return;
     }
     
-    return success;
-}
-
-- (void)configureChannelsInRange:(NSRange)range forGroup:(AEChannelGroupRef)group {
-    UInt32 numInteractions = kMaximumChannelsPerGroup*2;
-    AUNodeInteraction interactions[numInteractions];
+    // Channels of a software-mixed group are pulled directly by the group's render callback, not wired into the graph
+    BOOL parentIsSoftwareMixing = group && group->softwareMixing;
+    
+    UInt32 numInteractions = 0;
+    if ( !parentIsSoftwareMixing ) {
+        checkResult(AUGraphCountNodeInteractions(_audioGraph, group ? group->mixerNode : _ioNode, &numInteractions), "AUGraphCountNodeInteractions");
+    }
+    AUNodeInteraction interactions[MAX(numInteractions, 1)];
     
-    checkResult(AUGraphGetNodeInteractions(_audioGraph, group ? group->mixerNode : _ioNode, &numInteractions, interactions), "AUGraphGetNodeInteractions");
+    if ( numInteractions > 0 ) {
+        checkResult(AUGraphGetNodeInteractions(_audioGraph, group ? group->mixerNode : _ioNode, &numInteractions, interactions), "AUGraphGetNodeInteractions");
+    }
     
     for ( int i = (int)range.location; i < range.location+range.length; i++ ) {
         AEChannelRef channel = group ? group->channels[i] : _topChannel;
@@ -2730,7 +6161,10 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
             continue;
         }
         
-        if ( channel->type == kChannelTypeChannel ) {
+        if ( channel->type == kChannelTypeChannel && parentIsSoftwareMixing ) {
+            [self updateSoftwareMixerInputForChannel:channel];
+            
+        } else if ( channel->type == kChannelTypeChannel ) {
             // Setup render callback struct, if necessary
             AURenderCallbackStruct rcbs = { .inputProc = &renderCallback, .inputProcRefCon = channel };
             if ( 1 /* workaround for graph bug: http://wiki.theamazingaudioengine.com/graph-node-input-callback-bug */
@@ -2746,112 +6180,122 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
             AEChannelGroupRef subgroup = (AEChannelGroupRef)channel->ptr;
             
             // Determine if we have filters or receivers
-            BOOL hasReceivers=NO, hasFilters=NO;
-            for ( int i=0; i<channel->callbacks.count && (!hasReceivers || !hasFilters); i++ ) {
-                if ( channel->callbacks.callbacks[i].flags & kFilterFlag ) {
-                    hasFilters = YES;
-                } else if ( channel->callbacks.callbacks[i].flags & kReceiverFlag ) {
-                    hasReceivers = YES;
-                }
-            }
-            
-            if ( !subgroup->mixerNode ) {
-                // Create mixer node if necessary
-                AudioComponentDescription mixer_desc = {
-                    .componentType = kAudioUnitType_Mixer,
-                    .componentSubType = kAudioUnitSubType_MultiChannelMixer,
-                    .componentManufacturer = kAudioUnitManufacturer_Apple,
-                    .componentFlags = 0,
-                    .componentFlagsMask = 0
-                };
-                
-                // Add mixer node to graph
-                if ( !checkResult(AUGraphAddNode(_audioGraph, &mixer_desc, &subgroup->mixerNode), "AUGraphAddNode mixer") ||
-                    !checkResult(AUGraphNodeInfo(_audioGraph, subgroup->mixerNode, NULL, &subgroup->mixerAudioUnit), "AUGraphNodeInfo") ) {
-                    continue;
-                }
-                
-                // Set the mixer unit to handle up to 4096 frames per slice to keep rendering during screen lock
-                UInt32 maxFPS = 4096;
-                AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFPS, sizeof(maxFPS));
-            }
+            BOOL hasReceivers = callbackTableHasFlags(&channel->callbacks, kReceiverFlag);
+            BOOL hasFilters = callbackTableHasFlags(&channel->callbacks, kFilterFlag);
             
-            // Set bus count
             UInt32 busCount = subgroup->channelCount;
-            if ( !checkResult(AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount)), "AudioUnitSetProperty(kAudioUnitProperty_ElementCount)") ) continue;
-            
-            // Get current mixer's output format
-            AudioStreamBasicDescription currentMixerOutputDescription;
-            UInt32 size = sizeof(currentMixerOutputDescription);
-            checkResult(AudioUnitGetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &currentMixerOutputDescription, &size), "AudioUnitGetProperty(kAudioUnitProperty_StreamFormat)");
             
-            // Determine what the output format should be (use TAAE's audio description if client code will see the audio)
-            AudioStreamBasicDescription mixerOutputDescription = !subgroup->converterNode ? _audioDescription : currentMixerOutputDescription;
-            mixerOutputDescription.mSampleRate = _audioDescription.mSampleRate;
-            
-            if ( memcmp(&currentMixerOutputDescription, &mixerOutputDescription, sizeof(mixerOutputDescription)) != 0 ) {
-                // Assign the output format if necessary
-                OSStatus result = AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &mixerOutputDescription, sizeof(mixerOutputDescription));
+            if ( _softwareMixingEnabled && group ) {
+                // Mix this group's channels ourselves, in place of a mixer unit
+                [self setupSoftwareMixingForGroup:subgroup];
                 
-                if ( hasUpstreamInteraction ) {
-                    // Disconnect node to force reconnection, in order to apply new audio format
-                    checkResult(AUGraphDisconnectNodeInput(_audioGraph, targetNode, targetBus), "AUGraphDisconnectNodeInput");
+                if ( hasUpstreamInteraction && upstreamInteraction.nodeInteractionType == kAUNodeInteraction_Connection ) {
+                    // The connection from the old mixer went with it
                     hasUpstreamInteraction = NO;
                 }
+            } else {
+                if ( subgroup->softwareMixing ) {
+                    [self teardownSoftwareMixingForGroup:subgroup];
+                }
+                
+                if ( !subgroup->mixerNode ) {
+                    // Create mixer node if necessary
+                    AudioComponentDescription mixer_desc = {
+                        .componentType = kAudioUnitType_Mixer,
+                        .componentSubType = kAudioUnitSubType_MultiChannelMixer,
+                        .componentManufacturer = kAudioUnitManufacturer_Apple,
+                        .componentFlags = 0,
+                        .componentFlagsMask = 0
+                    };
+                
+                    // Add mixer node to graph
+                    if ( !checkResult(AUGraphAddNode(_audioGraph, &mixer_desc, &subgroup->mixerNode), "AUGraphAddNode mixer") ||
+                        !checkResult(AUGraphNodeInfo(_audioGraph, subgroup->mixerNode, NULL, &subgroup->mixerAudioUnit), "AUGraphNodeInfo") ) {
+                        continue;
+                    }
+                
+                    // Set the mixer unit to handle up to 4096 frames per slice to keep rendering during screen lock
+                    UInt32 maxFPS = 4096;
+                    AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFPS, sizeof(maxFPS));
+                }
+                
+                // Set bus count
+                if ( !checkResult(AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_ElementCount, kAudioUnitScope_Input, 0, &busCount, sizeof(busCount)), "AudioUnitSetProperty(kAudioUnitProperty_ElementCount)") ) continue;
+                
+                // Get current mixer's output format
+                AudioStreamBasicDescription currentMixerOutputDescription;
+                UInt32 size = sizeof(currentMixerOutputDescription);
+                checkResult(AudioUnitGetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &currentMixerOutputDescription, &size), "AudioUnitGetProperty(kAudioUnitProperty_StreamFormat)");
+                
+                // Determine what the output format should be (use the bus format if client code will see the audio)
+                AudioStreamBasicDescription mixerOutputDescription = !subgroup->converterNode ? _busAudioDescription : currentMixerOutputDescription;
+                mixerOutputDescription.mSampleRate = _audioDescription.mSampleRate;
+                
+                if ( memcmp(&currentMixerOutputDescription, &mixerOutputDescription, sizeof(mixerOutputDescription)) != 0 ) {
+                    // Assign the output format if necessary
+                    OSStatus result = AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &mixerOutputDescription, sizeof(mixerOutputDescription));
                 
-                if ( !subgroup->converterNode && result == kAudioUnitErr_FormatNotSupported ) {
-                    // The mixer only supports a subset of formats. If it doesn't support this one, then we'll add an audio converter
-                    currentMixerOutputDescription.mSampleRate = mixerOutputDescription.mSampleRate;
-                    AEAudioStreamBasicDescriptionSetChannelsPerFrame(&currentMixerOutputDescription, mixerOutputDescription.mChannelsPerFrame);
+                    if ( hasUpstreamInteraction ) {
+                        // Disconnect node to force reconnection, in order to apply new audio format
+                        checkResult(AUGraphDisconnectNodeInput(_audioGraph, targetNode, targetBus), "AUGraphDisconnectNodeInput");
+                        hasUpstreamInteraction = NO;
+                    }
+                
+                    if ( !subgroup->converterNode && result == kAudioUnitErr_FormatNotSupported ) {
+                        // The mixer only supports a subset of formats. If it doesn't support this one, then we'll add an audio converter
+                        currentMixerOutputDescription.mSampleRate = mixerOutputDescription.mSampleRate;
+                        AEAudioStreamBasicDescriptionSetChannelsPerFrame(&currentMixerOutputDescription, mixerOutputDescription.mChannelsPerFrame);
                     
-                    if ( !checkResult(result=AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &currentMixerOutputDescription, size), "AudioUnitSetProperty") ) {
-                        AUGraphRemoveNode(_audioGraph, subgroup->mixerNode);
-                        subgroup->mixerNode = 0;
-                        hasFilters = hasReceivers = NO;
-                    } else {
-                        AudioComponentDescription audioConverterDescription = AEAudioComponentDescriptionMake(kAudioUnitManufacturer_Apple, kAudioUnitType_FormatConverter, kAudioUnitSubType_AUConverter);
-                        if ( !checkResult(AUGraphAddNode(_audioGraph, &audioConverterDescription, &subgroup->converterNode), "AUGraphAddNode") ||
-                            !checkResult(AUGraphNodeInfo(_audioGraph, subgroup->converterNode, NULL, &subgroup->converterUnit), "AUGraphNodeInfo") ) {
-                            AUGraphRemoveNode(_audioGraph, subgroup->converterNode);
-                            subgroup->converterNode = 0;
-                            subgroup->converterUnit = NULL;
+                        if ( !checkResult(result=AudioUnitSetProperty(subgroup->mixerAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &currentMixerOutputDescription, size), "AudioUnitSetProperty") ) {
+                            AUGraphRemoveNode(_audioGraph, subgroup->mixerNode);
+                            subgroup->mixerNode = 0;
                             hasFilters = hasReceivers = NO;
-                        }
+                        } else {
+                            AudioComponentDescription audioConverterDescription = AEAudioComponentDescriptionMake(kAudioUnitManufacturer_Apple, kAudioUnitType_FormatConverter, kAudioUnitSubType_AUConverter);
+                            if ( !checkResult(AUGraphAddNode(_audioGraph, &audioConverterDescription, &subgroup->converterNode), "AUGraphAddNode") ||
+                                !checkResult(AUGraphNodeInfo(_audioGraph, subgroup->converterNode, NULL, &subgroup->converterUnit), "AUGraphNodeInfo") ) {
+                                AUGraphRemoveNode(_audioGraph, subgroup->converterNode);
+                                subgroup->converterNode = 0;
+                                subgroup->converterUnit = NULL;
+                                hasFilters = hasReceivers = NO;
+                            }
                         
-                        // Set the audio unit to handle up to 4096 frames per slice to keep rendering during screen lock
-                        UInt32 maxFPS = 4096;
-                        checkResult(AudioUnitSetProperty(subgroup->converterUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFPS, sizeof(maxFPS)),
-                                    "AudioUnitSetProperty(kAudioUnitProperty_MaximumFramesPerSlice)");
+                            // Set the audio unit to handle up to 4096 frames per slice to keep rendering during screen lock
+                            UInt32 maxFPS = 4096;
+                            checkResult(AudioUnitSetProperty(subgroup->converterUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFPS, sizeof(maxFPS)),
+                                        "AudioUnitSetProperty(kAudioUnitProperty_MaximumFramesPerSlice)");
                         
-                        if ( channel->setRenderNotification ) {
-                            checkResult(AudioUnitRemoveRenderNotify(subgroup->mixerAudioUnit, &groupRenderNotifyCallback, channel), "AudioUnitRemoveRenderNotify");
-                            channel->setRenderNotification = NO;
-                        }
+                            if ( channel->setRenderNotification ) {
+                                checkResult(AudioUnitRemoveRenderNotify(subgroup->mixerAudioUnit, &groupRenderNotifyCallback, channel), "AudioUnitRemoveRenderNotify");
+                                channel->setRenderNotification = NO;
+                            }
                         
-                        checkResult(AUGraphConnectNodeInput(_audioGraph, subgroup->mixerNode, 0, subgroup->converterNode, 0), "AUGraphConnectNodeInput");
+                            checkResult(AUGraphConnectNodeInput(_audioGraph, subgroup->mixerNode, 0, subgroup->converterNode, 0), "AUGraphConnectNodeInput");
+                        }
+                    } else {
+                        checkResult(result, "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
                     }
+                }
+                
+                if ( subgroup->converterNode ) {
+                    // Set the audio converter stream format
+                    checkResult(AudioUnitSetProperty(subgroup->converterUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &currentMixerOutputDescription, sizeof(AudioStreamBasicDescription)), "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
+                    checkResult(AudioUnitSetProperty(subgroup->converterUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &_busAudioDescription, sizeof(AudioStreamBasicDescription)), "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
+                    channel->audioDescription = _busAudioDescription;
                 } else {
-                    checkResult(result, "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
+                    channel->audioDescription = mixerOutputDescription;
                 }
             }
             
-            if ( subgroup->converterNode ) {
-                // Set the audio converter stream format
-                checkResult(AudioUnitSetProperty(subgroup->converterUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &currentMixerOutputDescription, sizeof(AudioStreamBasicDescription)), "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
-                checkResult(AudioUnitSetProperty(subgroup->converterUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &_audioDescription, sizeof(AudioStreamBasicDescription)), "AudioUnitSetProperty(kAudioUnitProperty_StreamFormat)");
-                channel->audioDescription = _audioDescription;
-            } else {
-                channel->audioDescription = mixerOutputDescription;
-            }
-            
             if ( channel->audiobusFloatConverter ) {
                 // Update Audiobus output converter to reflect new audio format
                 AudioStreamBasicDescription converterFormat = channel->audiobusFloatConverter.sourceFormat;
                 if ( memcmp(&converterFormat, &channel->audioDescription, sizeof(channel->audioDescription)) != 0 ) {
                     AEFloatConverter *newFloatConverter = [[AEFloatConverter alloc] initWithSourceFormat:channel->audioDescription];
                     AEFloatConverter *oldFloatConverter = channel->audiobusFloatConverter;
-                    [self performAsynchronousMessageExchangeWithBlock:^{ channel->audiobusFloatConverter = newFloatConverter; }
-                                                        responseBlock:^{ [oldFloatConverter release]; }];
+                    OSMemoryBarrier();
+                    channel->audiobusFloatConverter = newFloatConverter;
+                    [self releaseObjectWhenRenderingComplete:oldFloatConverter];
                 }
             }
             
@@ -2861,16 +6305,40 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
                 if ( memcmp(&converterFormat, &channel->audioDescription, sizeof(channel->audioDescription)) != 0 ) {
                     AEFloatConverter *newFloatConverter = [[AEFloatConverter alloc] initWithSourceFormat:channel->audioDescription];
                     AEFloatConverter *oldFloatConverter = subgroup->level_monitor_data.floatConverter;
-                    [self performAsynchronousMessageExchangeWithBlock:^{ subgroup->level_monitor_data.floatConverter = newFloatConverter; }
-                                                        responseBlock:^{ [oldFloatConverter release]; }];
+                    OSMemoryBarrier();
+                    subgroup->level_monitor_data.floatConverter = newFloatConverter;
+                    [self releaseObjectWhenRenderingComplete:oldFloatConverter];
+                }
+            }
+            
+            if ( subgroup->auxBus ) {
+                // Update aux bus converter to reflect new audio format
+                AudioStreamBasicDescription converterFormat = {};
+                if ( subgroup->auxBus->outputConverter ) converterFormat = subgroup->auxBus->outputConverter.sourceFormat;
+                if ( !subgroup->auxBus->outputConverter || memcmp(&converterFormat, &channel->audioDescription, sizeof(channel->audioDescription)) != 0 ) {
+                    AEFloatConverter *newFloatConverter = [[AEFloatConverter alloc] initWithSourceFormat:channel->audioDescription];
+                    AEFloatConverter *oldFloatConverter = subgroup->auxBus->outputConverter;
+                    OSMemoryBarrier();
+                    subgroup->auxBus->outputConverter = newFloatConverter;
+                    if ( oldFloatConverter ) [self releaseObjectWhenRenderingComplete:oldFloatConverter];
                 }
             }
             
             AUNode sourceNode = subgroup->converterNode ? subgroup->converterNode : subgroup->mixerNode;
             AudioUnit sourceUnit = subgroup->converterUnit ? subgroup->converterUnit : subgroup->mixerAudioUnit;
             
-            if ( hasFilters || channel->audiobusSenderPort ) {
-                // We need to use our own render callback, because we're either filtering, or sending via Audiobus (and we may need to adjust timestamp)
+            if ( parentIsSoftwareMixing ) {
+                // The parent group's mixer pulls this group through our render callback
+                if ( channel->setRenderNotification ) {
+                    checkResult(AudioUnitRemoveRenderNotify(sourceUnit, &groupRenderNotifyCallback, channel), "AudioUnitRemoveRenderNotify");
+                    channel->setRenderNotification = NO;
+                }
+                
+                [self updateSoftwareMixerInputForChannel:channel];
+                
+            } else if ( hasFilters || channel->audiobusSenderPort || subgroup->softwareMixing || channel->delayLine || channel->sendCount || subgroup->auxBus ) {
+                // We need to use our own render callback, because we're either filtering, sending via Audiobus (and we may need to adjust timestamp),
+                // mixing in software, delaying to compensate for latency elsewhere, or sending to or acting as an aux bus
                 
                 if ( channel->setRenderNotification ) {
                     // Remove render notification if there was one set
@@ -2922,7 +6390,16 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
         }
         
         
-        if ( group ) {
+        if ( !parentIsSoftwareMixing && channel->mixerInput ) {
+            // Channel is now mixed by a mixer unit
+            [self releaseSoftwareMixerInputForChannel:channel];
+        }
+        
+        if ( channel->sendCount ) {
+            [self updateSendFloatConverterForChannel:channel];
+        }
+        
+        if ( group && !parentIsSoftwareMixing ) {
             // Set volume
             AudioUnitParameterValue volumeValue = channel->volume;
             checkResult(AudioUnitSetParameter(group->mixerAudioUnit, kMultiChannelMixerParam_Volume, kAudioUnitScope_Input, i, volumeValue, 0),
@@ -2949,17 +6426,33 @@ NSTimeInterval AEAudioControllerOutputLatency(AEAudioController *controller) {
     }
 }
 
+- (void)appendChannels:(AEChannelRef*)channels count:(int)count toGroup:(AEChannelGroupRef)group {
+    if ( group->channelCount + count > group->channelCapacity ) {
+        // The realtime thread never sees this copy of the table, so it can simply grow
+        int newCapacity = MAX(group->channelCapacity * 2, kInitialChannelTableCapacity);
+        while ( newCapacity < group->channelCount + count ) newCapacity *= 2;
+        group->channels = (AEChannelRef*)realloc(group->channels, newCapacity * sizeof(AEChannelRef));
+        group->channelCapacity = newCapacity;
+    }
+    
+    memcpy(&group->channels[group->channelCount], channels, count * sizeof(AEChannelRef));
+    group->channelCount += count;
+    [self markGroupForPublication:group];
+}
+
 static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef group, void **ptrs, void **objects, AEChannelRef *outChannelReferences, int count) {
-    // Disable matching channels first
+    // Disable matching channels first, as the mixer may keep pulling them until the graph is updated
     for ( int i=0; i < count; i++ ) {
-        // Find the channel in our fixed array
+        // Find the channel in our array
         int index = 0;
         for ( index=0; index < group->channelCount; index++ ) {
             if ( group->channels[index] && group->channels[index]->ptr == ptrs[i] && group->channels[index]->object == objects[i] ) {
                 // Disable this channel until we update the graph
-                AudioUnitParameterValue enabledValue = 0;
-                checkResult(AudioUnitSetParameter(group->mixerAudioUnit, kMultiChannelMixerParam_Enable, kAudioUnitScope_Input, index, enabledValue, 0),
-                            "AudioUnitSetParameter(kMultiChannelMixerParam_Enable)");
+                if ( group->mixerAudioUnit ) {
+                    AudioUnitParameterValue enabledValue = 0;
+                    checkResult(AudioUnitSetParameter(group->mixerAudioUnit, kMultiChannelMixerParam_Enable, kAudioUnitScope_Input, index, enabledValue, 0),
+                                "AudioUnitSetParameter(kMultiChannelMixerParam_Enable)");
+                }
             }
         }
     }
@@ -2986,6 +6479,8 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
             }
         }
     }
+    
+    [THIS markGroupForPublication:group];
 }
 
 - (void)gatherChannelsFromGroup:(AEChannelGroupRef)group intoArray:(NSMutableArray*)array {
@@ -3035,6 +6530,39 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
         channel->audiobusFloatConverter = nil;
     }
     
+    if ( channel->mixerInput ) {
+        freeSoftwareMixerInput(channel->mixerInput);
+        channel->mixerInput = NULL;
+    }
+    
+    if ( channel->renderDelayLine && channel->renderDelayLine != channel->delayLine ) {
+        delayLineDestroy(channel->renderDelayLine);
+    }
+    channel->renderDelayLine = NULL;
+    if ( channel->delayLine ) {
+        delayLineDestroy(channel->delayLine);
+        channel->delayLine = NULL;
+    }
+    
+    if ( channel->clientFormatConverter ) {
+        [channel->clientFormatConverter release];
+        channel->clientFormatConverter = nil;
+    }
+    
+    if ( channel->renderSends != channel->sends ) {
+        free(channel->renderSends);
+    }
+    channel->renderSends = NULL;
+    if ( channel->sends ) {
+        free(channel->sends);
+        channel->sends = NULL;
+    }
+    
+    if ( channel->sendFloatConverter ) {
+        [channel->sendFloatConverter release];
+        channel->sendFloatConverter = nil;
+    }
+    
     if ( channel->type == kChannelTypeGroup ) {
         [self releaseResourcesForGroup:(AEChannelGroupRef)channel->ptr];
     } else if ( channel->type == kChannelTypeChannel ) {
@@ -3044,6 +6572,8 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
         [(NSObject*)channel->object release];
     }
     
+    free(channel->callbacks.callbacks);
+    free(channel->callbacks.renderCallbacks);
     free(channel);
 }
 
@@ -3054,6 +6584,10 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
         group->mixerAudioUnit = NULL;
     }
     
+    if ( group->mixerOutputConverter ) {
+        [group->mixerOutputConverter release];
+    }
+    
     // Release channel resources too
     for ( int i=0; i<group->channelCount; i++ ) {
         if ( group->channels[i] ) {
@@ -3061,6 +6595,14 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
         }
     }
     
+    if ( group->auxBus ) {
+        auxBusDestroy(group->auxBus);
+    }
+    
+    free(group->channels);
+    free(group->renderChannels);
+    free(group->renderedInputs);
+    free(group->schedule);
     free(group);
 }
 
@@ -3070,9 +6612,6 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
     group->converterUnit = NULL;
     group->converterNode = 0;
     memset(&group->channel->audioDescription, 0, sizeof(AudioStreamBasicDescription));
-    if ( group->level_monitor_data.scratchBuffer ) {
-        AEFreeAudioBufferList(group->level_monitor_data.scratchBuffer);
-    }
     if ( group->level_monitor_data.floatConverter ) {
         [group->level_monitor_data.floatConverter release];
     }
@@ -3088,7 +6627,7 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
 }
 
 - (BOOL)usingVPIO {
-    return _voiceProcessingEnabled && _inputEnabled && (!_voiceProcessingOnlyForSpeakerAndMicrophone || _playingThroughDeviceSpeaker);
+    return !_offline && _voiceProcessingEnabled && _inputEnabled && (!_voiceProcessingOnlyForSpeakerAndMicrophone || _playingThroughDeviceSpeaker);
 }
 
 - (BOOL)attemptRecoveryFromSystemError:(NSError**)error {
@@ -3120,19 +6659,119 @@ static void removeChannelsFromGroup(AEAudioController *THIS, AEChannelGroupRef g
 
 #pragma mark - Callback management
 
+static void compileCallbackTable(const callback_table_t *table, callback_table_t *compiled) {
+    // Prepare a render copy of the main thread's table, in the render fields of the compiled table
+    memset(compiled, 0, sizeof(callback_table_t));
+    int count = table->count;
+    if ( count == 0 ) return;
+    
+    callback_t *callbacks = (callback_t*)calloc(1, count * (3*sizeof(callback_t) + sizeof(render_profile_t)));
+    compiled->renderCount = count;
+    compiled->renderCallbacks = callbacks;
+    compiled->filters = callbacks + count;
+    compiled->receivers = callbacks + (count * 2);
+    compiled->profiles = (render_profile_t*)(callbacks + (count * 3));
+    
+    memcpy(callbacks, table->callbacks, count * sizeof(callback_t));
+    for ( int i=0; i<count; i++ ) {
+        callbacks[i].profile = &compiled->profiles[i];
+        callbacks[i].silentFrames = 0;
+        compiled->profiles[i].node = callbacks[i].userInfo;
+        compiled->profiles[i].nodeType = callbacks[i].flags & kFilterFlag ? AERenderProfileNodeTypeFilter : AERenderProfileNodeTypeReceiver;
+    }
+    
+    // Filters are applied most recently added first
+    for ( int i=count-1; i>=0; i-- ) {
+        if ( callbacks[i].flags & kFilterFlag ) {
+            compiled->filters[compiled->filterCount++] = callbacks[i];
+        }
+    }
+    
+    for ( int i=0; i<count; i++ ) {
+        if ( callbacks[i].flags & kReceiverFlag ) {
+            compiled->receivers[compiled->receiverCount++] = callbacks[i];
+        }
+    }
+}
+
+static void publishCallbackTable(callback_table_t *table, callback_table_t *compiled) {
+    // Performed on the realtime thread. Carry the profiles over now, so no renders are lost.
+    for ( int i=0; i<compiled->renderCount; i++ ) {
+        for ( int j=0; j<table->renderCount; j++ ) {
+            if ( table->renderCallbacks[j].callback == compiled->renderCallbacks[i].callback
+                    && table->renderCallbacks[j].userInfo == compiled->renderCallbacks[i].userInfo ) {
+                compiled->profiles[i] = table->profiles[j];
+                break;
+            }
+        }
+    }
+    
+    // Then swap, leaving the old render copy in the compiled table
+    callback_table_t old = *table;
+    table->renderCount = compiled->renderCount;
+    table->renderCallbacks = compiled->renderCallbacks;
+    table->filterCount = compiled->filterCount;
+    table->filters = compiled->filters;
+    table->receiverCount = compiled->receiverCount;
+    table->receivers = compiled->receivers;
+    table->profiles = compiled->profiles;
+    compiled->renderCount = old.renderCount;
+    compiled->renderCallbacks = old.renderCallbacks;
+    compiled->filterCount = old.filterCount;
+    compiled->filters = old.filters;
+    compiled->receiverCount = old.receiverCount;
+    compiled->receivers = old.receivers;
+    compiled->profiles = old.profiles;
+}
+
 static callback_t *addCallbackToTable(AEAudioController *THIS, callback_table_t *table, void *callback, void *userInfo, int flags) {
+    if ( table->count == table->capacity ) {
+        // The realtime thread never sees this copy of the table, so it can simply grow
+        table->capacity = MAX(table->capacity * 2, kInitialCallbackTableCapacity);
+        table->callbacks = (callback_t*)realloc(table->callbacks, table->capacity * sizeof(callback_t));
+    }
+    
     callback_t *callback_struct = &table->callbacks[table->count];
+    memset(callback_struct, 0, sizeof(callback_t));
     callback_struct->callback = callback;
     callback_struct->userInfo = userInfo;
     callback_struct->flags = flags;
+    callback_struct->tailFrames = kUnknownTailFrames;
+    callback_struct->silentFrames = 0;
+    callback_struct->latencyFrames = 0;
     table->count++;
+    [THIS markCallbackTableForPublication:table];
     return callback_struct;
 }
 
+- (void)addCallback:(void*)callback userInfo:(void*)userInfo flags:(uint8_t)flags toTable:(callback_table_t*)table {
+    UInt32 tailFrames = kUnknownTailFrames;
+    if ( (flags & kFilterFlag) && [(id)userInfo respondsToSelector:@selector(tailTime)] ) {
+        // Filters that declare a tail can be skipped once it has decayed after their input goes silent
+        tailFrames = (UInt32)round(((id<AEAudioFilter>)userInfo).tailTime * _audioDescription.mSampleRate);
+    }
+    
+    if ( (flags & kReceiverFlag) && [(id)userInfo respondsToSelector:@selector(requiresClientFormat)] && ((id<AEAudioReceiver>)userInfo).requiresClientFormat ) {
+        // Converted from the bus format for this receiver, if necessary
+        flags |= kClientFormatFlag;
+    }
+    
+    UInt32 latencyFrames = 0;
+    if ( (flags & kFilterFlag) && [(id)userInfo respondsToSelector:@selector(latency)] ) {
+        // Filters that delay their audio have the other paths through their groups delayed to match
+        latencyFrames = (UInt32)round(MAX(0, ((id<AEAudioFilter>)userInfo).latency) * _audioDescription.mSampleRate);
+    }
+    
+    // Seen by the realtime thread once the table is published
+    callback_t *entry = addCallbackToTable(self, table, callback, userInfo, flags);
+    entry->tailFrames = tailFrames;
+    entry->latencyFrames = latencyFrames;
+}
+
 static void removeCallbackFromTable(AEAudioController *THIS, callback_table_t *table, void *callback, void *userInfo, BOOL *found_p) {
     BOOL found = NO;
     
-    // Find the item in our fixed array
+    // Find the item in our array
     int index = 0;
     for ( index=0; index<table->count; index++ ) {
         if ( table->callbacks[index].callback == callback && table->callbacks[index].userInfo == userInfo ) {
@@ -3146,9 +6785,17 @@ static void removeCallbackFromTable(AEAudioController *THIS, callback_table_t *t
         for ( int i=index; i<table->count; i++ ) {
             table->callbacks[i] = table->callbacks[i+1];
         }
+        [THIS markCallbackTableForPublication:table];
     }
     
-    if ( found_p ) *found_p = found;
+    if ( found_p && found ) *found_p = YES;
+}
+
+static BOOL callbackTableHasFlags(callback_table_t *table, uint8_t flags) {
+    for ( int i=0; i<table->count; i++ ) {
+        if ( (table->callbacks[i].flags & flags) == flags ) return YES;
+    }
+    return NO;
 }
 
 - (NSArray *)associatedObjectsFromTable:(callback_table_t*)table matchingFlag:(uint8_t)flag {
@@ -3170,27 +6817,24 @@ static void removeCallbackFromTable(AEAudioController *THIS, callback_table_t *t
     
     AEChannelRef channel = parentGroup->channels[index];
     
-    if ( channel->callbacks.count == kMaximumCallbacksPerSource ) {
-        NSLog(@"Warning: Maximum number of callbacks reached");
-        return NO;
+    [self addCallback:callback userInfo:userInfo flags:flags toTable:&channel->callbacks];
+    
+    if ( (flags & kFilterFlag) && [(id)userInfo respondsToSelector:@selector(latency)] ) {
+        // Realign the channel's siblings
+        checkResult([self updateGraph], "Update graph");
     }
     
-    [self performSynchronousMessageExchangeWithBlock:^{
-        addCallbackToTable(self, &channel->callbacks, callback, userInfo, flags);
-    }];
+    if ( flags & kReceiverFlag ) {
+        [self updateClientFormatConvertersForChannel:channel];
+    }
+    
+    [self publishUpdates];
     
     return YES;
 }
 
 - (BOOL)addCallback:(void*)callback userInfo:(void*)userInfo flags:(uint8_t)flags forChannelGroup:(AEChannelGroupRef)group {
-    if ( group->channel->callbacks.count == kMaximumCallbacksPerSource ) {
-        NSLog(@"Warning: Maximum number of callbacks reached");
-        return NO;
-    }
-    
-    [self performSynchronousMessageExchangeWithBlock:^{
-        addCallbackToTable(self, &group->channel->callbacks, callback, userInfo, flags);
-    }];
+    [self addCallback:callback userInfo:userInfo flags:flags toTable:&group->channel->callbacks];
     
     AEChannelGroupRef parentGroup = NULL;
     int index=0;
@@ -3236,18 +6880,16 @@ static void removeCallbackFromTable(AEAudioController *THIS, callback_table_t *t
         }
     }
     
-    if ( callbackTable->count == kMaximumCallbacksPerSource ) {
-        NSLog(@"Warning: Maximum number of callbacks reached");
-        return NO;
-    }
-    [self performSynchronousMessageExchangeWithBlock:^{
-        if ( inputCallbacks ) {
+    if ( inputCallbacks ) {
+        // A new channel map changes the input tables themselves, so isn't held back with the other changes
+        [self performSynchronousMessageExchangeWithBlock:^{
             _inputCallbacks = inputCallbacks;
             _inputCallbackCount = inputCallbackCount;
-        }
-        
-        addCallbackToTable(self, callbackTable, callback, userInfo, flags);
-    }];
+        }];
+        [self movePendingPublicationsFromInputTables:oldMultichannelInputCallbacks count:inputCallbackCount-1 toInputTables:inputCallbacks];
+    }
+    
+    [self addCallback:callback userInfo:userInfo flags:flags toTable:callbackTable];
     
     if ( inputCallbacks ) {
         free(oldMultichannelInputCallbacks);
@@ -3255,6 +6897,8 @@ static void removeCallbackFromTable(AEAudioController *THIS, callback_table_t *t
         [self updateInputDeviceStatus];
     }
     
+    [self publishUpdates];
+    
     return YES;
 }
 
@@ -3265,19 +6909,22 @@ static void removeCallbackFromTable(AEAudioController *THIS, callback_table_t *t
     
     AEChannelRef channel = parentGroup->channels[index];
     
-    __block BOOL found = NO;
-    [self performSynchronousMessageExchangeWithBlock:^{
-        removeCallbackFromTable(self, &channel->callbacks, callback, userInfo, &found);
-    }];
+    BOOL found = NO;
+    removeCallbackFromTable(self, &channel->callbacks, callback, userInfo, &found);
+    
+    if ( found && [(id)userInfo respondsToSelector:@selector(latency)] ) {
+        // Realign the channel's siblings
+        checkResult([self updateGraph], "Update graph");
+    }
+    
+    [self publishUpdates];
     
     return found;
 }
 
 - (BOOL)removeCallback:(void*)callback userInfo:(void*)userInfo fromChannelGroup:(AEChannelGroupRef)group {
-    __block BOOL found = NO;
-    [self performSynchronousMessageExchangeWithBlock:^{
-        removeCallbackFromTable(self, &group->channel->callbacks, callback, userInfo, &found);
-    }];
+    BOOL found = NO;
+    removeCallbackFromTable(self, &group->channel->callbacks, callback, userInfo, &found);
     
     if ( !found ) return NO;
     
@@ -3314,20 +6961,40 @@ static void removeCallbackFromTable(AEAudioController *THIS, callback_table_t *t
 }
 
 static void handleCallbacksForChannel(AEChannelRef channel, const AudioTimeStamp *inTimeStamp, UInt32 inNumberFrames, AudioBufferList *ioData) {
+    AEFloatConverter *clientFormatConverter = channel->clientFormatConverter;
+    const AudioStreamBasicDescription *clientFormat = &channel->audioController->_audioDescription;
+    int clientBufferCount = clientFormat->mFormatFlags & kAudioFormatFlagIsNonInterleaved ? clientFormat->mChannelsPerFrame : 1;
+    char clientAudioSpace[sizeof(AudioBufferList)+(clientBufferCount-1)*sizeof(AudioBuffer)];
+    AudioBufferList *clientAudio = NULL;
+    
     // Pass audio to output callbacks
-    for ( int i=0; i<channel->callbacks.count; i++ ) {
-        callback_t *callback = &channel->callbacks.callbacks[i];
-        if ( callback->flags & kReceiverFlag ) {
-            ((AEAudioControllerAudioCallback)callback->callback)(callback->userInfo, channel->audioController, channel->ptr, inTimeStamp, inNumberFrames, ioData);
+    for ( int i=0; i<channel->callbacks.receiverCount; i++ ) {
+        callback_t *callback = &channel->callbacks.receivers[i];
+        AudioBufferList *audio = ioData;
+        
+        if ( (callback->flags & kClientFormatFlag) && clientFormatConverter ) {
+            if ( !clientAudio ) {
+                // Convert once, into pooled scratch space, for all the receivers that need it
+                render_buffer_pool_t *pool = channel->audioController->_renderBufferPool;
+                AudioBufferList *buffer = (AudioBufferList*)clientAudioSpace;
+                if ( renderBufferSlotAssignToBufferList(pool, renderBufferLaneSlot(pool, renderBufferPoolCurrentLane(pool)), clientFormat, inNumberFrames, buffer)
+                        && AEFloatConverterFromFloatBufferList(clientFormatConverter, ioData, buffer, inNumberFrames) ) {
+                    clientAudio = buffer;
+                }
+            }
+            if ( !clientAudio ) continue;
+            audio = clientAudio;
         }
+        
+        uint64_t start = renderProfileStart(channel->audioController);
+        ((AEAudioControllerAudioCallback)callback->callback)(callback->userInfo, channel->audioController, channel->ptr, inTimeStamp, inNumberFrames, audio);
+        renderProfileRecord(channel->audioController, callback->profile, start, 0, inNumberFrames);
     }
 }
 
 #pragma mark - Assorted helpers
 
-static void performLevelMonitoring(audio_level_monitor_t* monitor, AudioBufferList *buffer, UInt32 numberFrames) {
-    if ( !monitor->floatConverter || !monitor->scratchBuffer ) return;
-    
+static inline void resetLevelMonitorIfNeeded(audio_level_monitor_t* monitor) {
     if ( monitor->reset ) {
         monitor->reset  = NO;
         monitor->meanAccumulator = 0;
@@ -3335,22 +7002,47 @@ static void performLevelMonitoring(audio_level_monitor_t* monitor, AudioBufferLi
         monitor->average         = 0;
         monitor->peak            = 0;
     }
+}
+
+static void performLevelMonitoring(render_buffer_pool_t *pool, audio_level_monitor_t* monitor, AudioBufferList *buffer, UInt32 numberFrames) {
+    if ( !monitor->floatConverter ) return;
+    
+    resetLevelMonitorIfNeeded(monitor);
     
-    UInt32 monitorFrames = min(numberFrames, kLevelMonitorScratchBufferSize);
-    AEFloatConverterToFloatBufferList(monitor->floatConverter, buffer, monitor->scratchBuffer, monitorFrames);
+    UInt32 monitorFrames = min(numberFrames, kMaximumFramesPerSlice);
+    AudioBufferList *scratchBuffer = buffer;
+    
+    AudioStreamBasicDescription floatFormat = monitor->floatConverter.floatingPointAudioDescription;
+    char scratchBufferSpace[sizeof(AudioBufferList)+(floatFormat.mChannelsPerFrame-1)*sizeof(AudioBuffer)];
+    if ( !AEFloatConverterIsPassThrough(monitor->floatConverter) ) {
+        // Convert into pooled scratch space; float audio is measured where it is
+        scratchBuffer = (AudioBufferList*)scratchBufferSpace;
+        if ( !renderBufferSlotAssignToBufferList(pool, renderBufferLaneSlot(pool, renderBufferPoolCurrentLane(pool)), &floatFormat, monitorFrames, scratchBuffer) ) return;
+        AEFloatConverterToFloatBufferList(monitor->floatConverter, buffer, scratchBuffer, monitorFrames);
+    }
     
-    for ( int i=0; i<monitor->scratchBuffer->mNumberBuffers; i++ ) {
+    for ( int i=0; i<scratchBuffer->mNumberBuffers; i++ ) {
         float peak = 0.0;
-        vDSP_maxmgv((float*)monitor->scratchBuffer->mBuffers[i].mData, 1, &peak, monitorFrames);
+        vDSP_maxmgv((float*)scratchBuffer->mBuffers[i].mData, 1, &peak, monitorFrames);
         if ( peak > monitor->peak ) monitor->peak = peak;
         float avg = 0.0;
-        vDSP_meamgv((float*)monitor->scratchBuffer->mBuffers[i].mData, 1, &avg, monitorFrames);
+        vDSP_meamgv((float*)scratchBuffer->mBuffers[i].mData, 1, &avg, monitorFrames);
         monitor->meanAccumulator += avg;
         monitor->meanBlockCount++;
         monitor->average = monitor->meanAccumulator / (double)monitor->meanBlockCount;
     }
 }
 
+static void performLevelMonitoringOfSilence(audio_level_monitor_t* monitor) {
+    // Same result as monitoring a zeroed buffer, without the conversion
+    if ( !monitor->floatConverter ) return;
+    
+    resetLevelMonitorIfNeeded(monitor);
+    
+    monitor->meanBlockCount += monitor->channels;
+    monitor->average = monitor->meanAccumulator / (double)monitor->meanBlockCount;
+}
+
 - (void)housekeeping {
     Float32 bufferDuration;
     UInt32 bufferDurationSize = sizeof(bufferDuration);
@@ -3381,7 +7073,6 @@ static void performLevelMonitoring(audio_level_monitor_t* monitor, AudioBufferLi
 }
 @end
 @implementation AEAudioControllerMessagePollThread
-@synthesize pollInterval = _pollInterval;
 - (id)initWithAudioController:(AEAudioController *)audioController {
     if ( !(self = [super init]) ) return nil;
     _audioController = audioController;
@@ -3393,7 +7084,9 @@ static void performLevelMonitoring(audio_level_monitor_t* monitor, AudioBufferLi
         if ( AEAudioControllerHasPendingMainThreadMessages(_audioController) ) {
             [_audioController performSelectorOnMainThread:@selector(pollForMessageResponses) withObject:nil waitUntilDone:NO];
         }
-        usleep(_pollInterval*1.0e6);
+        AEAudioControllerReleaseRetiredItems(_audioController);
+        // Sleep until a realtime thread sends a message, there are retired items to check on, or we're cancelled
+        AEAudioControllerWaitForMainThreadMessages(_audioController);
     }
 }
 @end
\ No newline at end of file
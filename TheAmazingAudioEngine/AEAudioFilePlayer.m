@@ -119,13 +119,13 @@ static OSStatus renderCallback(AEAudioFilePlayer *THIS, AEAudioController *audio
     int32_t playhead = THIS->_playhead;
     int32_t originalPlayhead = playhead;
     
-    if ( !THIS->_channelIsPlaying ) return noErr;
+    if ( !THIS->_channelIsPlaying ) return AEAudioControllerOutputIsSilence;
     
     if ( !THIS->_loop && playhead == THIS->_lengthInFrames ) {
         // Notify main thread that playback has finished
         AEAudioControllerSendAsynchronousMessageToMainThread(audioController, notifyPlaybackStopped, &THIS, sizeof(AEAudioFilePlayer*));
         THIS->_channelIsPlaying = NO;
-        return noErr;
+        return AEAudioControllerOutputIsSilence;
     }
     
     // Get pointers to each buffer that we can advance
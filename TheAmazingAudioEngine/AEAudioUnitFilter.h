@@ -100,6 +100,16 @@ extern "C" {
  */
 @property (nonatomic, readonly) AUNode audioGraphNode;
 
+/*!
+ * The format of the audio passing through the filter
+ *
+ *  Set by the audio controller when the filter is added, to match where it's added
+ *  (see @link AEAudioFilter::clientFormat @endlink). Changing it rebuilds the audio unit,
+ *  which loses any settings made to it, and passes audio through unprocessed meanwhile.
+ *  Defaults to the audio controller's busAudioDescription.
+ */
+@property (nonatomic, assign) AudioStreamBasicDescription clientFormat;
+
 @end
 
 #ifdef __cplusplus
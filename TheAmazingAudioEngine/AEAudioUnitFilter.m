@@ -48,6 +48,8 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
     AUGraph _audioGraph;
     AEAudioControllerFilterProducer _currentProducer;
     void *_currentProducerToken;
+    AudioStreamBasicDescription _clientFormat;
+    BOOL _bypassed;
 }
 @end
 
@@ -78,6 +80,7 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
     _componentDescription = audioComponentDescription;
     _useDefaultInputFormat = useDefaultInputFormat;
     _audioGraph = audioController.audioGraph;
+    _clientFormat = audioController.busAudioDescription;
 	
     if ( ![self setup:block error:error] ) {
         [self release];
@@ -103,7 +106,7 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
     checkResult(result=AudioUnitSetProperty(_audioUnit, kAudioUnitProperty_MaximumFramesPerSlice, kAudioUnitScope_Global, 0, &maxFPS, sizeof(maxFPS)), "kAudioUnitProperty_MaximumFramesPerSlice");
     
     // Try to set the output audio description
-    AudioStreamBasicDescription audioDescription = _audioController.audioDescription;
+    AudioStreamBasicDescription audioDescription = _clientFormat;
     result = AudioUnitSetProperty(_audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &audioDescription, sizeof(AudioStreamBasicDescription));
     if ( result == kAudioUnitErr_FormatNotSupported ) {
         // The audio description isn't supported. Assign modified default audio description, and create an audio converter.
@@ -137,7 +140,7 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
     }
     
     // Try to set the input audio description
-    audioDescription = _audioController.audioDescription;
+    audioDescription = _clientFormat;
     
     if ( !_useDefaultInputFormat ) {
         result = AudioUnitSetProperty(_audioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &audioDescription, sizeof(AudioStreamBasicDescription));
@@ -211,9 +214,7 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
     return YES;
 }
 
--(void)dealloc {
-    [[NSNotificationCenter defaultCenter] removeObserver:self name:AEAudioControllerDidRecreateGraphNotification object:_audioController];
-    
+- (void)teardown {
     if ( _node ) {
         checkResult(AUGraphRemoveNode(_audioGraph, _node), "AUGraphRemoveNode");
     }
@@ -226,9 +227,44 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
     
     checkResult(AUGraphUpdate(_audioGraph, NULL), "AUGraphUpdate");
     
+    _node = 0;
+    _audioUnit = NULL;
+    _inConverterNode = 0;
+    _inConverterUnit = NULL;
+    _outConverterNode = 0;
+    _outConverterUnit = NULL;
+}
+
+-(void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self name:AEAudioControllerDidRecreateGraphNotification object:_audioController];
+    
+    [self teardown];
+    
     [super dealloc];
 }
 
+-(AudioStreamBasicDescription)clientFormat {
+    return _clientFormat;
+}
+
+-(void)setClientFormat:(AudioStreamBasicDescription)clientFormat {
+    if ( memcmp(&clientFormat, &_clientFormat, sizeof(clientFormat)) == 0 ) return;
+    
+    // Pass audio straight through while the units are rebuilt in the new format
+    [_audioController performSynchronousMessageExchangeWithBlock:^{
+        _bypassed = YES;
+    }];
+    
+    [self teardown];
+    _clientFormat = clientFormat;
+    
+    if ( [self setup:nil error:NULL] ) {
+        [_audioController performSynchronousMessageExchangeWithBlock:^{
+            _bypassed = NO;
+        }];
+    }
+}
+
 -(AudioUnit)audioUnit {
     return _audioUnit;
 }
@@ -237,6 +273,16 @@ static inline BOOL _checkResult(OSStatus result, const char *operation, const ch
     return _node;
 }
 
+-(NSTimeInterval)latency {
+    if ( !_audioUnit ) return 0;
+    Float64 latency = 0;
+    UInt32 size = sizeof(latency);
+    if ( !checkResult(AudioUnitGetProperty(_audioUnit, kAudioUnitProperty_Latency, kAudioUnitScope_Global, 0, &latency, &size), "AudioUnitGetProperty(kAudioUnitProperty_Latency)") ) {
+        return 0;
+    }
+    return latency;
+}
+
 static OSStatus filterCallback(id                        filter,
                                AEAudioController        *audioController,
                                AEAudioControllerFilterProducer producer,
@@ -246,6 +292,10 @@ static OSStatus filterCallback(id                        filter,
                                AudioBufferList          *audio) {
     AEAudioUnitFilter *THIS = (AEAudioUnitFilter*)filter;
     
+    if ( THIS->_bypassed ) {
+        return producer(producerToken, audio, &frames);
+    }
+    
     THIS->_currentProducer = producer;
     THIS->_currentProducerToken = producerToken;
     
@@ -107,6 +107,17 @@ BOOL AEFloatConverterFromFloat(AEFloatConverter* converter, float * const * sour
  */
 BOOL AEFloatConverterFromFloatBufferList(AEFloatConverter* converter, AudioBufferList *sourceBuffer, AudioBufferList *targetBuffer, UInt32 frames);
 
+/*!
+ * Determine whether conversion is a straight copy
+ *
+ *  True if the source format is already the non-interleaved floating-point format, in
+ *  which case callers may work on the source audio directly rather than converting it.
+ *
+ * @param converter         Pointer to the converter object.
+ * @return YES if the source format is the floating-point format
+ */
+BOOL AEFloatConverterIsPassThrough(AEFloatConverter* converter);
+
 /*!
  * The AudioStreamBasicDescription representing the converted floating-point format
  */
@@ -142,6 +142,7 @@ BOOL AEFloatConverterToFloat(AEFloatConverter* THIS, AudioBufferList *sourceBuff
         
     } else {
         for ( int i=0; i<sourceBuffer->mNumberBuffers; i++ ) {
+            if ( targetBuffers[i] == sourceBuffer->mBuffers[i].mData ) continue;
             memcpy(targetBuffers[i], sourceBuffer->mBuffers[i].mData, frames * sizeof(float));
         }
     }
@@ -189,6 +190,7 @@ BOOL AEFloatConverterFromFloat(AEFloatConverter* THIS, float * const * sourceBuf
         }
     } else {
         for ( int i=0; i<targetBuffer->mNumberBuffers; i++ ) {
+            if ( targetBuffer->mBuffers[i].mData == sourceBuffers[i] ) continue;
             memcpy(targetBuffer->mBuffers[i].mData, sourceBuffers[i], frames * sizeof(float));
         }
     }
@@ -206,6 +208,10 @@ BOOL AEFloatConverterFromFloatBufferList(AEFloatConverter* converter, AudioBuffe
     return AEFloatConverterFromFloat(converter, sourceBuffers, targetBuffer, frames);
 }
 
+BOOL AEFloatConverterIsPassThrough(AEFloatConverter* THIS) {
+    return memcmp(&THIS->_sourceAudioDescription, &THIS->_floatAudioDescription, sizeof(AudioStreamBasicDescription)) == 0;
+}
+
 static OSStatus complexInputDataProc(AudioConverterRef             inAudioConverter,
                                      UInt32                        *ioNumberDataPackets,
                                      AudioBufferList               *ioData,
@@ -27,10 +27,37 @@
 //  3. This notice may not be removed or altered from any source distribution.
 //
 
+#if !defined(__APPLE__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // For memfd_create
+#endif
+
 #include "TPCircularBuffer.h"
-#include <mach/mach.h>
 #include <stdio.h>
 
+static inline int32_t indexableLength(int32_t pageRoundedLength) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    // Free-running indices are masked, so the length must be a power of two
+    int32_t length = 1;
+    while ( length < pageRoundedLength ) length <<= 1;
+    return length;
+#else
+    return pageRoundedLength;
+#endif
+}
+
+static inline void resetIndices(TPCircularBuffer *buffer) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    buffer->head = buffer->tail = 0;
+#else
+    buffer->fillCount = 0;
+    buffer->head = buffer->tail = 0;
+#endif
+}
+
+#ifdef __APPLE__
+
+#include <mach/mach.h>
+
 #define reportResult(result,operation) (_reportResult((result),(operation),strrchr(__FILE__, '/')+1,__LINE__))
 static inline bool _reportResult(kern_return_t result, const char *operation, const char* file, int line) {
     if ( result != ERR_SUCCESS ) {
@@ -46,7 +73,7 @@ bool TPCircularBufferInit(TPCircularBuffer *buffer, int length) {
     int retries = 3;
     while ( true ) {
 
-        buffer->length = (int32_t)round_page(length);    // We need whole page sizes
+        buffer->length = indexableLength((int32_t)round_page(length));    // We need whole page sizes
 
         // Temporarily allocate twice the length, so we have the contiguous address space to
         // support a second instance of the buffer directly after
@@ -115,8 +142,7 @@ bool TPCircularBufferInit(TPCircularBuffer *buffer, int length) {
         }
         
         buffer->buffer = (void*)bufferAddress;
-        buffer->fillCount = 0;
-        buffer->head = buffer->tail = 0;
+        resetIndices(buffer);
         
         return true;
     }
@@ -128,6 +154,134 @@ void TPCircularBufferCleanup(TPCircularBuffer *buffer) {
     memset(buffer, 0, sizeof(TPCircularBuffer));
 }
 
+#else
+
+//
+//  POSIX implementation
+//
+//  The same mirroring technique, using a memory file descriptor (memfd_create on Linux, or an
+//  unlinked POSIX shared memory object elsewhere) mapped twice, back-to-back, into a reserved
+//  region of address space.
+//
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+
+#define reportResult(result,operation) (_reportResult((result),(operation),strrchr(__FILE__, '/')+1,__LINE__))
+static inline bool _reportResult(int result, const char *operation, const char* file, int line) {
+    if ( result != 0 ) {
+        printf("%s:%d: %s: %s\n", file, line, operation, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static int createMemoryFile(bool hugePages) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    unsigned int flags = MFD_CLOEXEC;
+#ifdef MFD_HUGETLB
+    if ( hugePages ) flags |= MFD_HUGETLB;
+#else
+    if ( hugePages ) return -1;
+#endif
+    return memfd_create("TPCircularBuffer", flags);
+#else
+    if ( hugePages ) return -1;
+    
+    // Create a uniquely-named shared memory object, then unlink it straight away so only our descriptor refers to it
+    char name[64];
+    for ( int attempt=0; attempt<16; attempt++ ) {
+        snprintf(name, sizeof(name), "/TPCircularBuffer-%ld-%d-%p", (long)getpid(), attempt, (void*)name);
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if ( fd >= 0 ) {
+            shm_unlink(name);
+            return fd;
+        }
+        if ( errno != EEXIST ) break;
+    }
+    return -1;
+#endif
+}
+
+static bool mapMirroredBuffer(TPCircularBuffer *buffer, int32_t length, size_t alignment, bool hugePages) {
+    int fd = createMemoryFile(hugePages);
+    if ( fd < 0 ) {
+        if ( !hugePages ) reportResult(-1, "Create memory file");
+        return false;
+    }
+    
+    if ( ftruncate(fd, length) != 0 ) {
+        if ( !hugePages ) reportResult(-1, "Resize memory file");
+        close(fd);
+        return false;
+    }
+    
+    // Reserve contiguous address space for both copies of the buffer (with some slack so we can align it)
+    size_t reservedLength = (size_t)length * 2 + alignment;
+    char *reservedAddress = mmap(NULL, reservedLength, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( reservedAddress == MAP_FAILED ) {
+        reportResult(-1, "Reserve address space");
+        close(fd);
+        return false;
+    }
+    
+    char *bufferAddress = (char*)(((uintptr_t)reservedAddress + alignment - 1) & ~((uintptr_t)alignment - 1));
+    
+    // Give back the slack on either side of the aligned region
+    if ( bufferAddress > reservedAddress ) {
+        munmap(reservedAddress, bufferAddress - reservedAddress);
+    }
+    char *reservedEnd = reservedAddress + reservedLength;
+    char *bufferEnd = bufferAddress + (size_t)length * 2;
+    if ( reservedEnd > bufferEnd ) {
+        munmap(bufferEnd, reservedEnd - bufferEnd);
+    }
+    
+    // Map the file over the first half of the reservation, then again over the second half as the mirror
+    if ( mmap(bufferAddress, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+            || mmap(bufferAddress + length, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ) {
+        if ( !hugePages ) reportResult(-1, "Map buffer memory");
+        munmap(bufferAddress, (size_t)length * 2);
+        close(fd);
+        return false;
+    }
+    
+    // The mappings keep the memory alive
+    close(fd);
+    
+    buffer->buffer = bufferAddress;
+    buffer->length = length;
+    resetIndices(buffer);
+    
+    return true;
+}
+
+bool TPCircularBufferInit(TPCircularBuffer *buffer, int length) {
+    
+    if ( length >= kTPCircularBufferHugePageThreshold ) {
+        // Try huge pages first for large buffers, to cut TLB pressure; fall through to regular pages if unavailable
+        int32_t hugePageLength = indexableLength((int32_t)(((size_t)length + kTPCircularBufferHugePageSize - 1) & ~((size_t)kTPCircularBufferHugePageSize - 1)));
+        if ( mapMirroredBuffer(buffer, hugePageLength, kTPCircularBufferHugePageSize, true) ) {
+            return true;
+        }
+    }
+    
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    int32_t pageLength = indexableLength((int32_t)(((size_t)length + pageSize - 1) & ~(pageSize - 1))); // We need whole page sizes
+    return mapMirroredBuffer(buffer, pageLength, pageSize, false);
+}
+
+void TPCircularBufferCleanup(TPCircularBuffer *buffer) {
+    munmap(buffer->buffer, (size_t)buffer->length * 2);
+    memset(buffer, 0, sizeof(TPCircularBuffer));
+}
+
+#endif
+
 void TPCircularBufferClear(TPCircularBuffer *buffer) {
     int32_t fillCount;
     if ( TPCircularBufferTail(buffer, &fillCount) ) {
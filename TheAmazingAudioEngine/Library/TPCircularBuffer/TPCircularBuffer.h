@@ -17,6 +17,9 @@
 //  adapted to Darwin by Kurt Revis (http://www.snoize.com,
 //  http://www.snoize.com/Code/PlayBufferedSoundFile.tar.gz)
 //
+//  On other POSIX systems, the mirror is built from two mappings of the same memory file
+//  (memfd_create on Linux), optionally backed by huge pages for large buffers.
+//
 //
 //  Copyright (C) 2012-2013 A Tasty Pixel
 //
@@ -42,14 +45,72 @@
 #ifndef TPCircularBuffer_h
 #define TPCircularBuffer_h
 
-#include <libkern/OSAtomic.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __APPLE__
+#include <libkern/OSAtomic.h>
+#else
+// Equivalent of the OSAtomic primitive, for non-Darwin platforms
+static __inline__ __attribute__((always_inline)) int32_t OSAtomicAdd32Barrier(int32_t amount, volatile int32_t *value) {
+    return __sync_add_and_fetch(value, amount);
+}
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
+
+#ifndef __APPLE__
+/*!
+ * Huge page backing (POSIX implementation only)
+ *
+ *  Buffers at least kTPCircularBufferHugePageThreshold bytes long will first be
+ *  backed by huge pages of kTPCircularBufferHugePageSize bytes, if the system has
+ *  any available; otherwise regular pages are used. Define either before including
+ *  this header to override.
+ */
+#ifndef kTPCircularBufferHugePageSize
+#define kTPCircularBufferHugePageSize (2*1024*1024)
+#endif
+#ifndef kTPCircularBufferHugePageThreshold
+#define kTPCircularBufferHugePageThreshold kTPCircularBufferHugePageSize
+#endif
+#endif
+    
+#ifndef TPCIRCULARBUFFER_SPLIT_INDICES
+/*!
+ * Split index variant
+ *
+ *  Define TPCIRCULARBUFFER_SPLIT_INDICES to 1 (for the whole project, as it changes the
+ *  layout of TPCircularBuffer) to use monotonically increasing head and tail indices that
+ *  live on separate cache lines, published with acquire/release atomics instead of
+ *  full barriers on a shared fill count. The producer and consumer then only ever write
+ *  to their own cache line. In this mode the buffer length is rounded up to a power of two.
+ */
+#define TPCIRCULARBUFFER_SPLIT_INDICES 0
+#endif
+
+#define kTPCircularBufferCacheLineSize 64
+
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+
+typedef struct {
+    void             *buffer;
+    int32_t           length;
+    char              _padding0[kTPCircularBufferCacheLineSize - sizeof(void*) - sizeof(int32_t)];
     
+    uint32_t          head;     // Written only by the producer
+    char              _padding1[kTPCircularBufferCacheLineSize - sizeof(uint32_t)];
+    
+    uint32_t          tail;     // Written only by the consumer
+    char              _padding2[kTPCircularBufferCacheLineSize - sizeof(uint32_t)];
+} TPCircularBuffer;
+
+#else
+
 typedef struct {
     void             *buffer;
     int32_t           length;
@@ -58,12 +119,15 @@ typedef struct {
     volatile int32_t  fillCount;
 } TPCircularBuffer;
 
+#endif
+
 /*!
  * Initialise buffer
  *
  *  Note that the length is advisory only: Because of the way the
  *  memory mirroring technique works, the true buffer length will
- *  be multiples of the device page size (e.g. 4096 bytes)
+ *  be multiples of the device page size (e.g. 4096 bytes), or of
+ *  the huge page size for large buffers on POSIX systems.
  *
  * @param buffer Circular buffer
  * @param length Length of buffer
@@ -100,9 +164,16 @@ void  TPCircularBufferClear(TPCircularBuffer *buffer);
  * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
  */
 static __inline__ __attribute__((always_inline)) void* TPCircularBufferTail(TPCircularBuffer *buffer, int32_t* availableBytes) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    uint32_t tail = buffer->tail;
+    *availableBytes = (int32_t)(__atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE) - tail);
+    if ( *availableBytes == 0 ) return NULL;
+    return (void*)((char*)buffer->buffer + (tail & (buffer->length-1)));
+#else
     *availableBytes = buffer->fillCount;
     if ( *availableBytes == 0 ) return NULL;
     return (void*)((char*)buffer->buffer + buffer->tail);
+#endif
 }
 
 /*!
@@ -114,18 +185,28 @@ static __inline__ __attribute__((always_inline)) void* TPCircularBufferTail(TPCi
  * @param amount Number of bytes to consume
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferConsume(TPCircularBuffer *buffer, int32_t amount) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    assert((uint32_t)amount <= __atomic_load_n(&buffer->head, __ATOMIC_RELAXED) - buffer->tail);
+    __atomic_store_n(&buffer->tail, buffer->tail + amount, __ATOMIC_RELEASE);
+#else
     buffer->tail = (buffer->tail + amount) % buffer->length;
     OSAtomicAdd32Barrier(-amount, &buffer->fillCount);
     assert(buffer->fillCount >= 0);
+#endif
 }
 
 /*!
  * Version of TPCircularBufferConsume without the memory barrier, for more optimal use in single-threaded contexts
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferConsumeNoBarrier(TPCircularBuffer *buffer, int32_t amount) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    assert((uint32_t)amount <= __atomic_load_n(&buffer->head, __ATOMIC_RELAXED) - buffer->tail);
+    __atomic_store_n(&buffer->tail, buffer->tail + amount, __ATOMIC_RELAXED);
+#else
     buffer->tail = (buffer->tail + amount) % buffer->length;
     buffer->fillCount -= amount;
     assert(buffer->fillCount >= 0);
+#endif
 }
 
 /*!
@@ -139,9 +220,16 @@ static __inline__ __attribute__((always_inline)) void TPCircularBufferConsumeNoB
  * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
  */
 static __inline__ __attribute__((always_inline)) void* TPCircularBufferHead(TPCircularBuffer *buffer, int32_t* availableBytes) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    uint32_t head = buffer->head;
+    *availableBytes = buffer->length - (int32_t)(head - __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE));
+    if ( *availableBytes == 0 ) return NULL;
+    return (void*)((char*)buffer->buffer + (head & (buffer->length-1)));
+#else
     *availableBytes = (buffer->length - buffer->fillCount);
     if ( *availableBytes == 0 ) return NULL;
     return (void*)((char*)buffer->buffer + buffer->head);
+#endif
 }
     
 // Writing (producing)
@@ -155,18 +243,28 @@ static __inline__ __attribute__((always_inline)) void* TPCircularBufferHead(TPCi
  * @param amount Number of bytes to produce
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferProduce(TPCircularBuffer *buffer, int amount) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    assert(buffer->head + amount - __atomic_load_n(&buffer->tail, __ATOMIC_RELAXED) <= (uint32_t)buffer->length);
+    __atomic_store_n(&buffer->head, buffer->head + amount, __ATOMIC_RELEASE);
+#else
     buffer->head = (buffer->head + amount) % buffer->length;
     OSAtomicAdd32Barrier(amount, &buffer->fillCount);
     assert(buffer->fillCount <= buffer->length);
+#endif
 }
 
 /*!
  * Version of TPCircularBufferProduce without the memory barrier, for more optimal use in single-threaded contexts
  */
 static __inline__ __attribute__((always_inline)) void TPCircularBufferProduceNoBarrier(TPCircularBuffer *buffer, int amount) {
+#if TPCIRCULARBUFFER_SPLIT_INDICES
+    assert(buffer->head + amount - __atomic_load_n(&buffer->tail, __ATOMIC_RELAXED) <= (uint32_t)buffer->length);
+    __atomic_store_n(&buffer->head, buffer->head + amount, __ATOMIC_RELAXED);
+#else
     buffer->head = (buffer->head + amount) % buffer->length;
     buffer->fillCount += amount;
     assert(buffer->fillCount <= buffer->length);
+#endif
 }
 
 /*!
@@ -290,7 +290,18 @@ extern "C" {
  
  Note that you can use as many channels as the device can handle, and you can add/remove channels whenever you like, by
  calling [addChannels:](@ref AEAudioController::addChannels:) or [removeChannels:](@ref AEAudioController::removeChannels:).
- 
+
+ If a channel is expensive to render and doesn't need to respond instantly - an instrument playing back a sequence, for
+ example - wrap it in the AERenderAheadChannel class from the "Modules" directory, and add that instead. It renders the
+ channel ahead of time on a worker thread, so a slow buffer won't cause a dropout:
+
+ @code
+ AERenderAheadChannel *renderAhead = [[AERenderAheadChannel alloc] initWithChannel:_instrument
+                                                                   audioController:_audioController
+                                                                   renderAheadTime:0.1];
+ [_audioController addChannels:[NSArray arrayWithObject:renderAhead]];
+ @endcode
+
  @section Grouping-Channels Grouping Channels
  
  The Amazing Audio Engine provides *channel groups*, which let you construct trees of channels so you can do things with them
@@ -304,7 +315,19 @@ extern "C" {
  
  You can then perform a variety of operations on the channel groups, such as @link AEAudioController::setVolume:forChannelGroup: setting volume @endlink
  and @link AEAudioController::setPan:forChannelGroup: pan @endlink, and adding filters and audio receivers, which we shall cover next.
- 
+
+ If you're setting up many channels, groups and filters at once - when loading a session, say - wrap the changes in
+ [beginUpdates](@ref AEAudioController::beginUpdates) and [commitUpdates](@ref AEAudioController::commitUpdates). The
+ audio graph is then reconfigured once, on commit, rather than after every change:
+
+ @code
+ [_audioController beginUpdates];
+ AEChannelGroupRef drums = [_audioController createChannelGroup];
+ [_audioController addChannels:drumChannels toChannelGroup:drums];
+ [_audioController addFilter:_compressor toChannelGroup:drums];
+ [_audioController commitUpdates];
+ @endcode
+
  -----------
  
  So, you're creating audio - now it's time to do something with it: [Filtering](@ref Filtering).
@@ -449,6 +472,20 @@ self.filter = [AEBlockFilter filterWithBlock:^(AEAudioControllerFilterProducer p
  You can add and remove filters at any time, using @link AEAudioController::addFilter: addFilter: @endlink and 
  @link AEAudioController::removeFilter: removeFilter: @endlink, and the other channel, group and input equivalents.
 
+ To share one expensive effect, like a reverb, between several channels, create an *aux bus* with
+ @link AEAudioController::createAuxBusWithinChannelGroup: createAuxBusWithinChannelGroup: @endlink, add the filter to it
+ with @link AEAudioController::addFilter:toChannelGroup: addFilter:toChannelGroup: @endlink, then choose how much of each channel
+ to send to it:
+
+ @code
+ _reverbBus = [_audioController createAuxBusWithinChannelGroup:_mainGroup];
+ [_audioController addFilter:_reverb toChannelGroup:_reverbBus];
+ [_audioController setSendLevel:0.5 toAuxBus:_reverbBus forChannel:_drums];
+ [_audioController setSendLevel:0.2 toAuxBus:_reverbBus forChannel:_vocals];
+ @endcode
+
+ The bus mixes the sends together and runs its filters once per buffer, however many channels send to it.
+
  ------------
  
  Now you're producing audio and applying effects to it. But what if you want to record, process audio input, or do something else with the audio?
@@ -34,7 +34,7 @@ static void audioCallback(id THIS, AEAudioController *audioController, void *sou
     if ( !(self = [super init]) ) return nil;
 
     self.audioController = audioController;
-    self.floatConverter = [[[AEFloatConverter alloc] initWithSourceFormat:audioController.audioDescription] autorelease];
+    self.floatConverter = [[[AEFloatConverter alloc] initWithSourceFormat:audioController.busAudioDescription] autorelease];
     _conversionBuffer = AEAllocateAndInitAudioBufferList(_floatConverter.floatingPointAudioDescription, kMaxConversionSize);
     _ringBuffer = (float*)calloc(kRingBufferLength, sizeof(float));
     _scratchBuffer = (float*)malloc(kRingBufferLength * sizeof(float) * 2);
@@ -124,11 +124,12 @@ static void audioCallback(id THIS, AEAudioController *audioController, void *sou
 static void audioCallback(id THISptr, AEAudioController *audioController, void *source, const AudioTimeStamp *time, UInt32 frames, AudioBufferList *audio) {
     TPOscilloscopeLayer *THIS = (TPOscilloscopeLayer*)THISptr;
     
-    // Convert audio
-    AEFloatConverterToFloatBufferList(THIS->_floatConverter, audio, THIS->_conversionBuffer, frames);
-    
-    // Get a pointer to the audio buffer that we can advance
-    float *audioPtr = THIS->_conversionBuffer->mBuffers[0].mData;
+    // Convert audio, unless it's already floating-point
+    float *audioPtr = audio->mBuffers[0].mData;
+    if ( !AEFloatConverterIsPassThrough(THIS->_floatConverter) ) {
+        AEFloatConverterToFloatBufferList(THIS->_floatConverter, audio, THIS->_conversionBuffer, frames);
+        audioPtr = THIS->_conversionBuffer->mBuffers[0].mData;
+    }
     
     // Copy in contiguous segments, wrapping around if necessary
     int remainingFrames = frames;